@@ -26,6 +26,8 @@ KO_PLATFORM_PATH="/sys/devices/platform/userspace_battery"
 KO_VOLTAGE_FILE="${KO_PLATFORM_PATH}/set_voltage_uv"
 KO_CAPACITY_FILE="${KO_PLATFORM_PATH}/set_capacity"
 KO_STATUS_FILE="${KO_PLATFORM_PATH}/set_status"
+KO_TXN_FILE="${KO_PLATFORM_PATH}/transaction"
+KO_RESUME_FILE="${KO_PLATFORM_PATH}/resume_count"
 KO_CLASS_PATH="/sys/class/power_supply/userspace_battery"
 ENABLE_KO_WRITE=true
 
@@ -66,6 +68,7 @@ read_i2c_word_bytes() {
 # --- Initialization ---
 last_voltage=""
 charge_status="Monitoring"
+last_resume_count=$(cat "$KO_RESUME_FILE" 2>/dev/null)
 echo "--- Starting MAX17048 Polling -> userspace_battery KO (Tuned Thresholds) ---"
 echo "Timestamp             | Voltage (V) | SOC (%) | Temp (°C) | Status       "
 echo "----------------------|-------------|---------|-----------|---------------"
@@ -84,6 +87,16 @@ while true; do
     voltage_diff="" is_increasing="" is_decreasing="" new_charge_status="" ko_status_string=""
     vcell_read_success=1 soc_read_success=1 temp_read_success=1
 
+    # The system slept since the last tick: a voltage delta across the sleep
+    # means nothing, so restart the status history (the daemon does this
+    # the moment the module signals the resume)
+    resume_count=$(cat "$KO_RESUME_FILE" 2>/dev/null)
+    if [ "$resume_count" != "$last_resume_count" ]; then
+        echo "$timestamp | INFO: System resumed, restarting status history." >&2
+        last_voltage="" charge_status="Monitoring"
+        last_resume_count="$resume_count"
+    fi
+
     # Read Sensor Data
     raw_vcell_dec=$(read_i2c_word_bytes "$REG_VCELL")
     vcell_read_success=$?
@@ -184,9 +197,14 @@ while true; do
             # echo "$timestamp | DEBUG: Writing -> V_uV:$current_voltage_uv | Cap:$soc_percent_int | Status:$ko_status_string" >&2
             # --- END DEBUG ---
             write_error=0
+            # Stage the three writes and publish them together (printf is a builtin,
+            # so they all come from this shell's pid). Older modules lack the file.
+            txn_open=false
+            if [ -w "$KO_TXN_FILE" ] && printf "begin" > "$KO_TXN_FILE" 2>/dev/null; then txn_open=true; fi
             if [[ "$current_voltage_uv" =~ $REGEX_INT ]]; then printf "%s" "$current_voltage_uv" > "$KO_VOLTAGE_FILE" || write_error=1; else write_error=1; fi
             if [[ "$soc_percent_int" =~ $REGEX_INT ]]; then printf "%s" "$soc_percent_int" > "$KO_CAPACITY_FILE" || write_error=1; else write_error=1; fi
             printf "%s" "$ko_status_string" > "$KO_STATUS_FILE" || write_error=1
+            if [ "$txn_open" = true ]; then printf "commit" > "$KO_TXN_FILE" || write_error=1; fi
             # Add error reporting if needed
             # if [ "$write_error" -ne 0 ]; then echo "$timestamp | ERROR writing to KO sysfs!" >&2; fi
         elif [ ! -d "$KO_PLATFORM_PATH" ]; then
@@ -0,0 +1,138 @@
+// battlog - export userspace_batteryd telemetry logs as CSV or JSON
+//
+// Reads one or more binary logs (the [log] path and its rotations, oldest
+// first: battlog log.2 log.1 log) and prints one line per record, either
+// CSV with a header row or JSON Lines. Files written by a newer daemon with
+// larger records are read too; the extra fields are skipped.
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <getopt.h>
+
+#include "classifier.h"
+#include "gauge.h"
+#include "telemetry_log.h"
+
+using namespace battd;
+
+enum class Format { Csv, Json };
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [-f csv|json] [-g gauge] log...\n"
+            "  -f  output format (default csv)\n"
+            "  -g  only records of this gauge\n",
+            prog);
+}
+
+static void print_record(Format fmt, const std::string &gauge, const TelemetryRecord &r) {
+    const char *chip = chip_type_name(static_cast<ChipType>(r.chip));
+    const char *state = charge_state_name(static_cast<ChargeState>(r.state));
+    char wall[40], rate[24] = "", temp[24] = "";
+
+    format_wall(wall, sizeof(wall), r.wall_ns);
+    if (r.flags & TELEMETRY_RATE_VALID)
+        snprintf(rate, sizeof(rate), "%.3f", r.rate_milli / 1000.0);
+    if (r.flags & TELEMETRY_TEMP_VALID)
+        snprintf(temp, sizeof(temp), "%.1f", r.temp_mc / 1000.0);
+
+    if (fmt == Format::Csv) {
+        printf("%s,%.3f,%s,%s,%.6f,%.3f,%s,%s,%s,%d,%d,0x%04x,0x%04x,0x%04x,0x%02x,%u,%u\n", wall,
+               r.mono_ns / 1e9, gauge.c_str(), chip, r.voltage_uv / 1e6, r.soc_milli / 1000.0, rate,
+               temp, state, r.tte_s, r.ttf_s, r.raw_voltage, r.raw_soc, r.raw_rate, r.flags,
+               r.syscalls, r.latency_us);
+        return;
+    }
+    printf("{\"time\":\"%s\",\"mono_s\":%.3f,\"gauge\":\"%s\",\"chip\":\"%s\",\"voltage_v\":%.6f,"
+           "\"soc_pct\":%.3f,\"rate_pct_h\":%s,\"temp_c\":%s,\"state\":\"%s\",\"tte_s\":%d,"
+           "\"ttf_s\":%d,\"raw_voltage\":%u,\"raw_soc\":%u,\"raw_rate\":%u,\"hibernating\":%s,"
+           "\"published\":%s,\"syscalls\":%u,\"latency_us\":%u}\n",
+           wall, r.mono_ns / 1e9, json_escape(gauge).c_str(), chip, r.voltage_uv / 1e6,
+           r.soc_milli / 1000.0, *rate ? rate : "null", *temp ? temp : "null", state, r.tte_s,
+           r.ttf_s, r.raw_voltage, r.raw_soc, r.raw_rate, r.flags & TELEMETRY_HIBERNATING ? "true" : "false",
+           r.flags & TELEMETRY_PUBLISHED ? "true" : "false", r.syscalls, r.latency_us);
+}
+
+static bool dump_file(const char *path, Format fmt, const std::string &only) {
+    std::ifstream in(path, std::ios::binary);
+    std::vector<std::string> names;
+    std::vector<char> raw;
+    TelemetryFileHeader h;
+    TelemetryRecord r;
+
+    if (!in) {
+        fprintf(stderr, "Error: cannot open %s\n", path);
+        return false;
+    }
+    if (!in.read(reinterpret_cast<char *>(&h), sizeof(h)) ||
+        memcmp(h.magic, TELEMETRY_MAGIC, sizeof(h.magic)) != 0) {
+        fprintf(stderr, "Error: %s: not a telemetry log\n", path);
+        return false;
+    }
+    if (h.record_size < sizeof(TelemetryRecord) || h.name_len == 0) {
+        fprintf(stderr, "Error: %s: unsupported record layout (version %u)\n", path, h.version);
+        return false;
+    }
+
+    raw.resize(h.name_len);
+    for (unsigned i = 0; i < h.num_gauges; i++) {
+        if (!in.read(raw.data(), h.name_len)) {
+            fprintf(stderr, "Error: %s: truncated header\n", path);
+            return false;
+        }
+        names.emplace_back(raw.data(), strnlen(raw.data(), h.name_len));
+    }
+
+    raw.resize(h.record_size);
+    // A torn record at the end (crash mid-write) is not an error
+    while (in.read(raw.data(), h.record_size)) {
+        memcpy(&r, raw.data(), sizeof(r));
+        const std::string gauge = r.gauge < names.size() ? names[r.gauge] : std::to_string(r.gauge);
+
+        if (!only.empty() && gauge != only)
+            continue;
+        print_record(fmt, gauge, r);
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    Format fmt = Format::Csv;
+    std::string only;
+    bool ok = true;
+    int c;
+
+    while ((c = getopt(argc, argv, "f:g:h")) != -1) {
+        switch (c) {
+        case 'f':
+            if (strcmp(optarg, "csv") == 0) {
+                fmt = Format::Csv;
+            } else if (strcmp(optarg, "json") == 0) {
+                fmt = Format::Json;
+            } else {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'g': only = optarg; break;
+        default:
+            usage(argv[0]);
+            return c == 'h' ? 0 : 1;
+        }
+    }
+    if (optind >= argc) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (fmt == Format::Csv)
+        printf("time,mono_s,gauge,chip,voltage_v,soc_pct,rate_pct_h,temp_c,state,tte_s,ttf_s,"
+               "raw_voltage,raw_soc,raw_rate,flags,syscalls,latency_us\n");
+    for (int i = optind; i < argc; i++)
+        ok &= dump_file(argv[i], fmt, only);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,92 @@
+#include "bq27xxx.h"
+
+#include <algorithm>
+
+#include <unistd.h>
+
+namespace battd {
+namespace bq27xxx {
+
+// --- Family read path ---
+
+template <typename M>
+class Bq27xxx final : public GaugeChip {
+    // Every standard command the sample needs, in one transaction
+    static constexpr uint8_t FIRST = std::min({ M::temp, M::voltage, M::full_charge_cap,
+                                                M::avg_current, M::soc });
+    static constexpr uint8_t LAST = std::max({ M::temp, M::voltage, M::full_charge_cap,
+                                               M::avg_current, M::soc });
+    static constexpr size_t BLOCK_LEN = LAST + 2 - FIRST;
+    static_assert(BLOCK_LEN <= 32, "standard commands too far apart for one read");
+
+    static uint16_t word(const uint8_t *block, uint8_t reg) {
+        const uint8_t *p = block + (reg - FIRST);
+
+        return static_cast<uint16_t>(p[0] | (p[1] << 8));
+    }
+
+public:
+    ChipType type() const override { return M::type; }
+
+    int read_sample(I2cBus &bus, uint16_t addr, Sample *s, SyscallStats *st) override {
+        uint8_t block[BLOCK_LEN];
+        uint16_t fcc;
+        int ret;
+
+        ret = bus.read_regs(addr, FIRST, block, sizeof(block), st);
+        if (ret) return ret;
+
+        s->raw_voltage = word(block, M::voltage);
+        s->raw_soc = word(block, M::soc);
+        s->raw_rate = word(block, M::avg_current);
+        s->voltage_uv = static_cast<uint64_t>(s->raw_voltage) * 1000;
+        s->soc_percent = s->raw_soc > 100 ? 100 : s->raw_soc;
+        s->temp_valid = true;
+        s->temp_mc = static_cast<int>(word(block, M::temp)) * 100 - 273150;
+
+        // Same unit as MAX17048 CRATE, from average current and capacity
+        fcc = word(block, M::full_charge_cap);
+        s->full_mah = fcc;
+        s->crate_valid = fcc != 0;
+        if (s->crate_valid)
+            s->crate_pct_per_hour = static_cast<int16_t>(s->raw_rate) * 100.0 / fcc;
+        return 0;
+    }
+};
+
+bool device_type_map(uint16_t device_type, ChipType *t) {
+    switch (device_type) {
+    case 0x0421:    // BQ27421, BQ27441
+    case 0x0425:
+    case 0x0426:
+        *t = ChipType::Bq27421;
+        return true;
+    default:
+        return false;
+    }
+}
+
+int read_device_type(I2cBus &bus, uint16_t addr, uint16_t *device_type, SyscallStats *st) {
+    uint8_t buf[2] = { CONTROL_DEVICE_TYPE & 0xFF, CONTROL_DEVICE_TYPE >> 8 };
+    int ret;
+
+    ret = bus.write_regs(addr, CMD_CONTROL, buf, sizeof(buf), st);
+    if (ret) return ret;
+    // The gauge needs a moment before the result can be read back
+    usleep(1000);
+    ret = bus.read_regs(addr, CMD_CONTROL, buf, sizeof(buf), st);
+    if (ret) return ret;
+
+    *device_type = static_cast<uint16_t>(buf[0] | (buf[1] << 8));
+    return 0;
+}
+
+std::unique_ptr<GaugeChip> make_chip(ChipType t) {
+    switch (t) {
+    case ChipType::Bq27421: return std::unique_ptr<GaugeChip>(new Bq27xxx<Bq27421Map>());
+    default: return nullptr;
+    }
+}
+
+} // namespace bq27xxx
+} // namespace battd
@@ -0,0 +1,43 @@
+#ifndef USERSPACE_BATTERYD_BQ27XXX_H
+#define USERSPACE_BATTERYD_BQ27XXX_H
+
+#include <cstdint>
+#include <memory>
+
+#include "gauge.h"
+#include "i2c_bus.h"
+#include "syscall_stats.h"
+
+namespace battd {
+namespace bq27xxx {
+
+// --- Control() (command 0x00, little-endian subcommand) ---
+constexpr uint8_t CMD_CONTROL = 0x00;
+constexpr uint16_t CONTROL_DEVICE_TYPE = 0x0001;
+
+constexpr uint16_t DEFAULT_ADDR = 0x55;
+
+// --- Standard command maps (16-bit, LSB first) ---
+// One per register layout; BQ27421/441/425/426 share the same one.
+struct Bq27421Map {
+    static constexpr ChipType type = ChipType::Bq27421;
+    static constexpr uint8_t temp = 0x02;           // 0.1 K
+    static constexpr uint8_t voltage = 0x04;        // mV
+    static constexpr uint8_t full_charge_cap = 0x0E; // mAh
+    static constexpr uint8_t avg_current = 0x10;    // mA, signed, > 0 charging
+    static constexpr uint8_t soc = 0x1C;            // %
+};
+
+// DEVICE_TYPE -> register map. Returns false for parts without a map.
+bool device_type_map(uint16_t device_type, ChipType *t);
+
+// Control(DEVICE_TYPE). Returns 0 or -errno.
+int read_device_type(I2cBus &bus, uint16_t addr, uint16_t *device_type, SyscallStats *st);
+
+// nullptr unless t is a BQ27xxx type
+std::unique_ptr<GaugeChip> make_chip(ChipType t);
+
+} // namespace bq27xxx
+} // namespace battd
+
+#endif // USERSPACE_BATTERYD_BQ27XXX_H
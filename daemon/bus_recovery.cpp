@@ -0,0 +1,88 @@
+#include "bus_recovery.h"
+
+#include <cerrno>
+#include <chrono>
+#include <thread>
+
+#include "bus_worker.h"
+
+namespace battd {
+
+I2cError classify_i2c_error(int err) {
+    switch (-err) {
+    case ENXIO:
+    case EREMOTEIO: return I2cError::Nack;
+    case ETIMEDOUT: return I2cError::Timeout;
+    case EAGAIN:    return I2cError::Arbitration;
+    case ENODEV:
+    case ENOENT:
+    case EBADF:     return I2cError::NoDevice;
+    default:        return I2cError::Bus;
+    }
+}
+
+const char *i2c_error_name(I2cError e) {
+    switch (e) {
+    case I2cError::Nack:        return "nack";
+    case I2cError::Timeout:     return "timeout";
+    case I2cError::Arbitration: return "arbitration";
+    case I2cError::Bus:         return "bus";
+    case I2cError::NoDevice:    return "nodev";
+    case I2cError::COUNT:       break;
+    }
+    return "unknown";
+}
+
+BusGuard::BusGuard(I2cBus &bus)
+    : bus_(bus), rng_(static_cast<unsigned>(monotonic_ns())) {}
+
+int BusGuard::run(const RecoveryPolicy &p, int64_t deadline_ns, const std::function<int()> &op,
+                  RecoveryStats *rs, SyscallStats *st) {
+    I2cError cls = I2cError::Bus;
+    int64_t t0;
+    int ret;
+
+    for (unsigned attempt = 0;; attempt++) {
+        uint64_t cap_us = static_cast<uint64_t>(p.backoff_ms) * 1000 << (attempt < 16 ? attempt : 16);
+        uint64_t delay_us;
+
+        ret = op();
+        if (!ret) {
+            failures_ = 0;
+            return 0;
+        }
+        cls = classify_i2c_error(ret);
+        rs->errors[static_cast<size_t>(cls)]++;
+        // Retrying on a dead fd cannot help
+        if (cls == I2cError::NoDevice || attempt >= p.retries)
+            break;
+
+        // Half fixed, half random: spreads gauges that failed together
+        delay_us = cap_us / 2 + std::uniform_int_distribution<uint64_t>(0, cap_us / 2)(rng_);
+        if (monotonic_ns() + static_cast<int64_t>(delay_us) * 1000 >= deadline_ns)
+            break;
+        std::this_thread::sleep_for(std::chrono::microseconds(delay_us));
+        rs->retries++;
+    }
+
+    failures_++;
+    if (!p.recover_after || (failures_ < p.recover_after && cls != I2cError::NoDevice))
+        return ret;
+
+    t0 = monotonic_ns();
+    rs->recovered = true;
+    rs->recovery_err = bus_.recover(p.rebind, st);
+    rs->recovery_ns = monotonic_ns() - t0;
+    failures_ = 0;
+    if (rs->recovery_err)
+        return ret;
+
+    ret = op();
+    if (ret) {
+        rs->errors[static_cast<size_t>(classify_i2c_error(ret))]++;
+        failures_ = 1;
+    }
+    return ret;
+}
+
+} // namespace battd
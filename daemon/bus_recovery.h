@@ -0,0 +1,68 @@
+#ifndef USERSPACE_BATTERYD_BUS_RECOVERY_H
+#define USERSPACE_BATTERYD_BUS_RECOVERY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <random>
+
+#include "i2c_bus.h"
+#include "syscall_stats.h"
+
+namespace battd {
+
+// --- I2C error classes ---
+// What the adapter drivers return, grouped by what can be done about it.
+enum class I2cError : unsigned {
+    Nack,           // ENXIO, EREMOTEIO: chip busy or absent, retry
+    Timeout,        // ETIMEDOUT: clock stretched or bus held low
+    Arbitration,    // EAGAIN: lost to another master, retry
+    Bus,            // EIO, EBUSY, anything else
+    NoDevice,       // ENODEV, ENOENT, EBADF: adapter gone, reopen
+    COUNT,
+};
+constexpr size_t I2C_ERROR_CLASSES = static_cast<size_t>(I2cError::COUNT);
+
+I2cError classify_i2c_error(int err);
+const char *i2c_error_name(I2cError e);
+
+struct RecoveryPolicy {
+    unsigned retries = 2;           // extra attempts within the deadline
+    unsigned backoff_ms = 5;        // doubles per attempt, equal jitter
+    unsigned deadline_ms = 1000;    // from when the sample was queued
+    unsigned recover_after = 3;     // failed samples in a row, 0 = never recover
+    bool rebind = false;            // recovery also rebinds the adapter driver
+};
+
+// What one guarded operation went through
+struct RecoveryStats {
+    unsigned errors[I2C_ERROR_CLASSES] = {};    // every failed attempt
+    unsigned retries = 0;
+    bool recovered = false;         // bus recovery ran
+    int recovery_err = 0;
+    int64_t recovery_ns = 0;
+};
+
+// --- Retry and recovery around bus operations ---
+// One per bus, used only by its thread. Failed samples are counted across
+// every gauge on the bus, since a wedged bus fails them all alike.
+class BusGuard {
+public:
+    explicit BusGuard(I2cBus &bus);
+
+    // Run op (idempotent reads) until it succeeds, the retries are spent or
+    // the next backoff would end past deadline_ns. When the bus has failed
+    // recover_after samples in a row, or the adapter vanished, recover it
+    // and try once more. Returns 0 or op's last -errno.
+    int run(const RecoveryPolicy &p, int64_t deadline_ns, const std::function<int()> &op,
+            RecoveryStats *rs, SyscallStats *st);
+
+private:
+    I2cBus &bus_;
+    std::minstd_rand rng_;
+    unsigned failures_ = 0;
+};
+
+} // namespace battd
+
+#endif // USERSPACE_BATTERYD_BUS_RECOVERY_H
@@ -0,0 +1,256 @@
+#include "bus_worker.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <ctime>
+
+#include <pthread.h>
+#include <sched.h>
+
+namespace battd {
+
+int64_t monotonic_ns() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// --- BusWorker ---
+
+BusWorker::~BusWorker() {
+    stop();
+}
+
+void BusWorker::add_gauge(const SampleJob &base, const GaugeParams &params) {
+    Slot &sl = slots_[base.gauge];
+
+    sl.base = base;
+    sl.params = params;
+}
+
+int BusWorker::start() {
+    int64_t now;
+    int ret = bus_.open();
+
+    if (ret)
+        return ret;
+    if (wake_.fd() < 0)
+        return -EMFILE;
+    // First sample right away, then every interval
+    now = monotonic_ns();
+    for (auto &s : slots_)
+        s.second.next_ns = now;
+    thread_ = std::thread(&BusWorker::run, this);
+    return 0;
+}
+
+int BusWorker::set_policy(const AcquirePolicy &p) {
+    int ret;
+
+    if (p.cpu >= 0) {
+        cpu_set_t set;
+
+        CPU_ZERO(&set);
+        CPU_SET(p.cpu, &set);
+        ret = pthread_setaffinity_np(thread_.native_handle(), sizeof(set), &set);
+        if (ret)
+            return -ret;
+    }
+    if (p.priority > 0) {
+        struct sched_param sp = {};
+
+        sp.sched_priority = p.priority;
+        ret = pthread_setschedparam(thread_.native_handle(), SCHED_FIFO, &sp);
+        if (ret)
+            return -ret;
+    }
+    return 0;
+}
+
+void BusWorker::stop() {
+    stopping_.store(true, std::memory_order_release);
+    wake_.ring();
+    if (thread_.joinable())
+        thread_.join();
+}
+
+bool BusWorker::command(const GaugeCommand &c) {
+    if (!commands_.try_push(c))
+        return false;
+    wake_.ring();
+    return true;
+}
+
+// Identify the gauge on its first job (and again after a failed attempt).
+// Returns 0 or -errno.
+int BusWorker::chip_for(const SampleJob &job, GaugeChip **chip, SampleResult *r) {
+    auto &slot = chips_[job.addr];
+    int err = 0;
+
+    if (!slot) {
+        slot = detect_chip(bus_, job.addr, job.chip, &r->chip_id, &err, &r->st);
+        if (!slot)
+            return err;
+        r->detected = slot->type();
+    }
+    *chip = slot.get();
+    return 0;
+}
+
+// Run one job on the bus; the body of every sample
+void BusWorker::sample(const SampleJob &job, SampleResult *r) {
+    GaugeChip *chip = nullptr;
+    auto known = chips_.end();
+    int64_t deadline;
+    int unknown = 0;
+    // Identification happens under the same retries as the read
+    auto read = [&]() -> int {
+        int err;
+
+        if (!chip) {
+            r->chip_id = 0;
+            err = chip_for(job, &chip, r);
+            // The chip answered with an ID we do not know: the bus is
+            // fine, so no retries or recovery. An all-zero answer is
+            // what a bus held low reads and stays a bus error.
+            if (err == -ENODEV && r->chip_id) {
+                unknown = err;
+                return 0;
+            }
+            if (err)
+                return err;
+        }
+        if (job.probe)
+            return chip->read_power_state(bus_, job.addr, &r->sample, &r->st);
+        return chip->read_sample(bus_, job.addr, &r->sample, &r->st);
+    };
+
+    r->gauge = job.gauge;
+    r->alert = job.alert;
+    r->queued_ns = job.queued_ns;
+    r->start_ns = monotonic_ns();
+    deadline = job.queued_ns + static_cast<int64_t>(job.recovery.deadline_ms) * 1000000;
+
+    // Settings go to a chip that is already known; a gauge identified
+    // by this job gets them with the next one
+    known = chips_.find(job.addr);
+    if (known != chips_.end() && known->second) {
+        chip = known->second.get();
+        if (job.rcomp >= 0) {
+            r->rcomp = job.rcomp;
+            r->rcomp_err = chip->write_rcomp(bus_, job.addr, static_cast<uint8_t>(job.rcomp), &r->st);
+        }
+        if (job.hibrt >= 0) {
+            r->hibrt = job.hibrt;
+            r->hibrt_err = chip->write_hibrt(bus_, job.addr, static_cast<uint16_t>(job.hibrt), &r->st);
+        }
+    }
+
+    r->probe = job.probe;
+    r->err = guard_.run(job.recovery, deadline, read, &r->recovery, &r->st);
+    if (!r->err && unknown)
+        r->err = unknown;
+    // Even after a failed read: the ALRT line stays low until cleared
+    if (job.alert && chip)
+        chip->clear_alert(bus_, job.addr, &r->alert_flags, &r->reset, &r->st);
+    r->done_ns = monotonic_ns();
+}
+
+void BusWorker::apply(const GaugeCommand &c, int64_t now) {
+    auto it = slots_.find(c.gauge);
+
+    if (it == slots_.end())
+        return;
+    Slot &sl = it->second;
+
+    if (c.update) {
+        // Next tick one new interval from now
+        if (c.params.interval_ms != sl.params.interval_ms)
+            sl.next_ns = now + static_cast<int64_t>(c.params.interval_ms) * 1000000;
+        sl.params = c.params;
+    }
+    if (c.sample) {
+        // Requests that pile up while the bus is busy share one sample
+        if (!sl.sample_now)
+            sl.now_ns = c.queued_ns;
+        sl.sample_now = true;
+        sl.alert |= c.alert;
+    }
+}
+
+// Sample one gauge and move its schedule past now. A tick that falls due
+// during an explicit sample is covered by it.
+void BusWorker::take(Slot &sl, int64_t now) {
+    const int64_t interval = static_cast<int64_t>(sl.params.interval_ms) * 1000000;
+    SampleJob job = sl.base;
+    SampleResult r;
+    bool tick = sl.next_ns <= now;
+
+    job.rcomp = sl.params.rcomp;
+    job.hibrt = sl.params.hibrt;
+    job.probe = sl.params.probe;
+    job.queued_ns = sl.sample_now ? sl.now_ns : sl.next_ns;
+    job.alert = sl.sample_now && sl.alert;
+    sl.sample_now = sl.alert = false;
+    // Retries must not run into the next tick
+    job.recovery.deadline_ms = std::min(job.recovery.deadline_ms, sl.params.interval_ms);
+
+    sample(job, &r);
+
+    if (tick) {
+        sl.next_ns += interval;
+        // A sample that overran skips the ticks it ran into instead of
+        // taking them back to back
+        while (sl.next_ns <= r.done_ns) {
+            sl.next_ns += interval;
+            r.missed++;
+        }
+    }
+
+    if (results_.try_push(r)) {
+        // Written (or refused) once; the loop asks again if it still wants
+        // them. Only once it has the result: until then its sync_params()
+        // takes them as queued, so a dropped result must leave them set
+        // and they go out again with the next sample.
+        if (r.rcomp >= 0)
+            sl.params.rcomp = -1;
+        if (r.hibrt >= 0)
+            sl.params.hibrt = -1;
+    } else {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+    }
+    done_->ring();
+}
+
+void BusWorker::run() {
+    while (!stopping_.load(std::memory_order_acquire)) {
+        GaugeCommand c;
+        Slot *due = nullptr;
+        int64_t now = monotonic_ns(), wake = INT64_MAX;
+
+        while (commands_.try_pop(&c))
+            apply(c, now);
+
+        // Explicit requests first, then the most overdue tick
+        for (auto &s : slots_) {
+            Slot &sl = s.second;
+
+            if (sl.sample_now) {
+                due = &sl;
+                break;
+            }
+            if (sl.next_ns <= now && (!due || sl.next_ns < due->next_ns))
+                due = &sl;
+            wake = std::min(wake, sl.next_ns);
+        }
+        if (due) {
+            take(*due, now);
+            continue;
+        }
+        wake_.wait(wake == INT64_MAX ? -1 : wake - now);
+    }
+}
+
+} // namespace battd
@@ -0,0 +1,163 @@
+#ifndef USERSPACE_BATTERYD_BUS_WORKER_H
+#define USERSPACE_BATTERYD_BUS_WORKER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <thread>
+
+#include "bus_recovery.h"
+#include "gauge.h"
+#include "i2c_bus.h"
+#include "spsc_ring.h"
+#include "syscall_stats.h"
+
+namespace battd {
+
+// --- Work items exchanged with the bus threads ---
+// What the loop wants from the bus thread for one gauge. Sent again
+// whenever it changes; rcomp and hibrt are written once, to a chip that is
+// already identified, and then dropped by the thread once the result that
+// reports the write is queued to the loop.
+struct GaugeParams {
+    unsigned interval_ms = 0;   // sampling period; changing it restarts the schedule
+    bool probe = false;         // gauge asleep: only read its power state
+    int rcomp = -1;             // write CONFIG.RCOMP before sampling, -1 = leave it
+    int hibrt = -1;             // write HIBRT before sampling, -1 = leave it
+
+    bool operator==(const GaugeParams &o) const {
+        return interval_ms == o.interval_ms && probe == o.probe && rcomp == o.rcomp &&
+               hibrt == o.hibrt;
+    }
+    bool operator!=(const GaugeParams &o) const { return !(*this == o); }
+};
+
+// epoll loop -> bus thread
+struct GaugeCommand {
+    size_t gauge = 0;
+    bool update = false;        // params replace the thread's copy
+    GaugeParams params;
+    bool sample = false;        // take a sample now, outside the schedule
+    bool alert = false;         // ... and acknowledge ALRT after it
+    int64_t queued_ns = 0;      // CLOCK_MONOTONIC
+};
+
+// One sample as the bus thread runs it
+struct SampleJob {
+    size_t gauge = 0;           // index into the daemon's gauge table
+    uint16_t addr = 0;
+    ChipType chip = ChipType::Auto; // configured type, checked on first use
+    bool alert = false;
+    int rcomp = -1;
+    int hibrt = -1;
+    bool probe = false;
+    RecoveryPolicy recovery;    // retries within recovery.deadline_ms of queued_ns
+    int64_t queued_ns = 0;      // the schedule tick, or when the command was sent
+};
+
+struct SampleResult {
+    size_t gauge = 0;
+    int err = 0;                // 0 or -errno from detection or the sample read
+    ChipType detected = ChipType::Auto; // set by the job that identified the chip
+    uint16_t chip_id = 0;       // its VERSION / DEVICE_TYPE
+    bool alert = false;
+    uint8_t alert_flags = 0;    // chip status flags seen on an alert job
+    bool reset = false;         // they report a power-on reset
+    int rcomp = -1;             // RCOMP the job wrote, -1 if none
+    int rcomp_err = 0;          // 0 or -errno from that write
+    int hibrt = -1;             // HIBRT the job wrote, -1 if none
+    int hibrt_err = 0;
+    bool probe = false;         // sample holds only hibernating/asleep
+    unsigned missed = 0;        // schedule ticks skipped because this one overran
+    RecoveryStats recovery;     // retries, error classes and bus recovery
+    Sample sample;
+    SyscallStats st;
+    int64_t queued_ns = 0;
+    int64_t start_ns = 0;
+    int64_t done_ns = 0;
+};
+
+// Scheduling of the acquisition threads. priority > 0 runs them SCHED_FIFO.
+struct AcquirePolicy {
+    int priority = 0;
+    int cpu = -1;               // pin to this CPU, -1 = anywhere
+};
+
+// --- One thread per I2C bus ---
+// Every transaction for a bus goes through its worker, so gauges sharing a
+// bus are strictly serialized while different buses run in parallel.
+//
+// The thread owns its gauges' sampling schedule: ticks are absolute
+// CLOCK_MONOTONIC deadlines, so however late the loop drains results, the
+// next sample is taken on time. Commands arrive and results leave through
+// SPSC rings; a full result ring drops the result rather than waiting.
+class BusWorker {
+public:
+    static constexpr size_t RING_SIZE = 64;
+
+    // done is rung after every result
+    BusWorker(int bus, Doorbell *done) : bus_(bus), guard_(bus_), done_(done) {}
+    ~BusWorker();
+
+    BusWorker(const BusWorker &) = delete;
+    BusWorker &operator=(const BusWorker &) = delete;
+
+    // Before start(): sample base.gauge every params.interval_ms, the first
+    // time right away.
+    void add_gauge(const SampleJob &base, const GaugeParams &params);
+
+    // Open /dev/i2c-N and start the thread. Returns 0 or -errno.
+    int start();
+    // Apply an AcquirePolicy to the running thread. Returns 0 or -errno.
+    int set_policy(const AcquirePolicy &p);
+    void stop();
+
+    // Loop thread only. Returns false if the command ring is full.
+    bool command(const GaugeCommand &c);
+    bool pop_result(SampleResult *r) { return results_.try_pop(r); }
+
+    // Ring state for the metrics; results lost to a full ring
+    size_t command_depth() const { return commands_.depth(); }
+    size_t command_high_water() const { return commands_.high_water(); }
+    size_t result_depth() const { return results_.depth(); }
+    size_t result_high_water() const { return results_.high_water(); }
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+    int number() const { return bus_.number(); }
+
+private:
+    struct Slot {
+        SampleJob base;
+        GaugeParams params;
+        int64_t next_ns = 0;    // next schedule tick
+        bool sample_now = false;
+        bool alert = false;
+        int64_t now_ns = 0;     // when the pending sample_now was sent
+    };
+
+    void run();
+    void apply(const GaugeCommand &c, int64_t now);
+    void take(Slot &sl, int64_t now);
+    void sample(const SampleJob &job, SampleResult *r);
+    int chip_for(const SampleJob &job, GaugeChip **chip, SampleResult *r);
+
+    I2cBus bus_;
+    BusGuard guard_;
+    std::map<uint16_t, std::unique_ptr<GaugeChip>> chips_;  // by address, bus thread only
+    std::map<size_t, Slot> slots_;  // by gauge, bus thread only once started
+    Doorbell *done_;
+    Doorbell wake_;
+    SpscRing<GaugeCommand, RING_SIZE> commands_;
+    SpscRing<SampleResult, RING_SIZE> results_;
+    std::atomic<uint64_t> dropped_{0};
+    std::atomic<bool> stopping_{false};
+    std::thread thread_;
+};
+
+int64_t monotonic_ns();
+
+} // namespace battd
+
+#endif // USERSPACE_BATTERYD_BUS_WORKER_H
@@ -0,0 +1,329 @@
+#include "classifier.h"
+
+namespace battd {
+
+// --- Transition tables ---
+
+static constexpr ChargePhase MON = ChargePhase::Monitoring;
+static constexpr ChargePhase STB = ChargePhase::Stable;
+static constexpr ChargePhase CHG = ChargePhase::Charging;
+static constexpr ChargePhase DIS = ChargePhase::Discharging;
+static constexpr ChargePhase CHF = ChargePhase::ChargingFall;
+static constexpr ChargePhase DSR = ChargePhase::DischargingRise;
+
+// MAX17048.sh's rule, made symmetric: a step from Stable takes a direction
+// at once, a reversal needs two steps in a row, and a flat step cancels a
+// pending one. The script went Discharging -> Charging on one rise but
+// never left Charging on falls at all.
+static constexpr ChargeTable DELTA_TABLE = { {
+    //          Invalid Warmup Rise Fall Flat Quiet Ambiguous
+    /* MON */ { MON,    MON,   CHG, DIS, STB, STB,  MON },
+    /* STB */ { MON,    MON,   CHG, DIS, STB, STB,  STB },
+    /* CHG */ { MON,    MON,   CHG, CHF, CHG, CHG,  CHG },
+    /* DIS */ { MON,    MON,   DSR, DIS, DIS, DIS,  DIS },
+    /* CHF */ { MON,    MON,   CHG, DIS, CHG, CHG,  CHG },
+    /* DSR */ { MON,    MON,   CHG, DIS, DIS, DIS,  DIS },
+} };
+
+// The slope guard already demands confidence, so a confident event is
+// taken at once; Quiet only settles a first decision, Ambiguous holds.
+// Warmup holds too: after a gap longer than the window (a gauge waking
+// from hibernation, a bus outage) the estimator is down to a few points,
+// which says nothing against what was reported before the gap.
+// The pending phases are unreachable here and behave like their direction.
+static constexpr ChargeTable SLOPE_TABLE = { {
+    //          Invalid Warmup Rise Fall Flat Quiet Ambiguous
+    /* MON */ { MON,    MON,   CHG, DIS, STB, STB,  MON },
+    /* STB */ { MON,    STB,   CHG, DIS, STB, STB,  STB },
+    /* CHG */ { MON,    CHG,   CHG, DIS, STB, CHG,  CHG },
+    /* DIS */ { MON,    DIS,   CHG, DIS, STB, DIS,  DIS },
+    /* CHF */ { MON,    CHG,   CHG, DIS, STB, CHG,  CHG },
+    /* DSR */ { MON,    DIS,   CHG, DIS, STB, DIS,  DIS },
+} };
+
+// --- Compile-time checks ---
+// Every (phase, event) pair of both tables, and the guards over a grid
+// of inputs around their thresholds.
+
+static constexpr ChargeEvent EVENTS[] = { ChargeEvent::Invalid, ChargeEvent::Warmup, ChargeEvent::Rise,
+                                          ChargeEvent::Fall, ChargeEvent::Flat, ChargeEvent::Quiet,
+                                          ChargeEvent::Ambiguous };
+static constexpr ChargePhase PHASES[] = { MON, STB, CHG, DIS, CHF, DSR };
+static_assert(sizeof(EVENTS) / sizeof(EVENTS[0]) == NUM_CHARGE_EVENTS, "event list");
+static_assert(sizeof(PHASES) / sizeof(PHASES[0]) == NUM_CHARGE_PHASES, "phase list");
+
+// Charging <-> Discharging
+static constexpr ChargePhase mirror(ChargePhase p) {
+    switch (p) {
+    case CHG: return DIS;
+    case DIS: return CHG;
+    case CHF: return DSR;
+    case DSR: return CHF;
+    default:  return p;
+    }
+}
+
+static constexpr ChargeEvent mirror(ChargeEvent e) {
+    return e == ChargeEvent::Rise ? ChargeEvent::Fall : e == ChargeEvent::Fall ? ChargeEvent::Rise : e;
+}
+
+static constexpr ChargeState mirror(ChargeState s) {
+    return s == ChargeState::Charging ? ChargeState::Discharging
+         : s == ChargeState::Discharging ? ChargeState::Charging : s;
+}
+
+// What rising does from p, falling does from mirror(p)
+static constexpr bool symmetric(const ChargeTable &t) {
+    for (ChargePhase p : PHASES)
+        for (ChargeEvent e : EVENTS)
+            if (mirror(t(p, e)) != t(mirror(p), mirror(e)))
+                return false;
+    return true;
+}
+
+// Event e leaves every phase in Monitoring
+static constexpr bool restarts(const ChargeTable &t, ChargeEvent e) {
+    for (ChargePhase p : PHASES)
+        if (t(p, e) != MON)
+            return false;
+    return true;
+}
+
+// Event e never changes what is reported
+static constexpr bool holds(const ChargeTable &t, ChargeEvent e) {
+    for (ChargePhase p : PHASES)
+        if (charge_phase_state(t(p, e)) != charge_phase_state(p))
+            return false;
+    return true;
+}
+
+// No event reports the opposite of what it measured
+static constexpr bool sane(const ChargeTable &t) {
+    for (ChargePhase p : PHASES) {
+        ChargeState s = charge_phase_state(p);
+
+        if (charge_phase_state(t(p, ChargeEvent::Rise)) == ChargeState::Discharging && s != ChargeState::Discharging)
+            return false;
+        if (charge_phase_state(t(p, ChargeEvent::Fall)) == ChargeState::Charging && s != ChargeState::Charging)
+            return false;
+    }
+    return true;
+}
+
+// A pending reversal is only entered from its direction, by the opposite step
+static constexpr bool pending_from_direction(const ChargeTable &t) {
+    for (ChargePhase p : PHASES)
+        for (ChargeEvent e : EVENTS) {
+            if (t(p, e) == CHF && !(p == CHG && e == ChargeEvent::Fall))
+                return false;
+            if (t(p, e) == DSR && !(p == DIS && e == ChargeEvent::Rise))
+                return false;
+        }
+    return true;
+}
+
+// Every reported state can be reached from Monitoring
+static constexpr bool reaches_all(const ChargeTable &t) {
+    bool seen[NUM_CHARGE_PHASES] = { true };
+    bool reported[4] = {};
+
+    for (size_t round = 0; round < NUM_CHARGE_PHASES; round++)
+        for (ChargePhase p : PHASES)
+            if (seen[static_cast<size_t>(p)])
+                for (ChargeEvent e : EVENTS)
+                    seen[static_cast<size_t>(t(p, e))] = true;
+    for (ChargePhase p : PHASES)
+        if (seen[static_cast<size_t>(p)])
+            reported[static_cast<size_t>(charge_phase_state(p))] = true;
+    return reported[0] && reported[1] && reported[2] && reported[3];
+}
+
+// Steps of ev from p until the reported state changes, 0 = never
+static constexpr unsigned steps_to_leave(const ChargeTable &t, ChargePhase p, ChargeEvent ev) {
+    ChargeState from = charge_phase_state(p);
+
+    for (unsigned n = 1; n <= NUM_CHARGE_PHASES; n++) {
+        p = t(p, ev);
+        if (charge_phase_state(p) != from)
+            return n;
+    }
+    return 0;
+}
+
+static_assert(symmetric(DELTA_TABLE) && symmetric(SLOPE_TABLE), "Charging/Discharging asymmetry");
+// Invalid drops the history in both rules. Warmup in Delta only follows
+// that (no previous sample), as in MAX17048.sh; in Slope it also follows
+// a gap, and holds.
+static_assert(restarts(DELTA_TABLE, ChargeEvent::Invalid) && restarts(SLOPE_TABLE, ChargeEvent::Invalid),
+              "Invalid must restart");
+static_assert(restarts(DELTA_TABLE, ChargeEvent::Warmup), "delta warmup must restart");
+static_assert(holds(SLOPE_TABLE, ChargeEvent::Warmup), "slope warmup must hold");
+static_assert(holds(DELTA_TABLE, ChargeEvent::Ambiguous) && holds(SLOPE_TABLE, ChargeEvent::Ambiguous),
+              "Ambiguous must hold");
+static_assert(sane(DELTA_TABLE) && sane(SLOPE_TABLE), "transition against the evidence");
+static_assert(pending_from_direction(DELTA_TABLE) && pending_from_direction(SLOPE_TABLE),
+              "pending reversal entered from the wrong phase");
+static_assert(reaches_all(DELTA_TABLE) && reaches_all(SLOPE_TABLE), "unreachable state");
+
+// Delta: a reversal takes exactly two steps either way, a first direction one
+static_assert(steps_to_leave(DELTA_TABLE, CHG, ChargeEvent::Fall) == 2 &&
+              steps_to_leave(DELTA_TABLE, DIS, ChargeEvent::Rise) == 2, "delta reversal");
+static_assert(steps_to_leave(DELTA_TABLE, STB, ChargeEvent::Rise) == 1 &&
+              steps_to_leave(DELTA_TABLE, STB, ChargeEvent::Fall) == 1 &&
+              steps_to_leave(DELTA_TABLE, MON, ChargeEvent::Flat) == 1, "delta first decision");
+static_assert(DELTA_TABLE(DELTA_TABLE(CHG, ChargeEvent::Fall), ChargeEvent::Flat) == CHG &&
+              DELTA_TABLE(DELTA_TABLE(DIS, ChargeEvent::Rise), ChargeEvent::Flat) == DIS,
+              "a flat step cancels a pending reversal");
+static_assert(steps_to_leave(DELTA_TABLE, CHG, ChargeEvent::Flat) == 0 &&
+              steps_to_leave(DELTA_TABLE, STB, ChargeEvent::Flat) == 0, "delta holds when flat");
+
+// Slope: confident evidence is taken at once, Quiet only settles Monitoring
+static_assert(steps_to_leave(SLOPE_TABLE, CHG, ChargeEvent::Fall) == 1 &&
+              steps_to_leave(SLOPE_TABLE, DIS, ChargeEvent::Rise) == 1, "slope reversal");
+static_assert(steps_to_leave(SLOPE_TABLE, CHG, ChargeEvent::Quiet) == 0 &&
+              steps_to_leave(SLOPE_TABLE, MON, ChargeEvent::Quiet) == 1 &&
+              steps_to_leave(SLOPE_TABLE, CHG, ChargeEvent::Flat) == 1, "slope settling");
+
+// Guards: mirrored input, mirrored event; events agree with the thresholds
+static constexpr bool delta_guard_ok(double rise) {
+    for (int i = -40; i <= 40; i++) {
+        double d = rise * i / 20.0;
+        ChargeEvent e = delta_event(d, rise, -rise);
+
+        if (mirror(e) != delta_event(-d, rise, -rise))
+            return false;
+        if ((e == ChargeEvent::Rise) != (d > rise) || (e == ChargeEvent::Fall) != (d < -rise))
+            return false;
+        if (e != ChargeEvent::Rise && e != ChargeEvent::Fall && e != ChargeEvent::Flat)
+            return false;
+    }
+    return true;
+}
+
+static constexpr bool slope_guard_ok(double rate, double k) {
+    for (int i = -40; i <= 40; i++)
+        for (int j = 0; j <= 16; j++) {
+            double s = rate * i / 10.0, err = rate * j / 8.0;
+            double mag = s < 0 ? -s : s;
+            ChargeEvent e = slope_event(s, err, rate, k);
+
+            if (mirror(e) != slope_event(-s, err, rate, k))
+                return false;
+            if ((e == ChargeEvent::Rise || e == ChargeEvent::Fall) != (mag >= rate && mag >= k * err))
+                return false;
+            if (e == ChargeEvent::Flat && !(mag + 2.0 * err < rate))
+                return false;
+            if (e == ChargeEvent::Quiet && !(mag < rate && mag + 2.0 * err >= rate))
+                return false;
+            if (e == ChargeEvent::Ambiguous && !(mag >= rate && mag < k * err))
+                return false;
+        }
+    return true;
+}
+
+static_assert(delta_guard_ok(0.010) && delta_guard_ok(0.002), "delta guard");
+static_assert(slope_guard_ok(0.3e-3 / 60.0, 4.0) && slope_guard_ok(1e-3 / 60.0, 2.0), "slope guard");
+static_assert(charge_phase_state(CHF) == ChargeState::Charging &&
+              charge_phase_state(DSR) == ChargeState::Discharging &&
+              mirror(charge_phase_state(CHF)) == charge_phase_state(DSR), "pending phases report their direction");
+
+const ChargeTable &charge_table(Classifier::Mode mode) {
+    return mode == Classifier::Mode::Delta ? DELTA_TABLE : SLOPE_TABLE;
+}
+
+// --- Classifier ---
+
+Classifier::Classifier(const Config &cfg)
+    : cfg_(cfg), table_(&charge_table(cfg.mode)), slope_(cfg.window_s) {}
+
+ChargeState Classifier::update(double t_s, double voltage_v) {
+    event_ = cfg_.mode == Mode::Delta ? delta(voltage_v) : slope(t_s, voltage_v);
+    phase_ = (*table_)(phase_, event_);
+    return state();
+}
+
+ChargeEvent Classifier::delta(double voltage_v) {
+    ChargeEvent e;
+
+    // Out-of-range samples drop the history so the next one starts over
+    if (!(voltage_v > cfg_.min_valid_v && voltage_v < cfg_.max_valid_v)) {
+        have_last_ = false;
+        return ChargeEvent::Invalid;
+    }
+    e = have_last_ ? delta_event(voltage_v - last_v_, cfg_.rise_threshold_v, cfg_.fall_threshold_v)
+                   : ChargeEvent::Warmup;
+    last_v_ = voltage_v;
+    have_last_ = true;
+    return e;
+}
+
+ChargeEvent Classifier::slope(double t_s, double voltage_v) {
+    if (!(voltage_v > cfg_.min_valid_v && voltage_v < cfg_.max_valid_v)) {
+        slope_.reset();
+        return ChargeEvent::Invalid;
+    }
+
+    slope_.add(t_s, voltage_v);
+    if (!slope_.valid() || slope_.span_s() < cfg_.min_span_s)
+        return ChargeEvent::Warmup;
+    return slope_event(slope_.slope(), slope_.slope_stderr(), cfg_.rate_threshold_v_per_s,
+                       cfg_.min_confidence);
+}
+
+void Classifier::reset() {
+    phase_ = ChargePhase::Monitoring;
+    event_ = ChargeEvent::Warmup;
+    have_last_ = false;
+    slope_.reset();
+}
+
+const char *Classifier::power_supply_status(double voltage_v) const {
+    switch (state()) {
+    case ChargeState::Charging:
+        return "Charging";
+    case ChargeState::Discharging:
+        return "Discharging";
+    case ChargeState::Stable:
+        return voltage_v >= cfg_.full_voltage_v ? "Full" : "Not charging";
+    case ChargeState::Monitoring:
+    default:
+        return "Unknown";
+    }
+}
+
+const char *charge_state_name(ChargeState s) {
+    switch (s) {
+    case ChargeState::Monitoring:  return "Monitoring";
+    case ChargeState::Stable:      return "Stable";
+    case ChargeState::Charging:    return "Charging";
+    case ChargeState::Discharging: return "Discharging";
+    }
+    return "Unknown";
+}
+
+const char *charge_phase_name(ChargePhase p) {
+    switch (p) {
+    case ChargePhase::Monitoring:       return "Monitoring";
+    case ChargePhase::Stable:           return "Stable";
+    case ChargePhase::Charging:         return "Charging";
+    case ChargePhase::Discharging:      return "Discharging";
+    case ChargePhase::ChargingFall:     return "Charging/fall";
+    case ChargePhase::DischargingRise:  return "Discharging/rise";
+    }
+    return "Unknown";
+}
+
+const char *charge_event_name(ChargeEvent e) {
+    switch (e) {
+    case ChargeEvent::Invalid:   return "Invalid";
+    case ChargeEvent::Warmup:    return "Warmup";
+    case ChargeEvent::Rise:      return "Rise";
+    case ChargeEvent::Fall:      return "Fall";
+    case ChargeEvent::Flat:      return "Flat";
+    case ChargeEvent::Quiet:     return "Quiet";
+    case ChargeEvent::Ambiguous: return "Ambiguous";
+    }
+    return "Unknown";
+}
+
+} // namespace battd
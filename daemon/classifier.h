@@ -0,0 +1,155 @@
+#ifndef USERSPACE_BATTERYD_CLASSIFIER_H
+#define USERSPACE_BATTERYD_CLASSIFIER_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "slope_estimator.h"
+
+namespace battd {
+
+enum class ChargeState {
+    Monitoring,
+    Stable,
+    Charging,
+    Discharging,
+};
+
+// --- Charge state machine ---
+// Each sample is reduced to an event by the mode's guards, and the next
+// phase is looked up in the mode's transition table. Phases refine
+// ChargeState with a pending reversal, so the Delta rule needs two steps
+// the other way to leave either direction. The tables and guards are
+// constexpr and checked exhaustively by static_asserts in classifier.cpp.
+enum class ChargeEvent : uint8_t {
+    Invalid,        // voltage out of range; history dropped
+    Warmup,         // not enough history to judge
+    Rise,           // past the rise threshold (Slope: with confidence)
+    Fall,
+    Flat,           // inside the band (Slope: the whole 2-sigma interval)
+    Quiet,          // Slope: under the rate threshold, not confidently
+    Ambiguous,      // Slope: over the rate threshold, not confidently
+};
+constexpr size_t NUM_CHARGE_EVENTS = 7;
+
+enum class ChargePhase : uint8_t {
+    Monitoring,
+    Stable,
+    Charging,
+    Discharging,
+    ChargingFall,       // Charging, after one fall
+    DischargingRise,    // Discharging, after one rise
+};
+constexpr size_t NUM_CHARGE_PHASES = 6;
+
+struct ChargeTable {
+    ChargePhase next[NUM_CHARGE_PHASES][NUM_CHARGE_EVENTS];
+
+    constexpr ChargePhase operator()(ChargePhase p, ChargeEvent e) const {
+        return next[static_cast<size_t>(p)][static_cast<size_t>(e)];
+    }
+};
+
+// What a phase reports
+constexpr ChargeState charge_phase_state(ChargePhase p) {
+    switch (p) {
+    case ChargePhase::Stable:           return ChargeState::Stable;
+    case ChargePhase::Charging:
+    case ChargePhase::ChargingFall:     return ChargeState::Charging;
+    case ChargePhase::Discharging:
+    case ChargePhase::DischargingRise:  return ChargeState::Discharging;
+    default:                            return ChargeState::Monitoring;
+    }
+}
+
+// Delta guard: the step from the previous sample
+constexpr ChargeEvent delta_event(double diff_v, double rise_v, double fall_v) {
+    return diff_v > rise_v ? ChargeEvent::Rise : diff_v < fall_v ? ChargeEvent::Fall : ChargeEvent::Flat;
+}
+
+// Slope guard: a fitted dV/dt and its standard error
+constexpr ChargeEvent slope_event(double slope, double err, double rate, double confidence) {
+    double mag = slope < 0 ? -slope : slope;
+
+    if (mag >= rate && mag >= confidence * err)
+        return slope > 0 ? ChargeEvent::Rise : ChargeEvent::Fall;
+    if (mag + 2.0 * err < rate)
+        return ChargeEvent::Flat;
+    return mag < rate ? ChargeEvent::Quiet : ChargeEvent::Ambiguous;
+}
+
+// --- Charge state classifier ---
+// Two rules are available:
+//  - Delta: MAX17048.sh's rule, comparing each sample against the previous
+//    one with fixed rise/drop thresholds. Kept for comparison, minus the
+//    script's asymmetry (it never left Charging on a drop, but left
+//    Discharging on a single rise): a reversal now takes two steps either way.
+//  - Slope: least-squares dV/dt over a time window (SlopeEstimator). A
+//    direction is only taken when the slope exceeds the rate threshold with
+//    enough confidence (|slope| / stderr). Leaving a direction for Stable
+//    needs the whole 2-sigma interval inside the threshold; otherwise the
+//    state holds. So does too little history, as after a gap in the samples
+//    longer than the window.
+class Classifier {
+public:
+    enum class Mode {
+        Delta,
+        Slope,
+    };
+
+    struct Config {
+        Mode mode = Mode::Slope;
+
+        // Delta rule
+        double rise_threshold_v = 0.010;
+        double fall_threshold_v = -0.010;
+
+        // Slope rule
+        double window_s = 600.0;
+        double min_span_s = 60.0;             // history needed before deciding
+        double rate_threshold_v_per_s = 0.3e-3 / 60.0; // 0.3 mV/min
+        double min_confidence = 4.0;          // |slope| / stderr
+
+        double full_voltage_v = 4.18;         // 'Stable' at or above this reports Full
+        double min_valid_v = 1.0;
+        double max_valid_v = 5.0;
+    };
+
+    Classifier() : Classifier(Config()) {}
+    explicit Classifier(const Config &cfg);
+
+    // t_s is a monotonic timestamp in seconds.
+    ChargeState update(double t_s, double voltage_v);
+    void reset();
+
+    ChargeState state() const { return charge_phase_state(phase_); }
+    ChargePhase phase() const { return phase_; }
+    ChargeEvent last_event() const { return event_; }
+    const SlopeEstimator &estimator() const { return slope_; }
+
+    // Map the current state to a POWER_SUPPLY_STATUS_* string for set_status.
+    const char *power_supply_status(double voltage_v) const;
+
+private:
+    ChargeEvent delta(double voltage_v);
+    ChargeEvent slope(double t_s, double voltage_v);
+
+    Config cfg_;
+    const ChargeTable *table_;
+    ChargePhase phase_ = ChargePhase::Monitoring;
+    ChargeEvent event_ = ChargeEvent::Warmup;
+    double last_v_ = 0.0;
+    bool have_last_ = false;
+    SlopeEstimator slope_;
+};
+
+// The transition table a mode runs on
+const ChargeTable &charge_table(Classifier::Mode mode);
+
+const char *charge_state_name(ChargeState s);
+const char *charge_phase_name(ChargePhase p);
+const char *charge_event_name(ChargeEvent e);
+
+} // namespace battd
+
+#endif // USERSPACE_BATTERYD_CLASSIFIER_H
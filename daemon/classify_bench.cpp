@@ -0,0 +1,324 @@
+// classify_bench - compare charge state rules on recorded voltage traces
+//
+// Replays each trace through the Delta rule (MAX17048.sh) and the Slope
+// rule (windowed least-squares dV/dt) and reports, per rule:
+//   - detection latency: time from a ground-truth state change until the
+//     classifier first reports that state (misses if it never does within
+//     the segment)
+//   - false transitions: state changes into something other than the truth
+//   - cost per sample
+//
+// Trace format (CSV, '#' comments):  time_s,voltage_v[,truth]
+// where truth is C(harging), D(ischarging) or S(table). Without truth only
+// transition counts and cost are reported. --synth generates a built-in
+// set of labelled scenarios (slow discharge, noisy load, plug cycle,
+// a gap in the samples);
+// --dump DIR writes them out as CSV for inspection or reuse. --table prints
+// the transition table of each rule.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <getopt.h>
+
+#include "classifier.h"
+
+using namespace battd;
+
+struct TracePoint {
+    double t;
+    double v;
+    char truth;     // 'C', 'D', 'S' or 0 when unlabelled
+};
+
+struct Trace {
+    std::string name;
+    std::vector<TracePoint> points;
+};
+
+// --- Trace I/O ---
+
+static bool load_trace(const std::string &path, Trace *tr) {
+    std::ifstream in(path);
+    std::string line;
+
+    if (!in) return false;
+    tr->name = path.substr(path.find_last_of('/') + 1);
+    while (std::getline(in, line)) {
+        TracePoint p = {};
+        char truth[16] = "";
+
+        if (line.empty() || line[0] == '#')
+            continue;
+        for (char &c : line)
+            if (c == ',') c = ' ';
+        if (sscanf(line.c_str(), "%lf %lf %15s", &p.t, &p.v, truth) < 2)
+            continue; // header or junk
+        p.truth = static_cast<char>(toupper(static_cast<unsigned char>(truth[0])));
+        if (p.truth != 'C' && p.truth != 'D' && p.truth != 'S')
+            p.truth = 0;
+        tr->points.push_back(p);
+    }
+    return !tr->points.empty();
+}
+
+static bool dump_trace(const std::string &dir, const Trace &tr) {
+    std::string path = dir + "/" + tr.name + ".csv";
+    FILE *f = fopen(path.c_str(), "w");
+
+    if (!f) return false;
+    fprintf(f, "# time_s,voltage_v,truth\n");
+    for (const TracePoint &p : tr.points)
+        fprintf(f, "%.1f,%.6f,%c\n", p.t, p.v, p.truth ? p.truth : '-');
+    fclose(f);
+    return true;
+}
+
+// --- Synthetic scenarios (10 s sampling, MAX17048 78.125 uV resolution) ---
+
+static double quantize(double v) {
+    return std::round(v / 78.125e-6) * 78.125e-6;
+}
+
+static std::vector<Trace> synth_traces() {
+    std::mt19937 rng(17048);
+    std::normal_distribution<double> noise(0.0, 1.0);
+    std::uniform_real_distribution<double> uni(0.0, 1.0);
+    std::vector<Trace> out;
+    const double dt = 10.0;
+
+    {   // Light load: 0.4 mV/min decline, 2 mV noise, never crosses 10 mV per step
+        Trace tr{ "slow_discharge", {} };
+        for (double t = 0; t < 4 * 3600; t += dt)
+            tr.points.push_back({ t, quantize(3.95 - 0.4e-3 / 60 * t + 0.002 * noise(rng)), 'D' });
+        out.push_back(tr);
+    }
+    {   // Idle on a bench supply with bursty load dips of 15-40 mV
+        Trace tr{ "noisy_load", {} };
+        for (double t = 0; t < 2 * 3600; t += dt) {
+            double v = 3.85 + 0.003 * noise(rng);
+            if (uni(rng) < 0.05)
+                v -= 0.015 + 0.025 * uni(rng);
+            tr.points.push_back({ t, quantize(v), 'S' });
+        }
+        out.push_back(tr);
+    }
+    {   // Discharge, plug in (CC then CV), unplug
+        Trace tr{ "plug_cycle", {} };
+        double v = 3.90, t = 0;
+        for (; t < 3600; t += dt) {
+            v -= 1.5e-3 / 60 * dt;
+            tr.points.push_back({ t, quantize(v + 0.002 * noise(rng)), 'D' });
+        }
+        v += 0.120;
+        for (; t < 3600 + 40 * 60; t += dt) {
+            v = std::min(4.20, v + 3e-3 / 60 * dt);
+            tr.points.push_back({ t, quantize(v + 0.002 * noise(rng)), v < 4.20 ? 'C' : 'S' });
+        }
+        for (; t < 3600 + 70 * 60; t += dt)
+            tr.points.push_back({ t, quantize(4.20 + 0.001 * noise(rng)), 'S' });
+        v = 4.14;
+        for (; t < 2 * 3600 + 70 * 60; t += dt) {
+            v -= 1.5e-3 / 60 * dt;
+            tr.points.push_back({ t, quantize(v + 0.002 * noise(rng)), 'D' });
+        }
+        out.push_back(tr);
+    }
+    {   // Discharge with a 30 min hole: the gauge hibernated or the bus was
+        // out, longer than the slope window. The state should carry over.
+        Trace tr{ "wake_gap", {} };
+        for (double t = 0; t < 3 * 3600; t += dt) {
+            if (t >= 3600 && t < 3600 + 30 * 60)
+                continue;
+            tr.points.push_back({ t, quantize(3.95 - 1.5e-3 / 60 * t + 0.002 * noise(rng)), 'D' });
+        }
+        out.push_back(tr);
+    }
+    return out;
+}
+
+// --- Scoring ---
+
+struct Score {
+    unsigned segments = 0;
+    unsigned detected = 0;
+    double latency_sum = 0.0;
+    double latency_max = 0.0;
+    unsigned transitions = 0;
+    unsigned false_transitions = 0;
+    double ns_per_sample = 0.0;
+};
+
+static char state_letter(ChargeState s) {
+    switch (s) {
+    case ChargeState::Charging:    return 'C';
+    case ChargeState::Discharging: return 'D';
+    case ChargeState::Stable:      return 'S';
+    default:                       return 0;
+    }
+}
+
+static Score score(const Trace &tr, const Classifier::Config &cfg) {
+    Classifier cls(cfg);
+    Score sc;
+    ChargeState prev = ChargeState::Monitoring;
+    char seg_truth = 0;
+    double seg_start = 0.0;
+    bool seg_hit = false;
+
+    for (const TracePoint &p : tr.points) {
+        ChargeState s = cls.update(p.t, p.v);
+
+        if (p.truth && p.truth != seg_truth) {
+            seg_truth = p.truth;
+            seg_start = p.t;
+            seg_hit = false;
+            sc.segments++;
+        }
+        if (s != prev) {
+            sc.transitions++;
+            if (p.truth && state_letter(s) != p.truth)
+                sc.false_transitions++;
+            prev = s;
+        }
+        if (seg_truth && !seg_hit && state_letter(s) == seg_truth) {
+            double lat = p.t - seg_start;
+
+            seg_hit = true;
+            sc.detected++;
+            sc.latency_sum += lat;
+            if (lat > sc.latency_max) sc.latency_max = lat;
+        }
+    }
+
+    // Cost: replay enough times to get a stable number
+    {
+        const unsigned reps = 1 + 200000 / static_cast<unsigned>(tr.points.size());
+        volatile int sink = 0;
+        auto t0 = std::chrono::steady_clock::now();
+
+        for (unsigned r = 0; r < reps; r++) {
+            Classifier c(cfg);
+            for (const TracePoint &p : tr.points)
+                sink += static_cast<int>(c.update(p.t, p.v));
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        sc.ns_per_sample = std::chrono::duration<double, std::nano>(t1 - t0).count() /
+                           (static_cast<double>(reps) * tr.points.size());
+    }
+    return sc;
+}
+
+static void print_score(const char *trace, const char *rule, const Score &sc) {
+    char lat[32] = "-", latmax[32] = "-";
+
+    if (sc.detected) {
+        snprintf(lat, sizeof(lat), "%.0f", sc.latency_sum / sc.detected);
+        snprintf(latmax, sizeof(latmax), "%.0f", sc.latency_max);
+    }
+    printf("%-16s %-6s %3u/%-3u %10s %10s %8u %8u %10.1f\n", trace, rule, sc.detected,
+           sc.segments, lat, latmax, sc.transitions, sc.false_transitions, sc.ns_per_sample);
+}
+
+static void print_table(const char *rule, Classifier::Mode mode) {
+    const ChargeTable &t = charge_table(mode);
+
+    printf("%s rule: next phase by event\n%-17s", rule, "");
+    for (size_t e = 0; e < NUM_CHARGE_EVENTS; e++)
+        printf(" %-17s", charge_event_name(static_cast<ChargeEvent>(e)));
+    printf("\n");
+    for (size_t p = 0; p < NUM_CHARGE_PHASES; p++) {
+        printf("%-17s", charge_phase_name(static_cast<ChargePhase>(p)));
+        for (size_t e = 0; e < NUM_CHARGE_EVENTS; e++)
+            printf(" %-17s", charge_phase_name(t(static_cast<ChargePhase>(p), static_cast<ChargeEvent>(e))));
+        printf("\n");
+    }
+    printf("\n");
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [--synth] [--dump DIR] [--table] [--window S] [--rate MV_PER_MIN]\n"
+            "          [--confidence K] [--delta MV] [trace.csv...]\n",
+            prog);
+}
+
+int main(int argc, char **argv) {
+    static const struct option longopts[] = {
+        { "synth", no_argument, nullptr, 's' },
+        { "dump", required_argument, nullptr, 'd' },
+        { "window", required_argument, nullptr, 'w' },
+        { "rate", required_argument, nullptr, 'r' },
+        { "confidence", required_argument, nullptr, 'k' },
+        { "delta", required_argument, nullptr, 'D' },
+        { "table", no_argument, nullptr, 't' },
+        { "help", no_argument, nullptr, 'h' },
+        { nullptr, 0, nullptr, 0 },
+    };
+    Classifier::Config slope_cfg, delta_cfg;
+    std::vector<Trace> traces;
+    std::string dump_dir;
+    bool synth = false, table = false;
+    int c;
+
+    delta_cfg.mode = Classifier::Mode::Delta;
+    slope_cfg.mode = Classifier::Mode::Slope;
+
+    while ((c = getopt_long(argc, argv, "sd:w:r:k:D:th", longopts, nullptr)) != -1) {
+        switch (c) {
+        case 's': synth = true; break;
+        case 'd': dump_dir = optarg; break;
+        case 'w': slope_cfg.window_s = atof(optarg); break;
+        case 'r': slope_cfg.rate_threshold_v_per_s = atof(optarg) * 1e-3 / 60.0; break;
+        case 'k': slope_cfg.min_confidence = atof(optarg); break;
+        case 'D':
+            delta_cfg.rise_threshold_v = atof(optarg) * 1e-3;
+            delta_cfg.fall_threshold_v = -delta_cfg.rise_threshold_v;
+            break;
+        case 't': table = true; break;
+        default:
+            usage(argv[0]);
+            return c == 'h' ? 0 : 1;
+        }
+    }
+
+    if (table) {
+        print_table("delta", Classifier::Mode::Delta);
+        print_table("slope", Classifier::Mode::Slope);
+        if (!synth && optind == argc)
+            return 0;
+    }
+
+    for (int i = optind; i < argc; i++) {
+        Trace tr;
+
+        if (!load_trace(argv[i], &tr)) {
+            fprintf(stderr, "Error: cannot read trace %s\n", argv[i]);
+            return 1;
+        }
+        traces.push_back(tr);
+    }
+    if (synth || traces.empty()) {
+        for (Trace &tr : synth_traces()) {
+            if (!dump_dir.empty() && !dump_trace(dump_dir, tr))
+                fprintf(stderr, "Warning: cannot write %s/%s.csv\n", dump_dir.c_str(), tr.name.c_str());
+            traces.push_back(tr);
+        }
+    }
+
+    printf("%-16s %-6s %7s %10s %10s %8s %8s %10s\n", "trace", "rule", "detect",
+           "lat_avg_s", "lat_max_s", "trans", "false", "ns/sample");
+    for (const Trace &tr : traces) {
+        print_score(tr.name.c_str(), "delta", score(tr, delta_cfg));
+        print_score(tr.name.c_str(), "slope", score(tr, slope_cfg));
+    }
+    return 0;
+}
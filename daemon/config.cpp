@@ -0,0 +1,484 @@
+#include "config.h"
+
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <set>
+#include <utility>
+
+#include <sched.h>
+
+namespace battd {
+
+std::string battery_instance_path(unsigned instance) {
+    std::string path = "/sys/devices/platform/userspace_battery";
+
+    // Instance 0 is registered without an ID suffix by the module
+    if (instance)
+        path += "." + std::to_string(instance);
+    return path;
+}
+
+// --- Parsing helpers ---
+
+static std::string trim(const std::string &s) {
+    size_t b = 0, e = s.size();
+
+    while (b < e && isspace(static_cast<unsigned char>(s[b]))) b++;
+    while (e > b && isspace(static_cast<unsigned char>(s[e - 1]))) e--;
+    return s.substr(b, e - b);
+}
+
+static bool parse_long(const std::string &v, long *out) {
+    char *end;
+
+    if (v.empty()) return false;
+    *out = strtol(v.c_str(), &end, 0);
+    return *end == '\0';
+}
+
+static bool parse_bool(const std::string &v, bool *out) {
+    if (v == "yes" || v == "true" || v == "on" || v == "1") { *out = true; return true; }
+    if (v == "no" || v == "false" || v == "off" || v == "0") { *out = false; return true; }
+    return false;
+}
+
+// "<gpiochip>:<line>", the chip either a path or a name under /dev
+static bool parse_gpio(const std::string &val, std::string *chip, int *line) {
+    size_t colon = val.rfind(':');
+    long n;
+
+    if (colon == std::string::npos || !parse_long(val.substr(colon + 1), &n) || n < 0)
+        return false;
+    *chip = val.substr(0, colon);
+    if (chip->find('/') == std::string::npos)
+        *chip = "/dev/" + *chip;
+    *line = static_cast<int>(n);
+    return true;
+}
+
+static bool parse_gauge_key(GaugeConfig *g, const std::string &key, const std::string &val,
+                            std::string *why) {
+    long n;
+
+    if (key == "bus") {
+        if (!parse_long(val, &n) || n < 0) { *why = "bad bus number"; return false; }
+        g->bus = static_cast<int>(n);
+    } else if (key == "address") {
+        if (!parse_long(val, &n) || n < 0x03 || n > 0x77) { *why = "bad I2C address"; return false; }
+        g->addr = static_cast<uint16_t>(n);
+    } else if (key == "chip") {
+        if (!parse_chip_type(val, &g->chip)) { *why = "unknown chip '" + val + "'"; return false; }
+        if (g->addr == chip_default_addr(ChipType::Auto))
+            g->addr = chip_default_addr(g->chip);
+    } else if (key == "interval") {
+        char *end;
+        double s = strtod(val.c_str(), &end);
+
+        if (*end != '\0' || s < 0.1) { *why = "interval must be >= 0.1 s"; return false; }
+        g->interval_ms = static_cast<unsigned>(s * 1000.0 + 0.5);
+    } else if (key == "hibernate_interval") {
+        char *end;
+        double s = strtod(val.c_str(), &end);
+
+        if (val.empty() || *end != '\0' || (s != 0.0 && s < 0.1)) {
+            *why = "hibernate_interval must be 0 or >= 0.1 s";
+            return false;
+        }
+        g->hibernate_interval_ms = static_cast<unsigned>(s * 1000.0 + 0.5);
+    } else if (key == "hib_threshold" || key == "act_threshold") {
+        char *end;
+        double d = strtod(val.c_str(), &end);
+
+        if (val.empty() || *end != '\0' || d < 0.0) { *why = key + " must be >= 0"; return false; }
+        if (key == "hib_threshold") g->hib_threshold = d;
+        else g->act_threshold = d;
+    } else if (key == "battery") {
+        if (parse_long(val, &n)) {
+            if (n < 0) { *why = "bad battery instance"; return false; }
+            g->battery_path = battery_instance_path(static_cast<unsigned>(n));
+        } else {
+            g->battery_path = val;
+        }
+    } else if (key == "alert") {
+        if (!parse_gpio(val, &g->alert_chip, &g->alert_line)) {
+            *why = "alert must be <gpiochip>:<line>";
+            return false;
+        }
+    } else if (key == "charger_detect") {
+        if (!parse_gpio(val, &g->charger_chip, &g->charger_line)) {
+            *why = "charger_detect must be <gpiochip>:<line>";
+            return false;
+        }
+    } else if (key == "charger_active_low") {
+        if (!parse_bool(val, &g->charger_active_low)) { *why = "charger_active_low must be yes/no"; return false; }
+    } else if (key == "classifier") {
+        if (val == "slope") g->classifier.mode = Classifier::Mode::Slope;
+        else if (val == "delta") g->classifier.mode = Classifier::Mode::Delta;
+        else { *why = "classifier must be slope or delta"; return false; }
+    } else if (key == "slope_window" || key == "slope_rate" || key == "slope_confidence" ||
+               key == "time_smoothing") {
+        char *end;
+        double d = strtod(val.c_str(), &end);
+
+        if (*end != '\0' || d <= 0.0) { *why = key + " must be a positive number"; return false; }
+        if (key == "slope_window") g->classifier.window_s = d;
+        else if (key == "slope_rate") g->classifier.rate_threshold_v_per_s = d * 1e-3 / 60.0;
+        else if (key == "slope_confidence") g->classifier.min_confidence = d;
+        else g->time.tau_s = d;
+    } else if (key == "delta_threshold") {
+        char *end;
+        double d = strtod(val.c_str(), &end);
+
+        if (val.empty() || *end != '\0' || d <= 0.0) { *why = "delta_threshold must be > 0 mV"; return false; }
+        g->classifier.rise_threshold_v = d * 1e-3;
+        g->classifier.fall_threshold_v = -d * 1e-3;
+    } else if (key == "temp_source") {
+        g->temp_source = val;
+    } else if (key == "rcomp") {
+        if (!parse_bool(val, &g->rcomp)) { *why = "rcomp must be yes/no"; return false; }
+    } else if (key == "rcomp0") {
+        if (!parse_long(val, &n) || n < 0 || n > 0xFF) { *why = "rcomp0 must be 0-255"; return false; }
+        g->rcomp_params.rcomp0 = static_cast<double>(n);
+    } else if (key == "rcomp_tempco_up" || key == "rcomp_tempco_down") {
+        char *end;
+        double d = strtod(val.c_str(), &end);
+
+        if (val.empty() || *end != '\0') { *why = key + " must be a number"; return false; }
+        if (key == "rcomp_tempco_up") g->rcomp_params.tempco_up = d;
+        else g->rcomp_params.tempco_down = d;
+    } else if (key == "retries") {
+        if (!parse_long(val, &n) || n < 0 || n > 8) { *why = "retries must be 0-8"; return false; }
+        g->recovery.retries = static_cast<unsigned>(n);
+    } else if (key == "retry_backoff") {
+        if (!parse_long(val, &n) || n < 1 || n > 1000) { *why = "retry_backoff must be 1-1000 ms"; return false; }
+        g->recovery.backoff_ms = static_cast<unsigned>(n);
+    } else if (key == "sample_deadline") {
+        char *end;
+        double d = strtod(val.c_str(), &end);
+
+        if (val.empty() || *end != '\0' || d <= 0.0) { *why = "sample_deadline must be > 0 s"; return false; }
+        g->recovery.deadline_ms = static_cast<unsigned>(d * 1000.0);
+    } else if (key == "recover_after" || key == "stale_after") {
+        if (!parse_long(val, &n) || n < 0 || n > 1000) { *why = key + " must be 0-1000"; return false; }
+        if (key == "recover_after") g->recovery.recover_after = static_cast<unsigned>(n);
+        else g->stale_after = static_cast<unsigned>(n);
+    } else if (key == "bus_rebind") {
+        if (!parse_bool(val, &g->recovery.rebind)) { *why = "bus_rebind must be yes/no"; return false; }
+    } else if (key == "design_capacity") {
+        if (!parse_long(val, &n) || n < 0 || n > 1000000) { *why = "design_capacity must be 0-1000000 mAh"; return false; }
+        g->cycles.design_mah = static_cast<unsigned>(n);
+    } else if (key == "cycle_fade" || key == "cycle_deadband" || key == "eol_capacity") {
+        char *end;
+        double d = strtod(val.c_str(), &end);
+
+        if (val.empty() || *end != '\0' || d < 0.0 || d > 100.0) { *why = key + " must be 0-100"; return false; }
+        if (key == "cycle_fade") g->cycles.fade_pct_per_cycle = d;
+        else if (key == "cycle_deadband") g->cycles.deadband_pct = d;
+        else g->cycles.eol_pct = d;
+    } else if (key == "ocv_table") {
+        g->ocv_table = val;
+    } else if (key == "ko_write") {
+        if (!parse_bool(val, &g->ko_write)) { *why = "ko_write must be yes/no"; return false; }
+    } else if (key == "ko_transaction") {
+        if (!parse_bool(val, &g->ko_transaction)) { *why = "ko_transaction must be yes/no"; return false; }
+    } else {
+        *why = "unknown key '" + key + "'";
+        return false;
+    }
+    return true;
+}
+
+static bool is_filter_key(const std::string &key) {
+    return key == "min_interval" || key == "max_interval" || key == "voltage_delta" ||
+           key == "soc_delta" || key == "temp_delta";
+}
+
+static bool parse_filter_key(SinkFilterConfig *f, const std::string &key, const std::string &val,
+                             std::string *why) {
+    char *end;
+    double d = strtod(val.c_str(), &end);
+
+    if (val.empty() || *end != '\0' || d < 0.0) { *why = key + " must be >= 0"; return false; }
+    if (key == "min_interval") f->min_interval_ms = static_cast<unsigned>(d * 1000.0 + 0.5);
+    else if (key == "max_interval") f->max_interval_ms = static_cast<unsigned>(d * 1000.0 + 0.5);
+    else if (key == "voltage_delta") f->voltage_delta_mv = d;
+    else if (key == "soc_delta") f->soc_delta_pct = d;
+    else f->temp_delta_c = d;
+    return true;
+}
+
+// [console] and [sysfs]
+static bool parse_sink_key(SinkFilterConfig *f, const std::string &key, const std::string &val,
+                           std::string *why) {
+    if (is_filter_key(key))
+        return parse_filter_key(f, key, val, why);
+    *why = "unknown key '" + key + "'";
+    return false;
+}
+
+static bool parse_log_key(DaemonConfig *cfg, const std::string &key, const std::string &val,
+                          std::string *why) {
+    TelemetryLogConfig *l = &cfg->log;
+    long n;
+    double d;
+    char *end;
+
+    if (is_filter_key(key)) {
+        return parse_filter_key(&cfg->log_filter, key, val, why);
+    } else if (key == "path") {
+        l->path = val;
+    } else if (key == "flush_size") {
+        if (!parse_long(val, &n) || n < 1) { *why = "flush_size must be >= 1 KiB"; return false; }
+        l->flush_bytes = static_cast<size_t>(n) * 1024;
+    } else if (key == "flush_interval") {
+        d = strtod(val.c_str(), &end);
+        if (val.empty() || *end || d < 0.0) { *why = "bad flush_interval"; return false; }
+        l->flush_interval_ms = static_cast<unsigned>(d * 1000.0);
+    } else if (key == "max_size") {
+        if (!parse_long(val, &n) || n < 1) { *why = "max_size must be >= 1 MiB"; return false; }
+        l->max_bytes = static_cast<uint64_t>(n) << 20;
+    } else if (key == "keep") {
+        if (!parse_long(val, &n) || n < 0 || n > 99) { *why = "keep must be 0-99"; return false; }
+        l->keep = static_cast<unsigned>(n);
+    } else if (key == "sync") {
+        if (!parse_bool(val, &l->sync)) { *why = "sync must be yes/no"; return false; }
+    } else {
+        *why = "unknown key '" + key + "'";
+        return false;
+    }
+    return true;
+}
+
+static bool parse_metrics_key(DaemonConfig *cfg, const std::string &key, const std::string &val,
+                              std::string *why) {
+    long n;
+
+    if (is_filter_key(key)) {
+        return parse_filter_key(&cfg->metrics_filter, key, val, why);
+    } else if (key == "socket") {
+        cfg->metrics_socket = val;
+    } else if (key == "mode") {
+        if (!parse_long(val, &n) || n < 0 || n > 0777) { *why = "mode must be 0-0777"; return false; }
+        cfg->metrics_mode = static_cast<unsigned>(n);
+    } else {
+        *why = "unknown key '" + key + "'";
+        return false;
+    }
+    return true;
+}
+
+static bool parse_udp_key(DaemonConfig *cfg, const std::string &key, const std::string &val,
+                          std::string *why) {
+    long n;
+
+    if (is_filter_key(key)) {
+        return parse_filter_key(&cfg->udp_filter, key, val, why);
+    } else if (key == "group") {
+        cfg->udp.group = val;
+    } else if (key == "port") {
+        if (!parse_long(val, &n) || n < 1 || n > 65535) { *why = "port must be 1-65535"; return false; }
+        cfg->udp.port = static_cast<unsigned>(n);
+    } else if (key == "ttl") {
+        if (!parse_long(val, &n) || n < 0 || n > 255) { *why = "ttl must be 0-255"; return false; }
+        cfg->udp.ttl = static_cast<unsigned>(n);
+    } else if (key == "interface") {
+        cfg->udp.interface = val;
+    } else {
+        *why = "unknown key '" + key + "'";
+        return false;
+    }
+    return true;
+}
+
+static bool parse_state_key(DaemonConfig *cfg, const std::string &key, const std::string &val,
+                            std::string *why) {
+    long n;
+
+    if (key == "dir") {
+        cfg->state_dir = val;
+    } else if (key == "save_interval") {
+        if (!parse_long(val, &n) || n < 1 || n > 24 * 60) { *why = "save_interval must be 1-1440 minutes"; return false; }
+        cfg->state_save_interval_s = static_cast<unsigned>(n) * 60;
+    } else {
+        *why = "unknown key '" + key + "'";
+        return false;
+    }
+    return true;
+}
+
+static bool parse_pipeline_key(DaemonConfig *cfg, const std::string &key, const std::string &val,
+                               std::string *why) {
+    long n;
+
+    if (key == "acquire_priority") {
+        if (!parse_long(val, &n) || n < 0 || n > 99) { *why = "acquire_priority must be 0-99"; return false; }
+        cfg->acquire.priority = static_cast<int>(n);
+    } else if (key == "acquire_cpu") {
+        if (!parse_long(val, &n) || n < 0 || n >= CPU_SETSIZE) { *why = "bad acquire_cpu"; return false; }
+        cfg->acquire.cpu = static_cast<int>(n);
+    } else {
+        *why = "unknown key '" + key + "'";
+        return false;
+    }
+    return true;
+}
+
+// --- load_config ---
+
+bool load_config(const std::string &path, DaemonConfig *cfg, std::string *err) {
+    std::ifstream in(path);
+    std::string line, why;
+    GaugeConfig *gauge = nullptr;
+    bool in_console = false, in_sysfs = false, in_log = false, in_metrics = false, in_udp = false;
+    bool in_state = false, in_pipeline = false;
+    unsigned lineno = 0;
+
+    if (!in) {
+        *err = path + ": cannot open";
+        return false;
+    }
+
+    while (std::getline(in, line)) {
+        size_t comment;
+
+        lineno++;
+        comment = line.find_first_of("#;");
+        if (comment != std::string::npos)
+            line.erase(comment);
+        line = trim(line);
+        if (line.empty())
+            continue;
+
+        if (line.front() == '[') {
+            std::string section;
+
+            if (line.back() != ']') {
+                why = "unterminated section header";
+                goto fail;
+            }
+            section = trim(line.substr(1, line.size() - 2));
+            in_console = section == "console";
+            in_sysfs = section == "sysfs";
+            in_log = section == "log";
+            in_metrics = section == "metrics";
+            in_udp = section == "udp";
+            in_state = section == "state";
+            in_pipeline = section == "pipeline";
+            if (in_console || in_sysfs || in_log || in_metrics || in_udp || in_state || in_pipeline) {
+                gauge = nullptr;
+                continue;
+            }
+            if (section.compare(0, 6, "gauge ") != 0 || trim(section.substr(6)).empty()) {
+                why = "expected [gauge <name>], [console], [sysfs], [log], [metrics], [udp], [state] "
+                      "or [pipeline]";
+                goto fail;
+            }
+            cfg->gauges.emplace_back();
+            gauge = &cfg->gauges.back();
+            gauge->name = trim(section.substr(6));
+            continue;
+        }
+
+        {
+            size_t eq = line.find('=');
+
+            if (eq == std::string::npos) {
+                why = "expected key = value";
+                goto fail;
+            }
+            if (in_console || in_sysfs) {
+                if (!parse_sink_key(in_console ? &cfg->console_filter : &cfg->sysfs_filter,
+                                    trim(line.substr(0, eq)), trim(line.substr(eq + 1)), &why))
+                    goto fail;
+                continue;
+            }
+            if (in_log) {
+                if (!parse_log_key(cfg, trim(line.substr(0, eq)), trim(line.substr(eq + 1)), &why))
+                    goto fail;
+                continue;
+            }
+            if (in_metrics) {
+                if (!parse_metrics_key(cfg, trim(line.substr(0, eq)), trim(line.substr(eq + 1)), &why))
+                    goto fail;
+                continue;
+            }
+            if (in_udp) {
+                if (!parse_udp_key(cfg, trim(line.substr(0, eq)), trim(line.substr(eq + 1)), &why))
+                    goto fail;
+                continue;
+            }
+            if (in_state) {
+                if (!parse_state_key(cfg, trim(line.substr(0, eq)), trim(line.substr(eq + 1)), &why))
+                    goto fail;
+                continue;
+            }
+            if (in_pipeline) {
+                if (!parse_pipeline_key(cfg, trim(line.substr(0, eq)), trim(line.substr(eq + 1)), &why))
+                    goto fail;
+                continue;
+            }
+            if (!gauge) {
+                why = "key outside of a section";
+                goto fail;
+            }
+            if (!parse_gauge_key(gauge, trim(line.substr(0, eq)), trim(line.substr(eq + 1)), &why))
+                goto fail;
+        }
+    }
+    return validate_config(*cfg, err);
+
+fail:
+    *err = path + ":" + std::to_string(lineno) + ": " + why;
+    return false;
+}
+
+bool validate_config(const DaemonConfig &cfg, std::string *err) {
+    std::set<std::string> names, batteries;
+    std::set<std::pair<int, uint16_t>> devices;
+
+    if (cfg.gauges.empty()) {
+        *err = "no gauges configured";
+        return false;
+    }
+
+    if (!cfg.log.path.empty() && cfg.gauges.size() > 255) {
+        *err = "the telemetry log holds at most 255 gauges";
+        return false;
+    }
+
+    for (const GaugeConfig &g : cfg.gauges) {
+        if (!cfg.state_dir.empty() && (g.name.find('/') != std::string::npos || g.name[0] == '.')) {
+            *err = "gauge name '" + g.name + "' cannot name a state file";
+            return false;
+        }
+        if (!names.insert(g.name).second) {
+            *err = "duplicate gauge name '" + g.name + "'";
+            return false;
+        }
+        if (!devices.insert({ g.bus, g.addr }).second) {
+            *err = "gauge '" + g.name + "' shares bus/address with another gauge";
+            return false;
+        }
+        if (g.rcomp && g.temp_source.empty()) {
+            *err = "gauge '" + g.name + "' enables rcomp without a temp_source";
+            return false;
+        }
+        if (g.rcomp && g.chip == ChipType::Bq27421) {
+            *err = "gauge '" + g.name + "' enables rcomp on a chip without RCOMP";
+            return false;
+        }
+        if ((g.hib_threshold >= 0.0 || g.act_threshold >= 0.0) &&
+            (g.chip == ChipType::Max17043 || g.chip == ChipType::Bq27421)) {
+            *err = "gauge '" + g.name + "' sets HIBRT thresholds on a chip without HIBRT";
+            return false;
+        }
+        if (g.ko_write && !batteries.insert(g.battery_path).second) {
+            *err = "gauge '" + g.name + "' publishes to an already used battery";
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace battd
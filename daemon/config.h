@@ -0,0 +1,185 @@
+#ifndef USERSPACE_BATTERYD_CONFIG_H
+#define USERSPACE_BATTERYD_CONFIG_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "bus_recovery.h"
+#include "bus_worker.h"
+#include "classifier.h"
+#include "cycle_tracker.h"
+#include "gauge.h"
+#include "max17048.h"
+#include "sink_filter.h"
+#include "sinks.h"
+#include "telemetry_log.h"
+#include "time_estimator.h"
+
+namespace battd {
+
+// --- Per-gauge configuration ---
+struct GaugeConfig {
+    std::string name;
+    int bus = 1;
+    uint16_t addr = 0x36;
+    ChipType chip = ChipType::Auto;
+    unsigned interval_ms = 10000;
+    // While the gauge hibernates (or sleeps) it measures rarely; poll at this
+    // interval instead. 0 = keep interval_ms.
+    unsigned hibernate_interval_ms = 0;
+    // HIBRT thresholds to program, < 0 = leave the chip's setting alone
+    double hib_threshold = -1.0;    // %/h
+    double act_threshold = -1.0;    // mV
+    std::string battery_path = "/sys/devices/platform/userspace_battery";
+    bool ko_write = true;
+    // Stage each publish in the module's transaction attribute
+    bool ko_transaction = false;
+
+    // Optional ALRT line: gpiochip device and line offset
+    std::string alert_chip;
+    int alert_line = -1;
+
+    // Optional charger-detect input, published as the companion charger's
+    // ONLINE property (module loaded with charger=mains|usb)
+    std::string charger_chip;
+    int charger_line = -1;
+    bool charger_active_low = false;
+
+    // Optional battery temperature sensor (m°C text file), published as TEMP
+    std::string temp_source;
+
+    // Write the gauge's RCOMP from temp_source (MAX17048 datasheet model)
+    bool rcomp = false;
+    max17048::RcompParams rcomp_params;
+
+    // I2C error handling. recover_after and rebind act on the whole bus.
+    RecoveryPolicy recovery;
+    // Failed samples in a row before the battery is marked stale, 0 = leave
+    // it to the module's watchdog
+    unsigned stale_after = 3;
+
+    // Optional OCV characterisation CSV, uploaded to the module's ocv_table
+    // so capacity is derived in-kernel from voltage instead of written
+    std::string ocv_table;
+
+    Classifier::Config classifier;
+    TimeEstimator::Config time;
+    CycleTracker::Config cycles;
+};
+
+struct DaemonConfig {
+    std::vector<GaugeConfig> gauges;
+    TelemetryLogConfig log;
+    UdpSinkConfig udp;
+
+    // What each sink lets through of the samples
+    SinkFilterConfig console_filter;
+    SinkFilterConfig sysfs_filter;
+    SinkFilterConfig log_filter;
+    SinkFilterConfig metrics_filter;
+    SinkFilterConfig udp_filter;
+
+    // Prometheus text endpoint; empty = none
+    std::string metrics_socket;
+    unsigned metrics_mode = 0660;
+
+    // Cycle count and fade per gauge (<dir>/<gauge>.state); empty = start
+    // from zero on every run
+    std::string state_dir;
+    unsigned state_save_interval_s = 1800;  // at most one write per this
+
+    // Scheduling of the bus threads
+    AcquirePolicy acquire;
+};
+
+// userspace_battery instance N -> its platform device path
+std::string battery_instance_path(unsigned instance);
+
+// Parse an INI-style config file:
+//
+//   [gauge main]
+//   bus = 1
+//   address = 0x36         ; defaults to the chip's (0x55 for bq27421)
+//   chip = auto            ; max17043, max17048, max17049, bq27421 (bq27441, ...)
+//   interval = 10          ; seconds, fractions allowed
+//   hibernate_interval = 60 ; seconds while the gauge hibernates or sleeps
+//   hib_threshold = 26.6   ; HIBRT: hibernate below this |CRATE| (%/h), 0 = never
+//   act_threshold = 60     ; HIBRT: wake above this |OCV - VCELL| (mV)
+//   battery = 0            ; instance number or platform device path
+//   alert = gpiochip0:17   ; optional ALRT GPIO
+//   charger_detect = gpiochip0:22 ; optional external power input
+//   charger_active_low = no
+//   temp_source = /sys/class/thermal/thermal_zone1/temp ; or a hwmon tempN_input
+//   ocv_table = /etc/battd/cell.csv ; temp_c,ocv_uv,capacity lines
+//   rcomp = no             ; compensate CONFIG.RCOMP for temp_source
+//   rcomp0 = 0x97          ; RCOMP at 20 °C
+//   rcomp_tempco_up = -0.5 ; per °C above 20 °C
+//   rcomp_tempco_down = -5.0 ; per °C below 20 °C
+//   retries = 2            ; extra attempts per sample on I2C errors
+//   retry_backoff = 5      ; ms before the first retry, doubling, jittered
+//   sample_deadline = 1    ; seconds a sample may take including retries
+//   recover_after = 3      ; failed samples in a row before bus recovery, 0 = never
+//   bus_rebind = no        ; recovery also rebinds the adapter driver
+//   stale_after = 3        ; failed samples in a row before mark_stale, 0 = never
+//   ko_write = yes
+//   ko_transaction = no    ; one module update (seq step, uevent) per publish
+//   classifier = slope     ; slope (default) or delta (MAX17048.sh rule)
+//   delta_threshold = 10   ; mV step the delta rule calls a rise or fall
+//   slope_window = 600     ; seconds of history in the dV/dt fit
+//   slope_rate = 0.3       ; mV/min needed to call Charging/Discharging
+//   slope_confidence = 4   ; |slope| / stderr needed for a direction
+//   time_smoothing = 300   ; time constant (s) of the TTE/TTF rate average
+//   design_capacity = 3000 ; mAh, enables CHARGE_FULL(_DESIGN)
+//   cycle_fade = 0.02      ; % of capacity lost per cycle without a measured FCC
+//   cycle_deadband = 1     ; SOC % a move must exceed to count
+//   eol_capacity = 60      ; % of design below which health is Dead
+//
+//   Every sink section below also takes a change filter for the samples it
+//   gets, per gauge; a status or charge state change always passes:
+//   min_interval = 0       ; seconds, at most one sample per this
+//   max_interval = 0       ; seconds, pass an unchanged sample after this, 0 = never
+//   voltage_delta = 0      ; mV moved since the last sample passed
+//   soc_delta = 0          ; SOC % moved
+//   temp_delta = 0         ; °C moved; with all three 0 every sample passes
+//
+//   [console]              ; the table on stdout; filter keys only
+//
+//   [sysfs]                ; userspace_battery set_* writes; filter keys only.
+//                          ; Keep max_interval below the module's stale_timeout_ms.
+//
+//   [log]                  ; optional binary telemetry log (battlog exports it)
+//   path = /var/log/battd.bin
+//   flush_size = 64        ; KiB buffered before a write
+//   flush_interval = 300   ; seconds a record may wait
+//   max_size = 16          ; MiB per file before rotating
+//   keep = 4               ; rotated files kept (path.1 .. path.4)
+//   sync = no              ; fdatasync() after each flush
+//
+//   [metrics]              ; optional Prometheus text endpoint
+//   socket = /run/userspace_batteryd.sock
+//   mode = 0660            ; socket permissions
+//
+//   [udp]                  ; optional JSON datagram per sample
+//   group = 239.255.45.10  ; IPv4 destination, multicast or not
+//   port = 4510
+//   ttl = 1                ; multicast hops
+//   interface = 127.0.0.1  ; address of the multicast interface
+//
+//   [state]                ; optional persistent cycle count and fade
+//   dir = /var/lib/userspace_batteryd
+//   save_interval = 30     ; minutes between writes (also saved on exit)
+//
+//   [pipeline]             ; optional
+//   acquire_priority = 0   ; SCHED_FIFO priority of the bus threads, 0 = normal
+//   acquire_cpu = 2        ; pin the bus threads to this CPU
+//
+// Returns true on success, otherwise false with a message in *err.
+bool load_config(const std::string &path, DaemonConfig *cfg, std::string *err);
+
+// Cross-gauge checks (unique names, bus/address pairs and batteries).
+bool validate_config(const DaemonConfig &cfg, std::string *err);
+
+} // namespace battd
+
+#endif // USERSPACE_BATTERYD_CONFIG_H
@@ -0,0 +1,136 @@
+#include "cycle_tracker.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace battd {
+
+constexpr int CYCLE_STATE_VERSION = 1;
+
+bool CycleTracker::update(double soc_pct, unsigned full_mah) {
+    bool changed = false;
+    double moved;
+
+    if (!have_anchor_) {
+        anchor_ = soc_pct;
+        have_anchor_ = true;
+    }
+    moved = std::fabs(soc_pct - anchor_);
+    if (moved >= cfg_.deadband_pct) {
+        state_.throughput_pct += moved;
+        anchor_ = soc_pct;
+        changed = true;
+    }
+
+    if (full_mah && cfg_.design_mah) {
+        double pct = 100.0 * full_mah / cfg_.design_mah;
+
+        // The gauge re-learns FCC in small steps; only whole-ish moves count
+        if (!state_.measured || std::fabs(pct - state_.full_pct) >= 0.1) {
+            state_.full_pct = pct;
+            state_.measured = true;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+double CycleTracker::full_pct() const {
+    if (state_.measured)
+        return state_.full_pct;
+    return std::max(0.0, 100.0 - cycles() * cfg_.fade_pct_per_cycle);
+}
+
+int CycleTracker::charge_full_uah() const {
+    if (!cfg_.design_mah)
+        return -1;
+    return static_cast<int>(std::lround(cfg_.design_mah * 10.0 * full_pct()));
+}
+
+// --- Persistence ---
+// "key value" lines; unknown keys are skipped so newer files still load.
+
+int load_cycle_state(const std::string &path, CycleState *s) {
+    std::ifstream in(path);
+    std::string line, key;
+    CycleState out;
+    int version = 0;
+
+    if (!in)
+        return errno == ENOENT ? -ENOENT : -EIO;
+    while (std::getline(in, line)) {
+        std::istringstream ls(line);
+
+        if (line.empty() || line[0] == '#' || !(ls >> key))
+            continue;
+        if (key == "version") ls >> version;
+        else if (key == "throughput_pct") ls >> out.throughput_pct;
+        else if (key == "full_pct") ls >> out.full_pct;
+        else if (key == "measured") ls >> out.measured;
+        if (ls.fail())
+            return -EINVAL;
+    }
+    if (version != CYCLE_STATE_VERSION || out.throughput_pct < 0.0 || out.full_pct <= 0.0)
+        return -EINVAL;
+    *s = out;
+    return 0;
+}
+
+static int write_all(int fd, const char *buf, size_t len) {
+    while (len) {
+        ssize_t n = write(fd, buf, len);
+
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -errno;
+        }
+        buf += n;
+        len -= static_cast<size_t>(n);
+    }
+    return 0;
+}
+
+int save_cycle_state(const std::string &path, const CycleState &s) {
+    std::string tmp = path + ".tmp";
+    std::string dir = path.find('/') == std::string::npos ? "." : path.substr(0, path.rfind('/'));
+    char buf[256];
+    int fd, len, ret;
+
+    len = snprintf(buf, sizeof(buf),
+                   "# userspace_batteryd battery state, delete when the battery is replaced\n"
+                   "version %d\nthroughput_pct %.3f\nfull_pct %.3f\nmeasured %d\n",
+                   CYCLE_STATE_VERSION, s.throughput_pct, s.full_pct, s.measured ? 1 : 0);
+
+    fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return -errno;
+    ret = write_all(fd, buf, static_cast<size_t>(len));
+    if (!ret && fsync(fd) < 0)
+        ret = -errno;
+    close(fd);
+    if (!ret && rename(tmp.c_str(), path.c_str()) < 0)
+        ret = -errno;
+    if (ret) {
+        unlink(tmp.c_str());
+        return ret;
+    }
+
+    // Make the rename itself durable
+    fd = open(dir.empty() ? "/" : dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0)
+        return -errno;
+    if (fsync(fd) < 0)
+        ret = -errno;
+    close(fd);
+    return ret;
+}
+
+} // namespace battd
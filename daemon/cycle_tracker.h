@@ -0,0 +1,64 @@
+#ifndef USERSPACE_BATTERYD_CYCLE_TRACKER_H
+#define USERSPACE_BATTERYD_CYCLE_TRACKER_H
+
+#include <string>
+
+namespace battd {
+
+// What survives a restart. Kept small and text so a replaced battery is
+// reset by deleting one file.
+struct CycleState {
+    double throughput_pct = 0.0;    // |dSOC| summed over the battery's life
+    double full_pct = 100.0;        // capacity left, % of design (measured only)
+    bool measured = false;          // full_pct came from the gauge
+};
+
+// --- Cycle counting and capacity fade ---
+// Every percent of SOC moved, charging or discharging, is throughput; 200 %
+// (one full discharge and one full charge) is one equivalent full cycle.
+// Movement is only counted once it leaves a dead band around the last
+// counted SOC, so jitter of a resting gauge does not add up to cycles.
+// Fade is the gauge's own full charge capacity against design_mah when it
+// measures one (BQ27xxx), otherwise a linear per-cycle model.
+class CycleTracker {
+public:
+    struct Config {
+        double deadband_pct = 1.0;
+        double fade_pct_per_cycle = 0.02;   // model: 80 % after 1000 cycles
+        unsigned design_mah = 0;            // 0 = unknown, no CHARGE_FULL
+        double eol_pct = 60.0;              // health Dead below this
+    };
+
+    explicit CycleTracker(const Config &cfg, const CycleState &initial = CycleState())
+        : cfg_(cfg), state_(initial) {}
+
+    // full_mah: measured full charge capacity, 0 = none. Returns true when
+    // the persistent state changed.
+    bool update(double soc_pct, unsigned full_mah);
+
+    double cycles() const { return state_.throughput_pct / 200.0; }
+    double full_pct() const;
+    bool dead() const { return full_pct() < cfg_.eol_pct; }
+    // Faded capacity in uAh, -1 without a design capacity
+    int charge_full_uah() const;
+    const Config &config() const { return cfg_; }
+    const CycleState &state() const { return state_; }
+
+private:
+    Config cfg_;
+    CycleState state_;
+    double anchor_ = 0.0;           // SOC throughput was last counted at
+    bool have_anchor_ = false;
+};
+
+// Returns 0, -ENOENT for no state yet, -EINVAL for a file that does not
+// parse, or -errno.
+int load_cycle_state(const std::string &path, CycleState *s);
+
+// Write path.tmp, fsync, rename over path and fsync the directory, so a
+// power cut leaves either the old or the new state. Returns 0 or -errno.
+int save_cycle_state(const std::string &path, const CycleState &s);
+
+} // namespace battd
+
+#endif // USERSPACE_BATTERYD_CYCLE_TRACKER_H
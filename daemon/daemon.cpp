@@ -0,0 +1,1108 @@
+#include "daemon.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <csignal>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <functional>
+
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+
+#include "ocv_table.h"
+
+namespace battd {
+
+// --- Helpers ---
+
+// Wall clock timestamp without forking date(1)
+static void format_timestamp(char *buf, size_t len) {
+    time_t now = time(nullptr);
+    struct tm tm;
+
+    localtime_r(&now, &tm);
+    strftime(buf, len, "%Y-%m-%d %H:%M:%S", &tm);
+}
+
+// "/sys/devices/platform/userspace_battery" -> "/devices/platform/userspace_battery"
+static std::string devpath_of(const std::string &sysfs_path) {
+    if (sysfs_path.compare(0, 4, "/sys") == 0)
+        return sysfs_path.substr(4);
+    return sysfs_path;
+}
+
+// "E 3h12m" / "F 0h40m" / "-"
+static void format_remaining(char *buf, size_t len, int tte_s, int ttf_s) {
+    if (tte_s >= 0)
+        snprintf(buf, len, "E %dh%02dm", tte_s / 3600, tte_s / 60 % 60);
+    else if (ttf_s >= 0)
+        snprintf(buf, len, "F %dh%02dm", ttf_s / 3600, ttf_s / 60 % 60);
+    else
+        snprintf(buf, len, "-");
+}
+
+static bool devpath_matches(const std::string &event, const std::string &dev) {
+    return event.compare(0, dev.size(), dev) == 0 &&
+           (event.size() == dev.size() || event[dev.size()] == '/');
+}
+
+// --- Setup / Teardown ---
+
+Daemon::~Daemon() {
+    // Producers first, so the sinks still write what is queued
+    for (auto &w : workers_)
+        w.second->stop();
+    for (auto &o : outputs_)
+        o->stop();
+    if (sigfd_ >= 0)
+        close(sigfd_);
+    if (epfd_ >= 0)
+        close(epfd_);
+}
+
+int Daemon::add_fd(int fd, FdKind kind, uint32_t index, uint32_t events) {
+    struct epoll_event ev = {};
+
+    ev.events = events;
+    ev.data.u64 = (static_cast<uint64_t>(kind) << 32) | index;
+    if (epoll_ctl(epfd_, EPOLL_CTL_ADD, fd, &ev) < 0)
+        return -errno;
+    return 0;
+}
+
+// (Re)open the battery's resume_count. Modules without it just never wake us.
+int Daemon::watch_resume(size_t idx) {
+    Gauge &g = *gauges_[idx];
+    int ret;
+
+    ret = g.resume.open();
+    if (ret)
+        return ret;
+    // sysfs_notify() shows up as EPOLLPRI (plus EPOLLERR, always reported)
+    return add_fd(g.resume.fd(), FD_RESUME, static_cast<uint32_t>(idx), EPOLLPRI);
+}
+
+int Daemon::setup_gauge(size_t idx, SysfsSink *sysfs) {
+    Gauge &g = *gauges_[idx];
+    auto &worker = workers_[g.cfg.bus];
+    std::unique_ptr<SysfsPublisher> publisher;
+    SampleJob base;
+    int ret;
+
+    // Started once every gauge on the bus is known
+    if (!worker)
+        worker.reset(new BusWorker(g.cfg.bus, &done_));
+    g.worker = worker.get();
+
+    if (g.cfg.ko_write) {
+        publisher.reset(new SysfsPublisher(g.cfg.battery_path));
+        publisher->set_transaction(g.cfg.ko_transaction);
+        g.devpath = devpath_of(g.cfg.battery_path);
+
+        if (!g.cfg.ocv_table.empty()) {
+            std::vector<uint8_t> blob;
+            std::string err;
+
+            if (!load_ocv_table(g.cfg.ocv_table, &blob, &err)) {
+                fprintf(stderr, "Error: %s\n", err.c_str());
+                return -EINVAL;
+            }
+            publisher->set_ocv_table(std::move(blob));
+        }
+
+        if (watch_resume(idx))
+            fprintf(stderr, "Warning: gauge %s: %s unavailable, not resume aware\n",
+                    g.cfg.name.c_str(), g.resume.path().c_str());
+    }
+    if (sysfs)
+        sysfs->add_gauge(std::move(publisher), !cfg_.metrics_socket.empty());
+
+    if (!g.cfg.temp_source.empty())
+        g.temp.reset(new TempSource(g.cfg.temp_source));
+
+    if (!cfg_.state_dir.empty()) {
+        CycleState cs;
+
+        g.state_path = cfg_.state_dir + "/" + g.cfg.name + ".state";
+        ret = load_cycle_state(g.state_path, &cs);
+        if (ret == 0) {
+            g.cycles = CycleTracker(g.cfg.cycles, cs);
+            printf("Gauge %s: %.2f cycles, %.1f %% of design capacity (%s)\n", g.cfg.name.c_str(),
+                   g.cycles.cycles(), g.cycles.full_pct(), cs.measured ? "measured" : "estimated");
+        } else if (ret != -ENOENT) {
+            // Keep the file for inspection; the next save replaces it
+            fprintf(stderr, "Warning: gauge %s: ignoring %s: %s\n", g.cfg.name.c_str(),
+                    g.state_path.c_str(), ret == -EINVAL ? "unreadable state" : strerror(-ret));
+        }
+        g.state_saved_ns = monotonic_ns();
+    }
+
+    if (g.cfg.hib_threshold >= 0.0 || g.cfg.act_threshold >= 0.0) {
+        // Unset half keeps the datasheet POR value (HIBRT = 0x8030)
+        double hib = g.cfg.hib_threshold >= 0.0 ? g.cfg.hib_threshold : 0x80 * max17048::HIBRT_HIB_LSB_PCT_PER_HOUR;
+        double act = g.cfg.act_threshold >= 0.0 ? g.cfg.act_threshold : 0x30 * max17048::HIBRT_ACT_LSB_MV;
+
+        g.hibrt = max17048::hibrt_word(hib, act);
+        g.hibrt_pending = g.hibrt;
+    }
+
+    base.gauge = idx;
+    base.addr = g.cfg.addr;
+    base.chip = g.cfg.chip;
+    base.recovery = g.cfg.recovery;
+    g.poll_ms = g.cfg.interval_ms;
+    g.sent.interval_ms = g.poll_ms;
+    g.sent.hibrt = g.hibrt_pending;
+    worker->add_gauge(base, g.sent);
+
+    if (g.cfg.alert_line >= 0) {
+        ret = g.alert.open(g.cfg.alert_chip, g.cfg.alert_line, "userspace_batteryd",
+                           GpioLine::Edge::Falling, false, true);
+        if (ret) {
+            fprintf(stderr, "Error: gauge %s: cannot request %s line %d: %s\n", g.cfg.name.c_str(),
+                    g.cfg.alert_chip.c_str(), g.cfg.alert_line, strerror(-ret));
+            return ret;
+        }
+        ret = add_fd(g.alert.fd(), FD_ALERT, static_cast<uint32_t>(idx));
+        if (ret) return ret;
+    }
+
+    if (g.cfg.charger_line >= 0) {
+        ret = g.charger.open(g.cfg.charger_chip, g.cfg.charger_line, "userspace_batteryd",
+                             GpioLine::Edge::Both, g.cfg.charger_active_low);
+        if (ret) {
+            fprintf(stderr, "Error: gauge %s: cannot request %s line %d: %s\n", g.cfg.name.c_str(),
+                    g.cfg.charger_chip.c_str(), g.cfg.charger_line, strerror(-ret));
+            return ret;
+        }
+        ret = add_fd(g.charger.fd(), FD_CHARGER, static_cast<uint32_t>(idx));
+        if (ret) return ret;
+        // Publish the initial state; edges only report changes
+        on_charger(idx);
+    }
+    return 0;
+}
+
+// Give the sink its own thread and ring, started at the end of setup()
+OutputStage *Daemon::add_output(std::unique_ptr<Sink> sink, const SinkFilterConfig &filter) {
+    outputs_.emplace_back(new OutputStage(std::move(sink), filter, cfg_.gauges.size(), &done_));
+    return outputs_.back().get();
+}
+
+int Daemon::setup() {
+    std::vector<std::string> names;
+    SysfsSink *sysfs = nullptr;
+    sigset_t mask;
+    bool any_ko = false;
+    int ret;
+
+    epfd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd_ < 0)
+        return -errno;
+
+    if (done_.fd() < 0)
+        return -EMFILE;
+    ret = add_fd(done_.fd(), FD_COMPLETION, 0);
+    if (ret) return ret;
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    // Block before any bus thread exists so they all inherit the mask
+    pthread_sigmask(SIG_BLOCK, &mask, nullptr);
+    sigfd_ = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (sigfd_ < 0)
+        return -errno;
+    ret = add_fd(sigfd_, FD_SIGNAL, 0);
+    if (ret) return ret;
+
+    for (const GaugeConfig &gc : cfg_.gauges) {
+        names.push_back(gc.name);
+        any_ko |= gc.ko_write;
+    }
+
+    // Sinks before gauges: setup_gauge() may already publish. Order matters
+    // to fan_out(): the log records whether the sysfs sink took a sample.
+    add_output(std::unique_ptr<Sink>(new ConsoleSink), cfg_.console_filter);
+    if (any_ko) {
+        sysfs = new SysfsSink;
+        sysfs_ = add_output(std::unique_ptr<Sink>(sysfs), cfg_.sysfs_filter);
+    }
+
+    if (!cfg_.log.path.empty()) {
+        std::unique_ptr<TelemetryLog> log(new TelemetryLog(cfg_.log, names));
+
+        ret = log->open();
+        if (ret) {
+            fprintf(stderr, "Error: cannot open telemetry log %s: %s\n", cfg_.log.path.c_str(),
+                    strerror(-ret));
+            return ret;
+        }
+        log_ = add_output(std::unique_ptr<Sink>(new LogSink(std::move(log))), cfg_.log_filter);
+    }
+
+    if (!cfg_.udp.group.empty()) {
+        std::unique_ptr<UdpSink> udp(new UdpSink(cfg_.udp, names));
+
+        ret = udp->open();
+        if (ret) {
+            fprintf(stderr, "Error: cannot send to %s:%u: %s\n", cfg_.udp.group.c_str(),
+                    cfg_.udp.port, ret == -EINVAL ? "bad address" : strerror(-ret));
+            return ret;
+        }
+        udp_ = add_output(std::move(udp), cfg_.udp_filter);
+    }
+
+    for (const GaugeConfig &gc : cfg_.gauges) {
+        gauges_.emplace_back(new Gauge(gc, cfg_.metrics_filter));
+        ret = setup_gauge(gauges_.size() - 1, sysfs);
+        if (ret) return ret;
+    }
+
+    if (!cfg_.metrics_socket.empty()) {
+        metrics_.reset(new MetricsServer(cfg_.metrics_socket, cfg_.metrics_mode));
+        ret = metrics_->open();
+        if (ret) {
+            fprintf(stderr, "Error: cannot listen on %s: %s\n", cfg_.metrics_socket.c_str(),
+                    strerror(-ret));
+            return ret;
+        }
+        ret = add_fd(metrics_->fd(), FD_METRICS, 0);
+        if (ret) return ret;
+    }
+
+    if (any_ko) {
+        ret = uevents_.open();
+        if (ret)
+            fprintf(stderr, "Warning: uevent socket unavailable (%s), relying on ENODEV reopen\n",
+                    strerror(-ret));
+        else
+            add_fd(uevents_.fd(), FD_UEVENT, 0);
+    }
+
+    for (auto &o : outputs_) {
+        ret = o->start();
+        if (ret) return ret;
+    }
+    for (auto &w : workers_) {
+        ret = w.second->start();
+        if (ret) {
+            fprintf(stderr, "Error: cannot open /dev/i2c-%d: %s\n", w.first, strerror(-ret));
+            return ret;
+        }
+        ret = w.second->set_policy(cfg_.acquire);
+        if (ret)
+            fprintf(stderr, "Warning: i2c-%d: cannot apply acquire_priority/acquire_cpu: %s\n",
+                    w.first, strerror(-ret));
+    }
+    return 0;
+}
+
+// --- Event handlers ---
+
+// Tell the bus thread about anything that changed since the last command.
+// A full command ring is retried after the next result.
+void Daemon::sync_params(size_t idx) {
+    Gauge &g = *gauges_[idx];
+    GaugeCommand c;
+
+    c.gauge = idx;
+    c.update = true;
+    c.params.interval_ms = g.poll_ms;
+    c.params.probe = g.asleep;
+    c.params.rcomp = g.rcomp_pending;
+    c.params.hibrt = g.hibrt_pending;
+    if (c.params == g.sent)
+        return;
+    if (g.worker->command(c))
+        g.sent = c.params;
+    else
+        acquire_.dropped++;
+}
+
+// Sample now, outside the schedule
+void Daemon::request_sample(size_t idx, bool alert) {
+    Gauge &g = *gauges_[idx];
+    GaugeCommand c;
+
+    sync_params(idx);
+    c.gauge = idx;
+    c.sample = true;
+    c.alert = alert;
+    c.queued_ns = monotonic_ns();
+    if (!g.worker->command(c))
+        acquire_.dropped++;
+}
+
+// Offer it to every sink that takes its kind; each applies its own filter
+// and counts what it drops. The module only hears about ko_write gauges.
+void Daemon::fan_out(OutputItem &it) {
+    int64_t now = monotonic_ns();
+
+    it.queued_ns = now;
+    for (auto &o : outputs_) {
+        if (o.get() != sysfs_) {
+            o->offer(it, now);
+            continue;
+        }
+        if (!gauges_[it.gauge]->cfg.ko_write)
+            continue;
+        if (o->offer(it, now) && it.kind == OutputItem::SAMPLE)
+            it.rec.flags |= TELEMETRY_PUBLISHED;
+    }
+}
+
+// A console line, written by the console sink like everything else that
+// can block
+void Daemon::say(bool error, const char *fmt, ...) {
+    OutputItem it;
+    va_list ap;
+
+    it.error = error;
+    va_start(ap, fmt);
+    vsnprintf(it.text, sizeof(it.text), fmt, ap);
+    va_end(ap);
+    fan_out(it);
+}
+
+void Daemon::on_alert(size_t idx) {
+    Gauge &g = *gauges_[idx];
+
+    // Always honoured: the ALRT line stays low until the flags are cleared
+    if (g.alert.drain(nullptr))
+        request_sample(idx, true);
+}
+
+// External power changed: publish it right away (no I2C involved) so the
+// module's charger -> battery notification chain fires immediately, then
+// take a fresh sample for the new charge state.
+void Daemon::on_charger(size_t idx) {
+    Gauge &g = *gauges_[idx];
+    OutputItem it;
+    char ts[32];
+    int online;
+
+    g.charger.drain(nullptr);
+    online = g.charger.value(nullptr);
+    if (online < 0)
+        return;
+
+    format_timestamp(ts, sizeof(ts));
+    say(false, "%s | %-8s | External power %s", ts, g.cfg.name.c_str(),
+        online ? "online" : "offline");
+
+    it.kind = OutputItem::ONLINE;
+    it.gauge = idx;
+    it.online = online;
+    fan_out(it);
+    request_sample(idx, false);
+}
+
+void Daemon::on_uevent() {
+    uevents_.drain([this](const std::string &devpath) {
+        for (size_t i = 0; i < gauges_.size(); i++) {
+            Gauge &g = *gauges_[i];
+
+            if (g.cfg.ko_write && devpath_matches(devpath, g.devpath)) {
+                bool watched = g.resume.fd() >= 0 || g.resume_lost;
+                OutputItem it;
+
+                it.kind = OutputItem::INVALIDATE;
+                it.gauge = i;
+                fan_out(it);
+                // Module reloaded: the old resume_count node is gone too. A
+                // module that never had one is not retried on every publish.
+                g.resume_lost = watch_resume(i) != 0 && watched;
+                g.have_seq = false;
+            }
+        }
+    }, nullptr);
+}
+
+// The system slept: the battery drained (or charged) while the timer was
+// frozen, so history spanning the gap would misclassify. Forget it and
+// sample right away instead of at the next tick.
+void Daemon::on_resume(size_t idx) {
+    Gauge &g = *gauges_[idx];
+    uint64_t prev = g.resume.value(), count;
+    char ts[32];
+    int ret;
+
+    ret = g.resume.read(&count);
+    if (ret == -ENODEV || ret == -EBADF) {
+        // The node is gone with the module and would report EPOLLERR on
+        // every wait: closing drops it from epoll. The uevent, or failing
+        // that the next successful publish, opens it again.
+        g.resume.close();
+        g.resume_lost = true;
+        return;
+    }
+    if (ret || count == prev)
+        return;
+
+    format_timestamp(ts, sizeof(ts));
+    say(false, "%s | %-8s | System resumed, resampling", ts, g.cfg.name.c_str());
+
+    g.classifier.reset();
+    g.times.reset();
+    // A sample already on the bus started before this and is dropped by
+    // process(); the requested one comes after it
+    g.resume_ns = monotonic_ns();
+    request_sample(idx, false);
+}
+
+void Daemon::on_completions() {
+    SampleResult r;
+    OutputDone d;
+
+    done_.clear();
+    for (auto &w : workers_) {
+        while (w.second->pop_result(&r)) {
+            Gauge &g = *gauges_[r.gauge];
+
+            // The bus thread has dropped whatever it wrote; see sync_params()
+            if (r.rcomp >= 0)
+                g.sent.rcomp = -1;
+            if (r.hibrt >= 0)
+                g.sent.hibrt = -1;
+            acquire_.latency.observe((r.done_ns - r.queued_ns) / 1e9);
+            process(r);
+            sync_params(r.gauge);
+            process_.latency.observe((monotonic_ns() - r.done_ns) / 1e9);
+        }
+    }
+
+    for (auto &o : outputs_) {
+        while (o->pop_done(&d))
+            on_output_done(o.get(), d);
+    }
+}
+
+// What a sink did with an item: metrics, and the errors it cannot print
+// itself without racing the console sink
+void Daemon::on_output_done(OutputStage *out, const OutputDone &d) {
+    Gauge &g = *gauges_[d.gauge];
+    const char *name = g.cfg.name.c_str();
+    char ts[32];
+
+    out->metrics().latency.observe((d.done_ns - d.queued_ns) / 1e9);
+    g.metrics.syscalls += d.syscalls;
+    if (d.err)
+        out->metrics().errors++;
+    format_timestamp(ts, sizeof(ts));
+
+    if (out == sysfs_) {
+        switch (d.kind) {
+        case OutputItem::SAMPLE:
+            if (d.err)
+                g.metrics.publish_errors++;
+            else
+                g.metrics.published++;
+            // Without uevents this is the only sign the module is back
+            if (!d.err && g.resume_lost)
+                g.resume_lost = watch_resume(d.gauge) != 0;
+            if (d.err == -ENOENT)
+                say(true, "%s | %-8s | INFO: KO path %s not found.", ts, name,
+                    g.cfg.battery_path.c_str());
+            else if (d.err)
+                say(true, "%s | %-8s | ERROR writing to KO sysfs: %s", ts, name, strerror(-d.err));
+            g.have_seq = d.have_seq;
+            if (d.have_seq)
+                g.module_seq = d.seq;
+            break;
+        case OutputItem::ONLINE:
+            if (d.err)
+                say(true, "%s | %-8s | ERROR writing set_online: %s", ts, name, strerror(-d.err));
+            break;
+        case OutputItem::STALE:
+            if (d.err)
+                say(true, "%s | %-8s | ERROR writing mark_stale: %s", ts, name, strerror(-d.err));
+            else
+                say(true, "%s | %-8s | WARNING: %u failed samples, battery marked stale", ts, name,
+                    g.failures);
+            break;
+        default:
+            break;
+        }
+    } else if (out == log_) {
+        log_dropped_ = d.log_dropped;
+        if (d.err)
+            say(true, "%-8s | ERROR writing telemetry log: %s (%llu records dropped)", name,
+                strerror(-d.err), static_cast<unsigned long long>(d.log_dropped));
+    } else if (out == udp_ && d.err != udp_err_) {
+        // Once per change: with no route every datagram fails the same way
+        if (d.err)
+            say(true, "%s | %-8s | ERROR sending to %s:%u: %s", ts, name, cfg_.udp.group.c_str(),
+                cfg_.udp.port, strerror(-d.err));
+        else
+            say(false, "%s | %-8s | Sending to %s:%u again", ts, name, cfg_.udp.group.c_str(),
+                cfg_.udp.port);
+        udp_err_ = d.err;
+    }
+}
+
+// Queue an RCOMP write for the next job once the ideal value has moved a
+// full register step away from what the gauge has. Every write makes the
+// gauge re-fit its SOC model, so jitter must not cause writes.
+void Daemon::update_rcomp(Gauge &g, double temp_c) {
+    double want = max17048::rcomp_for_temp(temp_c, g.cfg.rcomp_params);
+
+    if (g.rcomp_known && std::fabs(want - g.rcomp_applied) < 1.0) {
+        g.rcomp_pending = -1;
+        return;
+    }
+    g.rcomp_target = want;
+    g.rcomp_pending = max17048::rcomp_register(want);
+}
+
+// Follow the gauge's own duty cycle: while it hibernates it only measures
+// every 45 s and while it sleeps not at all, so polling at the normal rate
+// just repeats old values. Returns false if r holds no measurement to use.
+bool Daemon::update_power_state(size_t idx, const SampleResult &r) {
+    Gauge &g = *gauges_[idx];
+    const Sample &s = r.sample;
+    bool was_asleep = g.asleep;
+    unsigned ms = g.cfg.interval_ms;
+    char ts[32];
+
+    if (s.hibernating != g.hibernating || s.asleep != g.asleep) {
+        format_timestamp(ts, sizeof(ts));
+        say(false, "%s | %-8s | Gauge %s", ts, g.cfg.name.c_str(),
+            s.asleep ? "asleep" : s.hibernating ? "hibernating" : "active");
+    }
+    g.hibernating = s.hibernating;
+    g.asleep = s.asleep;
+
+    if ((g.hibernating || g.asleep) && g.cfg.hibernate_interval_ms)
+        ms = g.cfg.hibernate_interval_ms;
+    // The bus thread restarts its schedule on the next sync
+    g.poll_ms = ms;
+
+    if (r.probe) {
+        // Woke up: take a real sample now rather than one interval later
+        if (was_asleep && !g.asleep)
+            request_sample(idx, false);
+        return false;
+    }
+    return !g.asleep;
+}
+
+// The record minus TELEMETRY_PUBLISHED, which fan_out() adds
+void Daemon::fill_record(const SampleResult &r, const BatteryUpdate &u, TelemetryRecord *rec) const {
+    const Gauge &g = *gauges_[r.gauge];
+    const Sample &s = r.sample;
+    int64_t now = monotonic_ns();
+
+    rec->mono_ns = r.start_ns;
+    rec->wall_ns = realtime_ns() - (now - r.start_ns);
+    rec->voltage_uv = static_cast<uint32_t>(s.voltage_uv);
+    rec->soc_milli = static_cast<int32_t>(lround(s.soc_percent * 1000.0));
+    rec->rate_milli = static_cast<int32_t>(lround(s.crate_pct_per_hour * 1000.0));
+    rec->temp_mc = u.have_temp ? u.temp_dc * 100 : 0;
+    rec->tte_s = u.time_to_empty_s;
+    rec->ttf_s = u.time_to_full_s;
+    rec->raw_voltage = s.raw_voltage;
+    rec->raw_soc = s.raw_soc;
+    rec->raw_rate = s.raw_rate;
+    rec->latency_us = static_cast<uint32_t>((r.done_ns - r.queued_ns) / 1000);
+    rec->gauge = static_cast<uint8_t>(r.gauge);
+    rec->chip = static_cast<uint8_t>(g.chip);
+    rec->state = static_cast<uint8_t>(g.classifier.state());
+    rec->flags = (s.crate_valid ? TELEMETRY_RATE_VALID : 0) |
+                 (u.have_temp ? TELEMETRY_TEMP_VALID : 0) |
+                 (s.hibernating ? TELEMETRY_HIBERNATING : 0);
+}
+
+// Escalate a run of failed samples: the module would only notice once its
+// watchdog expires, and not at all with stale_timeout_ms = 0.
+void Daemon::mark_stale(size_t idx, const SampleResult &r) {
+    Gauge &g = *gauges_[idx];
+    bool gave_up = r.recovery.recovered && r.recovery.recovery_err;
+    OutputItem it;
+
+    if (g.marked_stale || !g.cfg.ko_write || !g.cfg.stale_after)
+        return;
+    if (g.failures < g.cfg.stale_after && !gave_up)
+        return;
+
+    g.marked_stale = true;
+    it.kind = OutputItem::STALE;
+    it.gauge = idx;
+    fan_out(it);
+}
+
+void Daemon::save_state(Gauge &g, bool force) {
+    int64_t now = monotonic_ns();
+    int ret;
+
+    if (g.state_path.empty() || !g.state_dirty)
+        return;
+    if (!force && now - g.state_saved_ns < static_cast<int64_t>(cfg_.state_save_interval_s) * 1000000000)
+        return;
+
+    ret = save_cycle_state(g.state_path, g.cycles.state());
+    // Retry at the next interval rather than on every sample
+    g.state_saved_ns = now;
+    if (ret) {
+        say(true, "%-8s | ERROR saving %s: %s", g.cfg.name.c_str(), g.state_path.c_str(),
+            strerror(-ret));
+        return;
+    }
+    g.state_dirty = false;
+}
+
+void Daemon::process(const SampleResult &r) {
+    Gauge &g = *gauges_[r.gauge];
+    const Sample &s = r.sample;
+    OutputItem it;
+    BatteryUpdate &u = it.update;
+    SyscallStats st = r.st;
+    double voltage_v, t_s;
+    char ts[32], remaining[32], rate[16] = "N/A", temp[16] = "N/A";
+    int64_t now;
+    int temp_mc, ret;
+
+    format_timestamp(ts, sizeof(ts));
+
+    g.metrics.samples++;
+    g.metrics.missed_ticks += r.missed;
+    g.metrics.i2c_transactions += r.st.ioctls;
+    g.metrics.bus_seconds += (r.done_ns - r.start_ns) / 1e9;
+    g.metrics.latency.observe((r.done_ns - r.queued_ns) / 1e9);
+    for (size_t i = 0; i < I2C_ERROR_CLASSES; i++)
+        g.metrics.i2c_errors[i] += r.recovery.errors[i];
+    g.metrics.retries += r.recovery.retries;
+
+    if (r.recovery.recovered) {
+        g.metrics.bus_recoveries++;
+        g.metrics.recovery.observe(r.recovery.recovery_ns / 1e9);
+        if (r.recovery.recovery_err) {
+            g.metrics.bus_recovery_errors++;
+            say(true, "%s | %-8s | ERROR recovering i2c-%d: %s", ts, g.cfg.name.c_str(),
+                g.cfg.bus, strerror(-r.recovery.recovery_err));
+        } else {
+            say(false, "%s | %-8s | Recovered i2c-%d (%s, %.1f ms)", ts, g.cfg.name.c_str(), g.cfg.bus,
+                g.cfg.recovery.rebind ? "rebind" : "reopen", r.recovery.recovery_ns / 1e6);
+        }
+    }
+
+    if (r.alert && r.alert_flags)
+        say(false, "%s | %-8s | ALERT: STATUS flags 0x%02x", ts, g.cfg.name.c_str(), r.alert_flags);
+    if (r.detected != ChipType::Auto) {
+        say(false, "%s | %-8s | Detected %s (ID 0x%04x)", ts, g.cfg.name.c_str(),
+            chip_type_name(r.detected), r.chip_id);
+        g.chip = r.detected;
+    }
+    // A power-on reset restores the default RCOMP and HIBRT
+    if (r.reset) {
+        g.rcomp_known = false;
+        g.hibrt_pending = g.hibrt;
+    }
+
+    if (r.hibrt >= 0) {
+        if (r.hibrt_err == -EOPNOTSUPP) {
+            say(true, "%s | %-8s | WARNING: %s has no HIBRT, thresholds ignored", ts,
+                g.cfg.name.c_str(), chip_type_name(g.chip));
+            g.hibrt = g.hibrt_pending = -1;
+        } else if (r.hibrt_err)
+            say(true, "%s | %-8s | ERROR writing HIBRT: %s", ts, g.cfg.name.c_str(),
+                strerror(-r.hibrt_err));
+        else if (r.hibrt == g.hibrt_pending)
+            g.hibrt_pending = -1;
+    }
+
+    if (r.rcomp >= 0) {
+        if (r.rcomp_err == -EOPNOTSUPP) {
+            say(true, "%s | %-8s | WARNING: %s has no RCOMP, compensation disabled", ts,
+                g.cfg.name.c_str(), chip_type_name(g.chip));
+            g.cfg.rcomp = false;
+            g.rcomp_pending = -1;
+        } else if (r.rcomp_err) {
+            say(true, "%s | %-8s | ERROR writing RCOMP: %s", ts, g.cfg.name.c_str(),
+                strerror(-r.rcomp_err));
+        } else if (r.rcomp == g.rcomp_pending) {
+            say(false, "%s | %-8s | RCOMP set to 0x%02x", ts, g.cfg.name.c_str(), r.rcomp);
+            g.rcomp_known = true;
+            g.rcomp_applied = g.rcomp_target;
+            g.rcomp_pending = -1;
+        }
+    }
+
+    if (r.err) {
+        g.metrics.read_errors[-r.err]++;
+        g.failures++;
+        mark_stale(r.gauge, r);
+        if (g.chip == ChipType::Auto)
+            say(true, "%s | %-8s | Error identifying gauge at 0x%02x: %s. Skipping.", ts,
+                g.cfg.name.c_str(), g.cfg.addr, strerror(-r.err));
+        else
+            say(true, "%s | %-8s | Error reading gauge: %s. Skipping.", ts,
+                g.cfg.name.c_str(), strerror(-r.err));
+        return;
+    }
+    if (g.failures) {
+        say(false, "%s | %-8s | Gauge answering again after %u failed samples", ts,
+            g.cfg.name.c_str(), g.failures);
+        g.failures = 0;
+        g.marked_stale = false;
+    }
+    // Read before the system slept (or while it was suspending)
+    if (r.start_ns < g.resume_ns)
+        return;
+    // Nothing to publish while the gauge sleeps: its registers are frozen
+    // and the module's watchdog is the right way to report that
+    if (!update_power_state(r.gauge, r))
+        return;
+
+    voltage_v = s.voltage_uv / 1e6;
+    t_s = r.start_ns / 1e9;
+    g.classifier.update(t_s, voltage_v);
+    g.times.update(t_s, s.soc_percent, s.crate_valid, s.crate_pct_per_hour);
+
+    u.voltage_uv = s.voltage_uv;
+    u.capacity = capacity_percent(s);
+    u.status = g.classifier.power_supply_status(voltage_v);
+    u.time_to_empty_s = g.times.time_to_empty_s();
+    u.time_to_full_s = g.times.time_to_full_s();
+    if (g.cycles.update(s.soc_percent, s.full_mah))
+        g.state_dirty = true;
+    u.cycle_count = static_cast<int>(g.cycles.cycles());
+    u.health = g.cycles.dead() ? "Dead" : "Good";
+    u.charge_full_uah = g.cycles.charge_full_uah();
+    if (g.cfg.cycles.design_mah)
+        u.charge_full_design_uah = static_cast<int>(g.cfg.cycles.design_mah * 1000);
+    save_state(g, false);
+    format_remaining(remaining, sizeof(remaining), u.time_to_empty_s, u.time_to_full_s);
+
+    if (g.temp) {
+        ret = g.temp->read(&temp_mc, &st);
+        if (ret == 0) {
+            u.have_temp = true;
+            u.temp_dc = temp_mc / 100;
+            snprintf(temp, sizeof(temp), "%.1f", temp_mc / 1000.0);
+            if (g.cfg.rcomp)
+                update_rcomp(g, temp_mc / 1000.0);
+        } else {
+            snprintf(temp, sizeof(temp), "Error");
+        }
+    } else if (s.temp_valid) {
+        // The gauge's own sensor (BQ27xxx)
+        u.have_temp = true;
+        u.temp_dc = s.temp_mc / 100;
+        snprintf(temp, sizeof(temp), "%.1f", s.temp_mc / 1000.0);
+    }
+
+    // Syscalls of the sample itself (bus, temperature); each sink's own
+    // are counted in battd_syscalls_total
+    if (s.crate_valid)
+        snprintf(rate, sizeof(rate), "%.3f", s.crate_pct_per_hour);
+    snprintf(it.text, sizeof(it.text), "%s | %-8s | %-11.4f | %-7.2f | %-10s | %-9s | %-12s | %-8s | %u",
+             ts, g.cfg.name.c_str(), voltage_v, s.soc_percent, rate, temp,
+             charge_state_name(g.classifier.state()), remaining, st.total());
+    g.metrics.syscalls += st.total();
+
+    it.kind = OutputItem::SAMPLE;
+    it.gauge = r.gauge;
+    fill_record(r, u, &it.rec);
+    it.rec.syscalls = static_cast<uint16_t>(st.total());
+
+    // The metrics endpoint is the one sink kept by the loop itself
+    now = monotonic_ns();
+    if (g.metrics_filter.wants(it, now)) {
+        g.metrics_filter.sent(it, now);
+        metrics_sink_.queued++;
+        g.metrics.last_sample_wall_ns = realtime_ns() - (now - r.start_ns);
+        g.have_last = true;
+        g.last = s;
+        g.last_update = u;
+    } else {
+        metrics_sink_.filtered++;
+    }
+
+    fan_out(it);
+}
+
+// --- Metrics ---
+
+// errno label for the read error counter
+static std::string errno_label(int err) {
+    switch (err) {
+    case EIO:       return "EIO";
+    case EREMOTEIO: return "EREMOTEIO";     // NACK on most adapters
+    case ENXIO:     return "ENXIO";
+    case ETIMEDOUT: return "ETIMEDOUT";
+    case EAGAIN:    return "EAGAIN";        // arbitration lost
+    case EBUSY:     return "EBUSY";
+    case ENODEV:    return "ENODEV";        // no such chip
+    default:        return std::to_string(err);
+    }
+}
+
+void Daemon::render_metrics(std::string *out) const {
+    static const ChargeState states[] = { ChargeState::Monitoring, ChargeState::Stable,
+                                          ChargeState::Charging, ChargeState::Discharging };
+    std::vector<std::string> labels;
+    char addr[8];
+
+    // One family with a series for every gauge get() has a value for
+    auto family = [&](const char *name, const char *type, const char *help,
+                      const std::function<bool(const Gauge &, double *)> &get) {
+        double v;
+
+        metric_header(out, name, type, help);
+        for (size_t i = 0; i < gauges_.size(); i++) {
+            if (get(*gauges_[i], &v))
+                metric_value(out, name, labels[i], v);
+        }
+    };
+
+    for (const auto &g : gauges_)
+        labels.push_back(metric_label("gauge", g->cfg.name));
+
+    metric_header(out, "battd_gauge_info", "gauge", "Configured gauges.");
+    for (size_t i = 0; i < gauges_.size(); i++) {
+        const Gauge &g = *gauges_[i];
+
+        snprintf(addr, sizeof(addr), "0x%02x", g.cfg.addr);
+        metric_value(out, "battd_gauge_info",
+                     labels[i] + "," + metric_label("chip", chip_type_name(g.chip)) + "," +
+                     metric_label("bus", std::to_string(g.cfg.bus)) + "," +
+                     metric_label("address", addr), 1);
+    }
+
+    // Last sample
+    family("battd_voltage_volts", "gauge", "Pack voltage of the last sample.",
+           [](const Gauge &g, double *v) { *v = g.last.voltage_uv / 1e6; return g.have_last; });
+    family("battd_soc_percent", "gauge", "State of charge of the last sample.",
+           [](const Gauge &g, double *v) { *v = g.last.soc_percent; return g.have_last; });
+    family("battd_charge_rate_percent_per_hour", "gauge", "Charge rate, negative while discharging.",
+           [](const Gauge &g, double *v) {
+               *v = g.last.crate_pct_per_hour;
+               return g.have_last && g.last.crate_valid;
+           });
+    family("battd_temperature_celsius", "gauge", "Battery temperature.",
+           [](const Gauge &g, double *v) {
+               *v = g.last_update.temp_dc / 10.0;
+               return g.have_last && g.last_update.have_temp;
+           });
+    family("battd_time_to_empty_seconds", "gauge", "Estimated time to empty.",
+           [](const Gauge &g, double *v) {
+               *v = g.last_update.time_to_empty_s;
+               return g.have_last && *v >= 0;
+           });
+    family("battd_time_to_full_seconds", "gauge", "Estimated time to full.",
+           [](const Gauge &g, double *v) {
+               *v = g.last_update.time_to_full_s;
+               return g.have_last && *v >= 0;
+           });
+    metric_header(out, "battd_charge_state", "gauge", "Classifier state, one series per state.");
+    for (size_t i = 0; i < gauges_.size(); i++) {
+        for (ChargeState cs : states)
+            metric_value(out, "battd_charge_state",
+                         labels[i] + "," + metric_label("state", charge_state_name(cs)),
+                         gauges_[i]->classifier.state() == cs);
+    }
+    family("battd_battery_cycles", "gauge", "Equivalent full cycles, from SOC throughput.",
+           [](const Gauge &g, double *v) { *v = g.cycles.cycles(); return true; });
+    family("battd_battery_full_percent", "gauge", "Full capacity left, percent of design.",
+           [](const Gauge &g, double *v) { *v = g.cycles.full_pct(); return true; });
+    family("battd_gauge_hibernating", "gauge", "Gauge reports hibernation.",
+           [](const Gauge &g, double *v) { *v = g.hibernating; return true; });
+    family("battd_gauge_asleep", "gauge", "Gauge is asleep, nothing is published.",
+           [](const Gauge &g, double *v) { *v = g.asleep; return true; });
+    family("battd_last_sample_timestamp_seconds", "gauge", "Wall clock time of the last sample.",
+           [](const Gauge &g, double *v) {
+               *v = g.metrics.last_sample_wall_ns / 1e9;
+               return g.have_last;
+           });
+
+    // Acquisition
+    family("battd_samples_total", "counter", "Bus jobs completed.",
+           [](const Gauge &g, double *v) { *v = g.metrics.samples; return true; });
+    family("battd_missed_ticks_total", "counter", "Sampling ticks skipped because a sample overran.",
+           [](const Gauge &g, double *v) { *v = g.metrics.missed_ticks; return true; });
+    metric_header(out, "battd_read_errors_total", "counter", "Failed gauge reads by errno.");
+    for (size_t i = 0; i < gauges_.size(); i++) {
+        for (const auto &e : gauges_[i]->metrics.read_errors)
+            metric_value(out, "battd_read_errors_total",
+                         labels[i] + "," + metric_label("errno", errno_label(e.first)), e.second);
+    }
+    metric_header(out, "battd_i2c_errors_total", "counter", "Failed I2C attempts by error class.");
+    for (size_t i = 0; i < gauges_.size(); i++) {
+        for (size_t c = 0; c < I2C_ERROR_CLASSES; c++)
+            metric_value(out, "battd_i2c_errors_total",
+                         labels[i] + "," + metric_label("class", i2c_error_name(static_cast<I2cError>(c))),
+                         gauges_[i]->metrics.i2c_errors[c]);
+    }
+    family("battd_retries_total", "counter", "I2C attempts repeated after an error.",
+           [](const Gauge &g, double *v) { *v = g.metrics.retries; return true; });
+    family("battd_bus_recoveries_total", "counter", "Bus reopens/rebinds triggered by the gauge.",
+           [](const Gauge &g, double *v) { *v = g.metrics.bus_recoveries; return true; });
+    family("battd_bus_recovery_errors_total", "counter", "Bus recoveries that failed.",
+           [](const Gauge &g, double *v) { *v = g.metrics.bus_recovery_errors; return true; });
+    metric_header(out, "battd_bus_recovery_seconds", "histogram", "Time spent reopening the bus.");
+    for (size_t i = 0; i < gauges_.size(); i++)
+        gauges_[i]->metrics.recovery.render(out, "battd_bus_recovery_seconds", labels[i]);
+    family("battd_gauge_stale", "gauge", "The battery was marked stale after failed samples.",
+           [](const Gauge &g, double *v) { *v = g.marked_stale; return true; });
+    family("battd_i2c_transactions_total", "counter", "I2C_RDWR transactions issued.",
+           [](const Gauge &g, double *v) { *v = g.metrics.i2c_transactions; return true; });
+    family("battd_bus_seconds_total", "counter", "Time the bus thread spent on the gauge.",
+           [](const Gauge &g, double *v) { *v = g.metrics.bus_seconds; return true; });
+    metric_header(out, "battd_sample_latency_seconds", "histogram", "Job queued to bus read done.");
+    for (size_t i = 0; i < gauges_.size(); i++)
+        gauges_[i]->metrics.latency.render(out, "battd_sample_latency_seconds", labels[i]);
+    family("battd_syscalls_total", "counter", "Syscalls spent on samples, acquisition and sinks.",
+           [](const Gauge &g, double *v) { *v = g.metrics.syscalls; return true; });
+
+    // Module side
+    family("battd_published_total", "counter", "Samples written to the module.",
+           [](const Gauge &g, double *v) { *v = g.metrics.published; return true; });
+    family("battd_publish_errors_total", "counter", "Failed writes to the module.",
+           [](const Gauge &g, double *v) { *v = g.metrics.publish_errors; return true; });
+    family("battd_module_seq", "counter", "The module's update sequence number.",
+           [](const Gauge &g, double *v) { *v = g.module_seq; return g.have_seq; });
+    family("battd_module_resume_count", "counter", "System resumes seen by the module.",
+           [](const Gauge &g, double *v) { *v = g.resume.value(); return g.resume.fd() >= 0; });
+
+    if (!cfg_.log.path.empty()) {
+        metric_header(out, "battd_log_dropped_records_total", "counter",
+                      "Telemetry records lost to write errors.");
+        metric_value(out, "battd_log_dropped_records_total", "", log_dropped_);
+    }
+
+    // Pipeline: each stage's queue is the ring(s) in front of it
+    {
+        struct Stage {
+            const char *name;
+            const Histogram *latency;
+            uint64_t dropped;
+            size_t depth, high_water;
+        } stages[] = {
+            { "acquire", &acquire_.latency, acquire_.dropped, 0, 0 },
+            { "process", &process_.latency, process_.dropped, 0, 0 },
+        };
+
+        for (const auto &w : workers_) {
+            stages[0].depth += w.second->command_depth();
+            stages[0].high_water = std::max(stages[0].high_water, w.second->command_high_water());
+            stages[1].depth += w.second->result_depth();
+            stages[1].high_water = std::max(stages[1].high_water, w.second->result_high_water());
+            stages[1].dropped += w.second->dropped();
+        }
+
+        metric_header(out, "battd_stage_queue_depth", "gauge", "Items waiting for a pipeline stage.");
+        for (const Stage &st : stages)
+            metric_value(out, "battd_stage_queue_depth", metric_label("stage", st.name), st.depth);
+        metric_header(out, "battd_stage_queue_high_water", "gauge",
+                      "Deepest a stage's queue has been (per bus for acquire and process).");
+        for (const Stage &st : stages)
+            metric_value(out, "battd_stage_queue_high_water", metric_label("stage", st.name),
+                         st.high_water);
+        metric_header(out, "battd_stage_dropped_total", "counter",
+                      "Items lost because a stage's queue was full.");
+        for (const Stage &st : stages)
+            metric_value(out, "battd_stage_dropped_total", metric_label("stage", st.name),
+                         st.dropped);
+        metric_header(out, "battd_stage_latency_seconds", "histogram",
+                      "Entering a stage's queue to leaving the stage.");
+        for (const Stage &st : stages)
+            st.latency->render(out, "battd_stage_latency_seconds", metric_label("stage", st.name));
+    }
+
+    // Sinks: the output stages plus the metrics endpoint, which has no queue
+    {
+        struct SinkRow {
+            std::string label;
+            const SinkMetrics *m;
+            size_t depth, high_water;
+        };
+        std::vector<SinkRow> sinks;
+
+        for (const auto &o : outputs_)
+            sinks.push_back({ metric_label("sink", o->name()), &o->metrics(), o->backlog(),
+                              o->high_water() });
+        sinks.push_back({ metric_label("sink", "metrics"), &metrics_sink_, 0, 0 });
+
+        metric_header(out, "battd_sink_queued_total", "counter", "Items handed to a sink.");
+        for (const SinkRow &k : sinks)
+            metric_value(out, "battd_sink_queued_total", k.label, k.m->queued);
+        metric_header(out, "battd_sink_filtered_total", "counter",
+                      "Samples held back by a sink's change filter or rate limit.");
+        for (const SinkRow &k : sinks)
+            metric_value(out, "battd_sink_filtered_total", k.label, k.m->filtered);
+        metric_header(out, "battd_sink_dropped_total", "counter", "Items lost because a sink's queue was full.");
+        for (const SinkRow &k : sinks)
+            metric_value(out, "battd_sink_dropped_total", k.label, k.m->dropped);
+        metric_header(out, "battd_sink_errors_total", "counter", "Items a sink failed to write.");
+        for (const SinkRow &k : sinks)
+            metric_value(out, "battd_sink_errors_total", k.label, k.m->errors);
+        metric_header(out, "battd_sink_queue_depth", "gauge", "Items waiting for a sink.");
+        for (const SinkRow &k : sinks)
+            metric_value(out, "battd_sink_queue_depth", k.label, k.depth);
+        metric_header(out, "battd_sink_queue_high_water", "gauge", "Deepest a sink's queue has been.");
+        for (const SinkRow &k : sinks)
+            metric_value(out, "battd_sink_queue_high_water", k.label, k.high_water);
+        metric_header(out, "battd_sink_latency_seconds", "histogram", "Queued to written by the sink.");
+        for (const auto &o : outputs_)
+            o->metrics().latency.render(out, "battd_sink_latency_seconds", metric_label("sink", o->name()));
+    }
+}
+
+// Scrapes are answered from what the loop already knows; nothing here
+// waits on a bus thread or reads sysfs.
+void Daemon::on_metrics() {
+    std::string body;
+
+    body.reserve(16384);
+    render_metrics(&body);
+    metrics_->serve(body);
+}
+
+// --- Main Loop ---
+
+int Daemon::run() {
+    struct epoll_event events[16];
+
+    say(false, "--- Starting fuel gauge polling -> userspace_battery KO (%zu gauge(s), %zu bus(es)) ---",
+        gauges_.size(), workers_.size());
+    say(false, "Timestamp           | Gauge    | Voltage (V) | SOC (%%) | Rate (%%/h) | Temp (°C) | Status       | Time     | Syscalls");
+    say(false, "--------------------|----------|-------------|---------|------------|-----------|--------------|----------|---------");
+
+    for (;;) {
+        int n = epoll_wait(epfd_, events, 16, -1);
+
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("epoll_wait");
+            return 1;
+        }
+
+        for (int i = 0; i < n; i++) {
+            uint32_t kind = static_cast<uint32_t>(events[i].data.u64 >> 32);
+            size_t idx = static_cast<uint32_t>(events[i].data.u64);
+
+            switch (kind) {
+            case FD_ALERT:      on_alert(idx); break;
+            case FD_CHARGER:    on_charger(idx); break;
+            case FD_COMPLETION: on_completions(); break;
+            case FD_UEVENT:     on_uevent(); break;
+            case FD_RESUME:     on_resume(idx); break;
+            case FD_METRICS:    on_metrics(); break;
+            case FD_SIGNAL:
+                say(false, "--- Stopping ---");
+                for (auto &g : gauges_)
+                    save_state(*g, true);
+                return 0;
+            }
+        }
+    }
+}
+
+} // namespace battd
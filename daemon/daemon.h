@@ -0,0 +1,169 @@
+#ifndef USERSPACE_BATTERYD_DAEMON_H
+#define USERSPACE_BATTERYD_DAEMON_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <sys/epoll.h>
+
+#include "bus_worker.h"
+#include "classifier.h"
+#include "config.h"
+#include "cycle_tracker.h"
+#include "gpio_line.h"
+#include "metrics.h"
+#include "output_stage.h"
+#include "sink_filter.h"
+#include "sinks.h"
+#include "sysfs_publisher.h"
+#include "sysfs_watch.h"
+#include "telemetry_log.h"
+#include "temp_source.h"
+#include "time_estimator.h"
+#include "uevent_monitor.h"
+
+namespace battd {
+
+// --- Acquisition daemon ---
+// Three stages joined by SPSC rings:
+//   acquire  one thread per bus samples its gauges on their own schedule
+//   process  the epoll loop filters and classifies each result and decides
+//            what to publish; it also owns the ALRT, charger-detect and
+//            resume_count fds and the metrics socket
+//   output   one thread per sink: the console, the module's sysfs, the
+//            log and UDP; the metrics endpoint is a sink kept by the loop
+// Only the loop talks to the other threads. Nothing downstream of the bus
+// threads can delay a sample, and no sink can delay another: rings that
+// fill up drop and count instead. Each sink has its own change filter.
+class Daemon {
+public:
+    explicit Daemon(const DaemonConfig &cfg) : cfg_(cfg) {}
+    ~Daemon();
+
+    Daemon(const Daemon &) = delete;
+    Daemon &operator=(const Daemon &) = delete;
+
+    // Open buses, timers, alert lines and the epoll set. Returns 0 or -errno.
+    int setup();
+    // Run until SIGINT/SIGTERM. Returns the process exit code.
+    int run();
+
+private:
+    struct Gauge {
+        Gauge(const GaugeConfig &c, const SinkFilterConfig &filter)
+            : cfg(c), classifier(c.classifier), times(c.time), cycles(c.cycles),
+              resume(c.battery_path + "/resume_count"), metrics_filter(filter) {}
+
+        GaugeConfig cfg;
+        Classifier classifier;
+        TimeEstimator times;
+        CycleTracker cycles;
+        std::string devpath;        // uevent devpath of the battery device
+        BusWorker *worker = nullptr;
+        GaugeParams sent;           // what the bus thread was last told
+        GpioLine alert;
+        GpioLine charger;           // charger-detect input
+        std::unique_ptr<TempSource> temp;
+        ChipType chip = ChipType::Auto; // as identified by the bus thread
+
+        // RCOMP compensation: the exact value last written, for the
+        // one-step hysteresis, and a register value waiting for a job
+        bool rcomp_known = false;
+        double rcomp_applied = 0.0;
+        double rcomp_target = 0.0;
+        int rcomp_pending = -1;
+
+        // Gauge power state, as of the last read
+        int hibrt = -1;             // HIBRT word to program, -1 = leave the chip's
+        int hibrt_pending = -1;     // Not yet written
+        bool hibernating = false;
+        bool asleep = false;        // Only probe MODE/CONFIG until it wakes
+        unsigned poll_ms = 0;       // Current sampling interval
+
+        // System resume, signalled by the module's resume_count
+        SysfsWatch resume;
+        bool resume_lost = false;   // Node went away; reopen after a good publish
+        int64_t resume_ns = 0;      // Samples started before this are dropped
+
+        // Served by the metrics endpoint; only the loop thread touches these
+        GaugeMetrics metrics;
+        SinkFilter metrics_filter;  // gates last/last_update
+        bool have_last = false;
+        Sample last;
+        BatteryUpdate last_update;
+        bool have_seq = false;      // Module's seq, re-read after each publish
+        uint64_t module_seq = 0;
+
+        // Cycle state file; written when dirty, at most once per save interval
+        std::string state_path;
+        bool state_dirty = false;
+        int64_t state_saved_ns = 0;
+
+        // Failed samples in a row; at cfg.stale_after the module is told
+        unsigned failures = 0;
+        bool marked_stale = false;
+    };
+
+    enum FdKind : uint32_t {
+        FD_ALERT,
+        FD_CHARGER,
+        FD_COMPLETION,
+        FD_UEVENT,
+        FD_RESUME,
+        FD_METRICS,
+        FD_SIGNAL,
+    };
+
+    int add_fd(int fd, FdKind kind, uint32_t index, uint32_t events = EPOLLIN);
+    int watch_resume(size_t idx);
+    int setup_gauge(size_t idx, SysfsSink *sysfs);
+    OutputStage *add_output(std::unique_ptr<Sink> sink, const SinkFilterConfig &filter);
+
+    void on_alert(size_t idx);
+    void on_charger(size_t idx);
+    void on_completions();
+    void on_uevent();
+    void on_resume(size_t idx);
+    void on_metrics();
+
+    void sync_params(size_t idx);
+    void request_sample(size_t idx, bool alert);
+    void fan_out(OutputItem &it);
+    void on_output_done(OutputStage *out, const OutputDone &d);
+    void say(bool error, const char *fmt, ...) __attribute__((format(printf, 3, 4)));
+    void update_rcomp(Gauge &g, double temp_c);
+    void mark_stale(size_t idx, const SampleResult &r);
+    void save_state(Gauge &g, bool force);
+    bool update_power_state(size_t idx, const SampleResult &r);
+    void process(const SampleResult &r);
+    void render_metrics(std::string *out) const;
+    void fill_record(const SampleResult &r, const BatteryUpdate &u, TelemetryRecord *rec) const;
+
+    DaemonConfig cfg_;
+    std::vector<std::unique_ptr<Gauge>> gauges_;
+    std::map<int, std::unique_ptr<BusWorker>> workers_;
+    Doorbell done_;             // bus results and output stage completions
+    std::vector<std::unique_ptr<OutputStage>> outputs_;
+    OutputStage *sysfs_ = nullptr;
+    OutputStage *log_ = nullptr;
+    OutputStage *udp_ = nullptr;
+    int udp_err_ = 0;           // last reported, so a missing route is said once
+    UeventMonitor uevents_;
+    std::unique_ptr<MetricsServer> metrics_;
+
+    // Pipeline, for the metrics endpoint
+    StageMetrics acquire_;
+    StageMetrics process_;
+    SinkMetrics metrics_sink_;
+    uint64_t log_dropped_ = 0;
+    int epfd_ = -1;
+    int sigfd_ = -1;
+};
+
+} // namespace battd
+
+#endif // USERSPACE_BATTERYD_DAEMON_H
@@ -0,0 +1,95 @@
+#include "gauge.h"
+
+#include "bq27xxx.h"
+#include "max17048.h"
+
+namespace battd {
+
+static const struct {
+    ChipType type;
+    const char *name;
+} chip_names[] = {
+    { ChipType::Auto, "auto" },
+    { ChipType::Max17043, "max17043" },
+    { ChipType::Max17048, "max17048" },
+    { ChipType::Max17049, "max17049" },
+    { ChipType::Bq27421, "bq27421" },
+};
+
+const char *chip_type_name(ChipType t) {
+    for (const auto &c : chip_names) {
+        if (c.type == t)
+            return c.name;
+    }
+    return "unknown";
+}
+
+bool parse_chip_type(const std::string &s, ChipType *t) {
+    for (const auto &c : chip_names) {
+        if (s == c.name) {
+            *t = c.type;
+            return true;
+        }
+    }
+    // Same register map
+    if (s == "max17044") { *t = ChipType::Max17043; return true; }
+    if (s == "bq27441" || s == "bq27425" || s == "bq27426") { *t = ChipType::Bq27421; return true; }
+    return false;
+}
+
+uint16_t chip_default_addr(ChipType t) {
+    return t == ChipType::Bq27421 ? bq27xxx::DEFAULT_ADDR : max17048::DEFAULT_ADDR;
+}
+
+int capacity_percent(const Sample &s) {
+    int cap = static_cast<int>(s.soc_percent);
+
+    if (cap < 0) cap = 0;
+    if (cap > 100) cap = 100;
+    return cap;
+}
+
+std::unique_ptr<GaugeChip> make_chip(ChipType t) {
+    std::unique_ptr<GaugeChip> chip = max17048::make_chip(t);
+
+    return chip ? std::move(chip) : bq27xxx::make_chip(t);
+}
+
+static bool is_bq27xxx(ChipType t) {
+    return t == ChipType::Bq27421;
+}
+
+// --- Detection ---
+// The probes are not interchangeable: Control() is a write, and 0x08 on a
+// BQ27 is a capacity that can look like any VERSION. So the family is
+// picked first, from the configured type or the strapped address, and only
+// its own ID register is read.
+
+std::unique_ptr<GaugeChip> detect_chip(I2cBus &bus, uint16_t addr, ChipType want, uint16_t *id,
+                                       int *err, SyscallStats *st) {
+    bool bq = want == ChipType::Auto ? addr == bq27xxx::DEFAULT_ADDR : is_bq27xxx(want);
+    ChipType found;
+    int ret;
+
+    if (bq) {
+        ret = bq27xxx::read_device_type(bus, addr, id, st);
+        if (!ret && !bq27xxx::device_type_map(*id, &found))
+            ret = -ENODEV;
+    } else {
+        ret = max17048::read_version(bus, addr, id, st);
+        if (!ret && !max17048::version_type(*id, &found))
+            ret = -ENODEV;
+        // VERSION cannot tell the 2-cell part apart; trust the config
+        if (!ret && found == ChipType::Max17048 && want == ChipType::Max17049)
+            found = want;
+    }
+    if (!ret && want != ChipType::Auto && found != want)
+        ret = -ENODEV;
+    if (ret) {
+        *err = ret;
+        return nullptr;
+    }
+    return make_chip(found);
+}
+
+} // namespace battd
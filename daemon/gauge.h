@@ -0,0 +1,92 @@
+#ifndef USERSPACE_BATTERYD_GAUGE_H
+#define USERSPACE_BATTERYD_GAUGE_H
+
+#include <cerrno>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "i2c_bus.h"
+#include "syscall_stats.h"
+
+namespace battd {
+
+// --- Supported fuel gauges ---
+enum class ChipType {
+    Auto,       // identify from VERSION / DEVICE_TYPE
+    Max17043,   // also MAX17044; 1.25 mV VCELL, no CRATE or hibernation
+    Max17048,
+    Max17049,   // 2-cell MAX17048: same VERSION, twice the VCELL LSB
+    Bq27421,    // BQ27421/BQ27441/BQ27425/BQ27426 standard commands
+};
+
+const char *chip_type_name(ChipType t);
+bool parse_chip_type(const std::string &s, ChipType *t);
+
+// I2C address the family is strapped to
+uint16_t chip_default_addr(ChipType t);
+
+// One reading in chip independent units
+struct Sample {
+    uint64_t voltage_uv = 0;            // pack voltage
+    double soc_percent = 0.0;
+    bool crate_valid = false;           // charge rate is best-effort
+    double crate_pct_per_hour = 0.0;    // signed, > 0 charging
+    bool temp_valid = false;            // gauge has its own sensor
+    int temp_mc = 0;
+    bool hibernating = false;           // sampling at a reduced rate
+    bool asleep = false;                // measurements frozen
+    unsigned full_mah = 0;              // learned full charge capacity, 0 = none
+
+    // Register words as read, for the telemetry log
+    uint16_t raw_voltage = 0;           // VCELL / Voltage()
+    uint16_t raw_soc = 0;               // SOC / StateOfCharge()
+    uint16_t raw_rate = 0;              // CRATE / AverageCurrent()
+};
+
+// SOC clamped to 0-100 as expected by set_capacity.
+int capacity_percent(const Sample &s);
+
+// --- One family's register map behind a common interface ---
+// Instances belong to the bus thread that talks to the chip. Optional
+// features default to -EOPNOTSUPP so the caller can drop them.
+class GaugeChip {
+public:
+    virtual ~GaugeChip() = default;
+
+    virtual ChipType type() const = 0;
+    const char *name() const { return chip_type_name(type()); }
+
+    // Measurements. Returns 0 or -errno.
+    virtual int read_sample(I2cBus &bus, uint16_t addr, Sample *s, SyscallStats *st) = 0;
+
+    // Only the hibernate/sleep flags of *s, for polling a sleeping gauge
+    // without reading measurements it is not taking.
+    virtual int read_power_state(I2cBus &, uint16_t, Sample *s, SyscallStats *) {
+        s->hibernating = s->asleep = false;
+        return 0;
+    }
+
+    // Acknowledge an alert interrupt. *flags receives the chip's status bits
+    // and *reset whether they report a power-on reset.
+    virtual int clear_alert(I2cBus &, uint16_t, uint8_t *flags, bool *reset, SyscallStats *) {
+        *flags = 0;
+        *reset = false;
+        return 0;
+    }
+
+    virtual int write_rcomp(I2cBus &, uint16_t, uint8_t, SyscallStats *) { return -EOPNOTSUPP; }
+    virtual int write_hibrt(I2cBus &, uint16_t, uint16_t, SyscallStats *) { return -EOPNOTSUPP; }
+};
+
+std::unique_ptr<GaugeChip> make_chip(ChipType t);
+
+// Identify the gauge at addr. With a specific type only that family is
+// probed. *id receives the VERSION or DEVICE_TYPE word. Returns nullptr
+// with -errno in *err (-ENODEV for an unknown chip).
+std::unique_ptr<GaugeChip> detect_chip(I2cBus &bus, uint16_t addr, ChipType want, uint16_t *id,
+                                       int *err, SyscallStats *st);
+
+} // namespace battd
+
+#endif // USERSPACE_BATTERYD_GAUGE_H
@@ -0,0 +1,83 @@
+#include "gpio_line.h"
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
+
+namespace battd {
+
+GpioLine::~GpioLine() {
+    if (fd_ >= 0)
+        ::close(fd_);
+}
+
+int GpioLine::open(const std::string &chip, int line, const char *consumer, Edge edge,
+                   bool active_low, bool pull_up) {
+    struct gpio_v2_line_request req;
+    int chip_fd, ret = 0;
+
+    chip_fd = ::open(chip.c_str(), O_RDWR | O_CLOEXEC);
+    if (chip_fd < 0)
+        return -errno;
+
+    memset(&req, 0, sizeof(req));
+    req.offsets[0] = static_cast<__u32>(line);
+    req.num_lines = 1;
+    strncpy(req.consumer, consumer, sizeof(req.consumer) - 1);
+    req.config.flags = GPIO_V2_LINE_FLAG_INPUT | GPIO_V2_LINE_FLAG_EDGE_FALLING;
+    if (edge == Edge::Both)
+        req.config.flags |= GPIO_V2_LINE_FLAG_EDGE_RISING;
+    if (active_low)
+        req.config.flags |= GPIO_V2_LINE_FLAG_ACTIVE_LOW;
+    if (pull_up)
+        req.config.flags |= GPIO_V2_LINE_FLAG_BIAS_PULL_UP;
+
+    if (ioctl(chip_fd, GPIO_V2_GET_LINE_IOCTL, &req) < 0) {
+        ret = -errno;
+    } else {
+        fd_ = req.fd;
+        fcntl(fd_, F_SETFL, fcntl(fd_, F_GETFL) | O_NONBLOCK);
+    }
+    ::close(chip_fd);
+    return ret;
+}
+
+unsigned GpioLine::drain(SyscallStats *st) {
+    struct gpio_v2_line_event ev[8];
+    unsigned count = 0;
+
+    if (fd_ < 0)
+        return 0;
+
+    for (;;) {
+        ssize_t n = read(fd_, ev, sizeof(ev));
+
+        if (st) st->reads++;
+        if (n <= 0)
+            break;
+        count += static_cast<unsigned>(n / sizeof(ev[0]));
+    }
+    return count;
+}
+
+int GpioLine::value(SyscallStats *st) {
+    struct gpio_v2_line_values vals;
+    int ret;
+
+    if (fd_ < 0)
+        return -EBADF;
+
+    vals.bits = 0;
+    vals.mask = 1;
+    ret = ioctl(fd_, GPIO_V2_LINE_GET_VALUES_IOCTL, &vals);
+    if (st) st->ioctls++;
+    if (ret < 0)
+        return -errno;
+    return static_cast<int>(vals.bits & 1);
+}
+
+} // namespace battd
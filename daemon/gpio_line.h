@@ -0,0 +1,45 @@
+#ifndef USERSPACE_BATTERYD_GPIO_LINE_H
+#define USERSPACE_BATTERYD_GPIO_LINE_H
+
+#include <string>
+
+#include "syscall_stats.h"
+
+namespace battd {
+
+// --- Input line with edge events via the GPIO character device ---
+// Used for the gauge's ALRT pin (active-low open drain, falling edges) and
+// for an optional charger-detect input (both edges). The returned line fd
+// is pollable and goes into the daemon's epoll set next to the gauge's
+// timerfd.
+class GpioLine {
+public:
+    enum class Edge {
+        Falling,
+        Both,
+    };
+
+    GpioLine() = default;
+    ~GpioLine();
+
+    GpioLine(const GpioLine &) = delete;
+    GpioLine &operator=(const GpioLine &) = delete;
+
+    // Returns 0 or -errno.
+    int open(const std::string &chip, int line, const char *consumer, Edge edge,
+             bool active_low = false, bool pull_up = false);
+    int fd() const { return fd_; }
+
+    // Consume queued edge events. Returns the number of events read.
+    unsigned drain(SyscallStats *st);
+
+    // Logical line value (active_low applied). Returns 0/1 or -errno.
+    int value(SyscallStats *st);
+
+private:
+    int fd_ = -1;
+};
+
+} // namespace battd
+
+#endif // USERSPACE_BATTERYD_GPIO_LINE_H
@@ -0,0 +1,162 @@
+#include "i2c_bus.h"
+
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+
+namespace battd {
+
+I2cBus::~I2cBus() {
+    close();
+}
+
+int I2cBus::open(SyscallStats *st) {
+    char path[32];
+
+    if (fd_ >= 0)
+        return 0;
+
+    snprintf(path, sizeof(path), "/dev/i2c-%d", bus_);
+    fd_ = ::open(path, O_RDWR | O_CLOEXEC);
+    if (st) st->opens++;
+    if (fd_ < 0)
+        return -errno;
+    return 0;
+}
+
+void I2cBus::close(SyscallStats *st) {
+    if (fd_ < 0)
+        return;
+    ::close(fd_);
+    if (st) st->closes++;
+    fd_ = -1;
+}
+
+int I2cBus::read_regs(uint16_t addr, uint8_t reg, uint8_t *buf, size_t len, SyscallStats *st) {
+    struct i2c_msg msgs[2];
+    struct i2c_rdwr_ioctl_data xfer;
+    int ret;
+
+    if (fd_ < 0) {
+        ret = open(st);
+        if (ret) return ret;
+    }
+
+    msgs[0].addr = addr;
+    msgs[0].flags = 0;
+    msgs[0].len = 1;
+    msgs[0].buf = &reg;
+    msgs[1].addr = addr;
+    msgs[1].flags = I2C_M_RD;
+    msgs[1].len = static_cast<uint16_t>(len);
+    msgs[1].buf = buf;
+
+    xfer.msgs = msgs;
+    xfer.nmsgs = 2;
+
+    ret = ioctl(fd_, I2C_RDWR, &xfer);
+    if (st) st->ioctls++;
+    if (ret < 0)
+        return -errno;
+    if (ret != 2)
+        return -EIO;
+    return 0;
+}
+
+int I2cBus::write_regs(uint16_t addr, uint8_t reg, const uint8_t *buf, size_t len,
+                      SyscallStats *st) {
+    uint8_t out[1 + 32];
+    struct i2c_msg msg;
+    struct i2c_rdwr_ioctl_data xfer;
+    int ret;
+
+    if (len > sizeof(out) - 1)
+        return -EINVAL;
+    if (fd_ < 0) {
+        ret = open(st);
+        if (ret) return ret;
+    }
+
+    out[0] = reg;
+    for (size_t i = 0; i < len; i++)
+        out[1 + i] = buf[i];
+
+    msg.addr = addr;
+    msg.flags = 0;
+    msg.len = static_cast<uint16_t>(len + 1);
+    msg.buf = out;
+
+    xfer.msgs = &msg;
+    xfer.nmsgs = 1;
+
+    ret = ioctl(fd_, I2C_RDWR, &xfer);
+    if (st) st->ioctls++;
+    if (ret < 0)
+        return -errno;
+    if (ret != 1)
+        return -EIO;
+    return 0;
+}
+
+// --- Recovery ---
+
+static int write_file(const std::string &path, const std::string &val, SyscallStats *st) {
+    int fd = ::open(path.c_str(), O_WRONLY | O_CLOEXEC), ret = 0;
+
+    if (st) st->opens++;
+    if (fd < 0)
+        return -errno;
+    if (write(fd, val.data(), val.size()) < 0)
+        ret = -errno;
+    if (st) st->writes++;
+    ::close(fd);
+    if (st) st->closes++;
+    return ret;
+}
+
+// /sys/class/i2c-adapter/i2c-N/device is the controller (e.g.
+// /sys/devices/platform/soc/fe804000.i2c) and its driver link the
+// directory with bind/unbind
+static int rebind_adapter(int bus, SyscallStats *st) {
+    std::string dev = "/sys/class/i2c-adapter/i2c-" + std::to_string(bus) + "/device";
+    char real[PATH_MAX], drv[PATH_MAX];
+    std::string name;
+    int ret;
+
+    if (!realpath(dev.c_str(), real) || !realpath((dev + "/driver").c_str(), drv))
+        return -errno;
+    name = strrchr(real, '/') + 1;
+
+    ret = write_file(std::string(drv) + "/unbind", name, st);
+    if (ret) return ret;
+    return write_file(std::string(drv) + "/bind", name, st);
+}
+
+int I2cBus::recover(bool rebind, SyscallStats *st) {
+    int ret = 0;
+
+    close(st);
+    if (rebind) {
+        ret = rebind_adapter(bus_, st);
+        if (ret) return ret;
+    }
+    // The node comes back asynchronously after a rebind
+    for (int i = 0; i < (rebind ? 20 : 1); i++) {
+        ret = open(st);
+        if (ret != -ENOENT)
+            break;
+        usleep(50000);
+    }
+    return ret;
+}
+
+} // namespace battd
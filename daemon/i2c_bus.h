@@ -0,0 +1,52 @@
+#ifndef USERSPACE_BATTERYD_I2C_BUS_H
+#define USERSPACE_BATTERYD_I2C_BUS_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "syscall_stats.h"
+
+namespace battd {
+
+// --- I2C character device access (/dev/i2c-N) ---
+// Register reads are issued as a single combined I2C_RDWR transaction
+// (write register pointer, repeated start, read N bytes) instead of the
+// byte-at-a-time i2cget calls the shell script uses. The transfer methods
+// are virtual so recovery_bench can put a simulated bus underneath.
+class I2cBus {
+public:
+    explicit I2cBus(int bus) : bus_(bus) {}
+    virtual ~I2cBus();
+
+    I2cBus(const I2cBus &) = delete;
+    I2cBus &operator=(const I2cBus &) = delete;
+
+    // Returns 0 or -errno.
+    int open(SyscallStats *st = nullptr);
+    void close(SyscallStats *st = nullptr);
+
+    // Read len bytes starting at reg. Returns 0 or -errno.
+    virtual int read_regs(uint16_t addr, uint8_t reg, uint8_t *buf, size_t len, SyscallStats *st);
+
+    // Write len bytes starting at reg (register pointer + data in one
+    // message). Returns 0 or -errno.
+    virtual int write_regs(uint16_t addr, uint8_t reg, const uint8_t *buf, size_t len,
+                           SyscallStats *st);
+
+    // Get a wedged bus going again: reopen the device node and, with
+    // rebind, unbind and rebind the adapter's driver so it reinitialises
+    // the controller (and runs its SCL recovery, if it has one). The
+    // latter also resets every other device's transfer on this bus.
+    // Returns 0 once the node opens again, or -errno.
+    virtual int recover(bool rebind, SyscallStats *st);
+
+    int number() const { return bus_; }
+
+private:
+    int bus_;
+    int fd_ = -1;
+};
+
+} // namespace battd
+
+#endif // USERSPACE_BATTERYD_I2C_BUS_H
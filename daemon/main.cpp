@@ -0,0 +1,86 @@
+// userspace_batteryd - poll MAX17048 fuel gauges and feed userspace_battery
+//
+// C++ counterpart of MAX17048.sh. One process serves any number of gauges
+// on any number of I2C buses (see config.h for the file format); without a
+// config file the command line describes a single gauge, like the script.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <getopt.h>
+
+#include "config.h"
+#include "daemon.h"
+
+using namespace battd;
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [-c config] | [-b bus] [-a addr] [-i seconds] [-p platform_path] [-n] [-l log] [-m socket]\n"
+            "          [-s state_dir]\n"
+            "  -c  config file describing one or more gauges\n"
+            "  -b  I2C bus number (default 1)\n"
+            "  -a  gauge I2C address (default 0x36)\n"
+            "  -i  sample interval in seconds (default 10)\n"
+            "  -p  userspace_battery platform device path\n"
+            "  -n  do not write to the kernel module\n"
+            "  -l  binary telemetry log (overrides [log] path; see battlog)\n"
+            "  -m  metrics socket (overrides [metrics] socket)\n"
+            "  -s  directory for cycle count state (overrides [state] dir)\n",
+            prog);
+}
+
+int main(int argc, char **argv) {
+    DaemonConfig cfg;
+    GaugeConfig single;
+    std::string config_path, log_path, metrics_path, state_dir, err;
+    int c, ret;
+
+    single.name = "main";
+
+    while ((c = getopt(argc, argv, "c:b:a:i:p:nl:m:s:h")) != -1) {
+        switch (c) {
+        case 'c': config_path = optarg; break;
+        case 'b': single.bus = atoi(optarg); break;
+        case 'a': single.addr = static_cast<uint16_t>(strtoul(optarg, nullptr, 0)); break;
+        case 'i': single.interval_ms = static_cast<unsigned>(atof(optarg) * 1000.0); break;
+        case 'p': single.battery_path = optarg; break;
+        case 'n': single.ko_write = false; break;
+        case 'l': log_path = optarg; break;
+        case 'm': metrics_path = optarg; break;
+        case 's': state_dir = optarg; break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (!config_path.empty()) {
+        if (!load_config(config_path, &cfg, &err)) {
+            fprintf(stderr, "Error: %s\n", err.c_str());
+            return 1;
+        }
+    } else {
+        if (single.interval_ms < 100) {
+            usage(argv[0]);
+            return 1;
+        }
+        cfg.gauges.push_back(single);
+    }
+    if (!log_path.empty())
+        cfg.log.path = log_path;
+    if (!metrics_path.empty())
+        cfg.metrics_socket = metrics_path;
+    if (!state_dir.empty())
+        cfg.state_dir = state_dir;
+
+    Daemon daemon(cfg);
+    ret = daemon.setup();
+    if (ret) {
+        fprintf(stderr, "Error: setup failed: %s\n", strerror(-ret));
+        return 1;
+    }
+    return daemon.run();
+}
@@ -0,0 +1,184 @@
+#include "max17048.h"
+
+#include <cmath>
+
+namespace battd {
+namespace max17048 {
+
+static int read_word(I2cBus &bus, uint16_t addr, uint8_t reg, uint16_t *val, SyscallStats *st) {
+    uint8_t buf[2];
+    int ret;
+
+    ret = bus.read_regs(addr, reg, buf, sizeof(buf), st);
+    if (ret) return ret;
+
+    *val = static_cast<uint16_t>((buf[0] << 8) | buf[1]);
+    return 0;
+}
+
+// Word at reg inside a block read that started at first
+static uint16_t block_word(const uint8_t *block, uint8_t first, uint8_t reg) {
+    const uint8_t *p = block + (reg - first);
+
+    return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+// MODE high byte and CONFIG low byte -> flags
+static void decode_power_state(uint8_t mode_hi, uint8_t config_lo, Sample *s) {
+    s->hibernating = mode_hi & MODE_HIBSTAT;
+    s->asleep = (mode_hi & MODE_ENSLEEP) && (config_lo & CONFIG_SLEEP);
+}
+
+// --- Family read paths ---
+
+template <typename M>
+class Max1704x final : public GaugeChip {
+    // VCELL up to block_end in one transaction
+    static constexpr size_t BLOCK_LEN = M::block_end - REG_VCELL;
+    static_assert(BLOCK_LEN >= 4 && BLOCK_LEN % 2 == 0, "block must cover VCELL and SOC");
+    static_assert(!M::has_power_state || M::block_end >= REG_CONFIG + 2,
+                  "power state needs MODE and CONFIG in the block");
+
+public:
+    ChipType type() const override { return M::type; }
+
+    int read_sample(I2cBus &bus, uint16_t addr, Sample *s, SyscallStats *st) override {
+        uint8_t block[BLOCK_LEN];
+        uint16_t crate;
+        int ret;
+
+        ret = bus.read_regs(addr, REG_VCELL, block, sizeof(block), st);
+        if (ret) return ret;
+        s->raw_voltage = block_word(block, REG_VCELL, REG_VCELL);
+        s->raw_soc = block_word(block, REG_VCELL, REG_SOC);
+        s->voltage_uv = static_cast<uint64_t>(s->raw_voltage * M::vcell_lsb_uv);
+        s->soc_percent = s->raw_soc * SOC_LSB_PERCENT;
+        if constexpr (M::has_power_state)
+            decode_power_state(block[REG_MODE - REG_VCELL], block[REG_CONFIG + 1 - REG_VCELL], s);
+
+        if constexpr (M::has_crate) {
+            // Best-effort, like TEMP in the script
+            s->crate_valid = read_word(bus, addr, REG_CRATE, &crate, st) == 0;
+            if (s->crate_valid) {
+                s->raw_rate = crate;
+                s->crate_pct_per_hour = static_cast<int16_t>(crate) * CRATE_LSB_PCT_PER_HOUR;
+            }
+        }
+        return 0;
+    }
+
+    int read_power_state(I2cBus &bus, uint16_t addr, Sample *s, SyscallStats *st) override {
+        if constexpr (M::has_power_state) {
+            uint8_t block[REG_CONFIG + 2 - REG_MODE];   // MODE, VERSION, HIBRT, CONFIG
+            int ret;
+
+            ret = bus.read_regs(addr, REG_MODE, block, sizeof(block), st);
+            if (ret) return ret;
+            decode_power_state(block[0], block[REG_CONFIG + 1 - REG_MODE], s);
+            return 0;
+        } else {
+            return GaugeChip::read_power_state(bus, addr, s, st);
+        }
+    }
+
+    // Clear the STATUS flags and CONFIG.ALRT so the open-drain line is released
+    int clear_alert(I2cBus &bus, uint16_t addr, uint8_t *flags, bool *reset,
+                    SyscallStats *st) override {
+        uint8_t status[2] = {}, config[2];
+        int ret;
+
+        if constexpr (M::has_status) {
+            ret = bus.read_regs(addr, REG_STATUS, status, sizeof(status), st);
+            if (ret) return ret;
+        }
+        ret = bus.read_regs(addr, REG_CONFIG, config, sizeof(config), st);
+        if (ret) return ret;
+
+        *flags = status[0] & STATUS_FLAGS;
+        *reset = status[0] & STATUS_RI;
+
+        if (status[0] & STATUS_FLAGS) {
+            status[0] &= static_cast<uint8_t>(~STATUS_FLAGS);
+            ret = bus.write_regs(addr, REG_STATUS, status, sizeof(status), st);
+            if (ret) return ret;
+        }
+        if (config[1] & CONFIG_ALRT) {
+            config[1] &= static_cast<uint8_t>(~CONFIG_ALRT);
+            ret = bus.write_regs(addr, REG_CONFIG, config, sizeof(config), st);
+            if (ret) return ret;
+        }
+        return 0;
+    }
+
+    // Replace CONFIG.RCOMP, keeping the alert/sleep settings in the low byte
+    int write_rcomp(I2cBus &bus, uint16_t addr, uint8_t rcomp, SyscallStats *st) override {
+        uint8_t config[2];
+        int ret;
+
+        ret = bus.read_regs(addr, REG_CONFIG, config, sizeof(config), st);
+        if (ret) return ret;
+        if (config[0] == rcomp)
+            return 0;
+        config[0] = rcomp;
+        return bus.write_regs(addr, REG_CONFIG, config, sizeof(config), st);
+    }
+
+    int write_hibrt(I2cBus &bus, uint16_t addr, uint16_t hibrt, SyscallStats *st) override {
+        if constexpr (M::has_power_state) {
+            uint8_t buf[2] = { static_cast<uint8_t>(hibrt >> 8), static_cast<uint8_t>(hibrt) };
+
+            return bus.write_regs(addr, REG_HIBRT, buf, sizeof(buf), st);
+        } else {
+            return GaugeChip::write_hibrt(bus, addr, hibrt, st);
+        }
+    }
+};
+
+bool version_type(uint16_t version, ChipType *t) {
+    if ((version & 0xFFF0) == 0x0010)
+        *t = ChipType::Max17048;
+    else if (version && (version & 0xFFF0) == 0x0000)
+        *t = ChipType::Max17043;
+    else
+        return false;
+    return true;
+}
+
+int read_version(I2cBus &bus, uint16_t addr, uint16_t *version, SyscallStats *st) {
+    return read_word(bus, addr, REG_VERSION, version, st);
+}
+
+std::unique_ptr<GaugeChip> make_chip(ChipType t) {
+    switch (t) {
+    case ChipType::Max17043: return std::unique_ptr<GaugeChip>(new Max1704x<Max17043Model>());
+    case ChipType::Max17048: return std::unique_ptr<GaugeChip>(new Max1704x<Max17048Model>());
+    case ChipType::Max17049: return std::unique_ptr<GaugeChip>(new Max1704x<Max17049Model>());
+    default: return nullptr;
+    }
+}
+
+double rcomp_for_temp(double temp_c, const RcompParams &p) {
+    double dt = temp_c - 20.0;
+
+    return p.rcomp0 + dt * (dt > 0.0 ? p.tempco_up : p.tempco_down);
+}
+
+uint8_t rcomp_register(double rcomp) {
+    long v = lround(rcomp);
+
+    if (v < 0) v = 0;
+    if (v > 0xFF) v = 0xFF;
+    return static_cast<uint8_t>(v);
+}
+
+uint16_t hibrt_word(double hib_pct_per_hour, double act_mv) {
+    long hib = lround(hib_pct_per_hour / HIBRT_HIB_LSB_PCT_PER_HOUR);
+    long act = lround(act_mv / HIBRT_ACT_LSB_MV);
+
+    hib = hib < 0 ? 0 : (hib > 0xFF ? 0xFF : hib);
+    act = act < 0 ? 0 : (act > 0xFF ? 0xFF : act);
+    return static_cast<uint16_t>((hib << 8) | act);
+}
+
+} // namespace max17048
+} // namespace battd
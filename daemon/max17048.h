@@ -0,0 +1,114 @@
+#ifndef USERSPACE_BATTERYD_MAX17048_H
+#define USERSPACE_BATTERYD_MAX17048_H
+
+#include <cstdint>
+#include <memory>
+
+#include "gauge.h"
+#include "i2c_bus.h"
+#include "syscall_stats.h"
+
+namespace battd {
+namespace max17048 {
+
+// --- Register Addresses (16-bit, MSB first) ---
+constexpr uint8_t REG_VCELL = 0x02;
+constexpr uint8_t REG_SOC = 0x04;
+constexpr uint8_t REG_MODE = 0x06;
+constexpr uint8_t REG_VERSION = 0x08;
+constexpr uint8_t REG_HIBRT = 0x0A;
+constexpr uint8_t REG_CONFIG = 0x0C;
+constexpr uint8_t REG_CRATE = 0x16;
+constexpr uint8_t REG_STATUS = 0x1A;
+
+// CONFIG low byte
+constexpr uint8_t CONFIG_ALRT = 0x20;
+constexpr uint8_t CONFIG_SLEEP = 0x80;  // forces sleep when MODE.EnSleep is set
+
+// MODE high byte
+constexpr uint8_t MODE_HIBSTAT = 0x10;  // read-only: hibernating
+constexpr uint8_t MODE_ENSLEEP = 0x20;  // sleep allowed
+
+// HIBRT: high byte HibThr (|CRATE| below it for 6 min enters hibernate),
+// low byte ActThr (|OCV - VCELL| above it leaves). 0x0000 disables
+// hibernation, 0xFFFF forces it.
+constexpr double HIBRT_HIB_LSB_PCT_PER_HOUR = 0.208;
+constexpr double HIBRT_ACT_LSB_MV = 1.25;
+
+// STATUS high byte alert flags (EnVR, bit 6, is a setting and is preserved)
+constexpr uint8_t STATUS_RI = 0x01;  // reset indicator
+constexpr uint8_t STATUS_VH = 0x02;  // voltage high
+constexpr uint8_t STATUS_VL = 0x04;  // voltage low
+constexpr uint8_t STATUS_VR = 0x08;  // voltage reset
+constexpr uint8_t STATUS_HD = 0x10;  // SOC low (HD)
+constexpr uint8_t STATUS_SC = 0x20;  // SOC changed by 1%
+constexpr uint8_t STATUS_FLAGS = STATUS_RI | STATUS_VH | STATUS_VL | STATUS_VR | STATUS_HD | STATUS_SC;
+
+constexpr uint16_t DEFAULT_ADDR = 0x36;
+
+// --- Scaling Factors ---
+constexpr double VCELL_LSB_UV = 78.125;         // per cell
+constexpr double SOC_LSB_PERCENT = 1.0 / 256.0;
+constexpr double CRATE_LSB_PCT_PER_HOUR = 0.208; // signed
+
+// --- Family members ---
+// Each gets its own read path at compile time. VCELL through CONFIG
+// (0x02-0x0D) are contiguous on the MAX17048/49, so one transaction returns
+// the measurements together with the power state; the MAX17043 leaves 0x0A
+// undefined and MODE write-only, so it reads just VCELL and SOC.
+struct Max17043Model {
+    static constexpr ChipType type = ChipType::Max17043;
+    static constexpr double vcell_lsb_uv = VCELL_LSB_UV;   // 1.25 mV in bits 15:4
+    static constexpr uint8_t block_end = REG_MODE;
+    static constexpr bool has_crate = false;
+    static constexpr bool has_power_state = false;          // no HibStat/EnSleep/HIBRT
+    static constexpr bool has_status = false;               // ALRT only in CONFIG
+};
+
+struct Max17048Model {
+    static constexpr ChipType type = ChipType::Max17048;
+    static constexpr double vcell_lsb_uv = VCELL_LSB_UV;
+    static constexpr uint8_t block_end = REG_CONFIG + 2;
+    static constexpr bool has_crate = true;
+    static constexpr bool has_power_state = true;
+    static constexpr bool has_status = true;
+};
+
+// Two cells in series behind the same register map
+struct Max17049Model : Max17048Model {
+    static constexpr ChipType type = ChipType::Max17049;
+    static constexpr double vcell_lsb_uv = 2 * VCELL_LSB_UV;
+};
+
+// VERSION -> family member. 0x001X is a MAX17048 or MAX17049 (the chip
+// does not say which), 0x000X a MAX17043/44. Returns false otherwise.
+bool version_type(uint16_t version, ChipType *t);
+
+// Read VERSION. Returns 0 or -errno.
+int read_version(I2cBus &bus, uint16_t addr, uint16_t *version, SyscallStats *st);
+
+// nullptr unless t is a MAX1704x type
+std::unique_ptr<GaugeChip> make_chip(ChipType t);
+
+// HIBRT word from thresholds in %/h and mV, rounded and clamped per byte.
+uint16_t hibrt_word(double hib_pct_per_hour, double act_mv);
+
+// --- RCOMP temperature compensation (CONFIG high byte) ---
+// Datasheet defaults; a characterised cell model supplies its own.
+struct RcompParams {
+    double rcomp0 = 0x97;       // RCOMP at 20 °C
+    double tempco_up = -0.5;    // per °C above 20 °C
+    double tempco_down = -5.0;  // per °C below 20 °C
+};
+
+// RCOMP = RCOMP0 + (T - 20) * TempCoUp (T > 20) or TempCoDown (T < 20),
+// before rounding, so callers can apply hysteresis on the exact value.
+double rcomp_for_temp(double temp_c, const RcompParams &p);
+
+// Rounded and clamped to the 8-bit register field.
+uint8_t rcomp_register(double rcomp);
+
+} // namespace max17048
+} // namespace battd
+
+#endif // USERSPACE_BATTERYD_MAX17048_H
@@ -0,0 +1,135 @@
+#include "metrics.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+namespace battd {
+
+// --- Histogram ---
+
+void Histogram::observe(double v) {
+    for (size_t i = 0; i < NUM_BOUNDS; i++) {
+        if (v <= BOUNDS[i]) {
+            buckets_[i]++;
+            break;
+        }
+    }
+    count_++;
+    sum_ += v;
+}
+
+void Histogram::render(std::string *out, const char *name, const std::string &labels) const {
+    std::string bucket = std::string(name) + "_bucket";
+    std::string sep = labels.empty() ? "" : labels + ",";
+    uint64_t cum = 0;
+    char le[32];
+
+    for (size_t i = 0; i < NUM_BOUNDS; i++) {
+        cum += buckets_[i];
+        snprintf(le, sizeof(le), "le=\"%g\"", BOUNDS[i]);
+        metric_value(out, bucket.c_str(), sep + le, static_cast<double>(cum));
+    }
+    metric_value(out, bucket.c_str(), sep + "le=\"+Inf\"", static_cast<double>(count_));
+    metric_value(out, (std::string(name) + "_sum").c_str(), labels, sum_);
+    metric_value(out, (std::string(name) + "_count").c_str(), labels, static_cast<double>(count_));
+}
+
+// --- Text format ---
+
+void metric_header(std::string *out, const char *name, const char *type, const char *help) {
+    *out += "# HELP ";
+    *out += name;
+    *out += ' ';
+    *out += help;
+    *out += "\n# TYPE ";
+    *out += name;
+    *out += ' ';
+    *out += type;
+    *out += '\n';
+}
+
+void metric_value(std::string *out, const char *name, const std::string &labels, double v) {
+    char buf[32];
+
+    *out += name;
+    if (!labels.empty()) {
+        *out += '{';
+        *out += labels;
+        *out += '}';
+    }
+    snprintf(buf, sizeof(buf), " %.12g\n", v);
+    *out += buf;
+}
+
+std::string metric_label(const char *name, const std::string &value) {
+    std::string out = name;
+
+    out += "=\"";
+    for (char c : value) {
+        if (c == '\\' || c == '"')
+            out += '\\';
+        if (c == '\n') {
+            out += "\\n";
+            continue;
+        }
+        out += c;
+    }
+    out += '"';
+    return out;
+}
+
+// --- MetricsServer ---
+
+MetricsServer::~MetricsServer() {
+    if (fd_ >= 0) {
+        close(fd_);
+        unlink(path_.c_str());
+    }
+}
+
+int MetricsServer::open() {
+    struct sockaddr_un sa = {};
+
+    if (path_.size() >= sizeof(sa.sun_path))
+        return -ENAMETOOLONG;
+    sa.sun_family = AF_UNIX;
+    memcpy(sa.sun_path, path_.c_str(), path_.size());
+
+    fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd_ < 0)
+        return -errno;
+    // Left behind by an earlier instance that did not exit cleanly
+    unlink(path_.c_str());
+    if (bind(fd_, reinterpret_cast<struct sockaddr *>(&sa), sizeof(sa)) < 0 ||
+        chmod(path_.c_str(), mode_) < 0 || listen(fd_, 8) < 0) {
+        int ret = -errno;
+
+        close(fd_);
+        fd_ = -1;
+        return ret;
+    }
+    return 0;
+}
+
+unsigned MetricsServer::serve(const std::string &body) {
+    unsigned served = 0;
+    int c;
+
+    while ((c = accept4(fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+        // A fresh socket buffer holds far more than one response; a client
+        // that cannot take it all gets a truncated one rather than stalling
+        // the loop
+        if (send(c, body.data(), body.size(), MSG_NOSIGNAL) >= 0)
+            served++;
+        close(c);
+    }
+    return served;
+}
+
+} // namespace battd
@@ -0,0 +1,100 @@
+#ifndef USERSPACE_BATTERYD_METRICS_H
+#define USERSPACE_BATTERYD_METRICS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include "bus_recovery.h"
+
+namespace battd {
+
+// --- Cumulative histogram (Prometheus semantics) ---
+class Histogram {
+public:
+    // Upper bounds in seconds, shared by every latency histogram
+    static constexpr double BOUNDS[] = { 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1,
+                                         0.25, 0.5, 1.0 };
+    static constexpr size_t NUM_BOUNDS = sizeof(BOUNDS) / sizeof(BOUNDS[0]);
+
+    void observe(double v);
+
+    // _bucket/_sum/_count lines for name{labels}
+    void render(std::string *out, const char *name, const std::string &labels) const;
+
+private:
+    uint64_t buckets_[NUM_BOUNDS] = {};  // non-cumulative; summed on render
+    uint64_t count_ = 0;
+    double sum_ = 0.0;
+};
+
+// --- Per-gauge counters kept by the epoll loop ---
+struct GaugeMetrics {
+    uint64_t samples = 0;           // results received
+    uint64_t missed_ticks = 0;      // schedule ticks a slow sample ran into
+    uint64_t published = 0;
+    uint64_t publish_errors = 0;
+    std::map<int, uint64_t> read_errors;   // by errno
+    uint64_t i2c_errors[I2C_ERROR_CLASSES] = {};    // every failed attempt
+    uint64_t retries = 0;
+    uint64_t bus_recoveries = 0;
+    uint64_t bus_recovery_errors = 0;
+    Histogram recovery;             // reopen/rebind duration
+    uint64_t i2c_transactions = 0;
+    uint64_t syscalls = 0;
+    double bus_seconds = 0.0;       // bus thread time, start -> done
+    Histogram latency;              // queued -> done
+    int64_t last_sample_wall_ns = 0;
+};
+
+// --- Per pipeline stage, also kept by the loop ---
+struct StageMetrics {
+    Histogram latency;              // entered the stage's queue -> left the stage
+    uint64_t dropped = 0;           // lost to a full queue
+};
+
+// --- Per output sink, kept by the loop ---
+struct SinkMetrics {
+    uint64_t queued = 0;
+    uint64_t filtered = 0;          // held back by the change filter or rate limit
+    uint64_t dropped = 0;           // lost to a full queue
+    uint64_t errors = 0;            // written but failed
+    Histogram latency;              // queued -> written
+};
+
+// Append "# HELP"/"# TYPE" for a metric family
+void metric_header(std::string *out, const char *name, const char *type, const char *help);
+// Append name{labels} value
+void metric_value(std::string *out, const char *name, const std::string &labels, double v);
+
+// label="value" with the exposition format's escaping
+std::string metric_label(const char *name, const std::string &value);
+
+// --- Unix socket endpoint ---
+// Every connection gets the current text and is closed, so a scrape is
+// `socat - UNIX-CONNECT:path` and never waits on the bus threads.
+class MetricsServer {
+public:
+    explicit MetricsServer(std::string path, unsigned mode) : path_(std::move(path)), mode_(mode) {}
+    ~MetricsServer();
+
+    MetricsServer(const MetricsServer &) = delete;
+    MetricsServer &operator=(const MetricsServer &) = delete;
+
+    // Replace a stale socket and listen. Returns 0 or -errno.
+    int open();
+    int fd() const { return fd_; }
+
+    // Answer every pending connection with body. Returns the number served.
+    unsigned serve(const std::string &body);
+
+private:
+    std::string path_;
+    unsigned mode_;
+    int fd_ = -1;
+};
+
+} // namespace battd
+
+#endif // USERSPACE_BATTERYD_METRICS_H
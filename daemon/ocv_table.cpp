@@ -0,0 +1,62 @@
+#include "ocv_table.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include "../userspace_battery.h"
+
+namespace battd {
+
+bool load_ocv_table(const std::string &path, std::vector<uint8_t> *blob, std::string *err) {
+    std::ifstream in(path);
+    std::vector<userspace_batt_ocv_entry> entries;
+    std::string line;
+    unsigned lineno = 0;
+
+    if (!in) {
+        *err = path + ": cannot open";
+        return false;
+    }
+
+    while (std::getline(in, line)) {
+        userspace_batt_ocv_entry e = {};
+        int temp_c;
+        unsigned long ocv_uv, capacity;
+        char tail;
+
+        lineno++;
+        line.erase(0, line.find_first_not_of(" \t"));
+        if (line.empty() || line[0] == '#' || line[0] == '\r')
+            continue;
+
+        if (sscanf(line.c_str(), "%d , %lu , %lu %c", &temp_c, &ocv_uv, &capacity, &tail) != 3 ||
+            ocv_uv == 0 || ocv_uv > UINT32_MAX || capacity > 100) {
+            *err = path + ":" + std::to_string(lineno) + ": expected temp_c,ocv_uv,capacity(0-100)";
+            return false;
+        }
+        e.temp_c = temp_c;
+        e.ocv_uv = static_cast<uint32_t>(ocv_uv);
+        e.capacity = static_cast<uint32_t>(capacity);
+        entries.push_back(e);
+    }
+
+    if (entries.size() < 2 ||
+        entries.size() > USERSPACE_BATT_OCV_MAX_TEMPS * USERSPACE_BATT_OCV_MAX_POINTS) {
+        *err = path + ": need 2.." +
+               std::to_string(USERSPACE_BATT_OCV_MAX_TEMPS * USERSPACE_BATT_OCV_MAX_POINTS) + " points";
+        return false;
+    }
+
+    userspace_batt_ocv_hdr hdr = {};
+    hdr.magic = USERSPACE_BATT_OCV_MAGIC;
+    hdr.version = USERSPACE_BATT_OCV_VERSION;
+    hdr.num_entries = static_cast<uint32_t>(entries.size());
+
+    blob->resize(sizeof(hdr) + entries.size() * sizeof(entries[0]));
+    memcpy(blob->data(), &hdr, sizeof(hdr));
+    memcpy(blob->data() + sizeof(hdr), entries.data(), entries.size() * sizeof(entries[0]));
+    return true;
+}
+
+} // namespace battd
@@ -0,0 +1,26 @@
+#ifndef USERSPACE_BATTERYD_OCV_TABLE_H
+#define USERSPACE_BATTERYD_OCV_TABLE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace battd {
+
+// --- OCV table loader ---
+// Reads a characterisation CSV, one point per line:
+//
+//   # temp_c,ocv_uv,capacity
+//   25,3300000,0
+//   25,3680000,20
+//   ...
+//
+// and encodes it as the module's ocv_table binary attribute (header plus
+// entries, see userspace_battery.h). Only the shape the module can accept
+// is checked here (count, ranges); curve ordering is validated in-kernel.
+// Returns true on success, otherwise false with a message in *err.
+bool load_ocv_table(const std::string &path, std::vector<uint8_t> *blob, std::string *err);
+
+} // namespace battd
+
+#endif // USERSPACE_BATTERYD_OCV_TABLE_H
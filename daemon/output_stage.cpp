@@ -0,0 +1,86 @@
+#include "output_stage.h"
+
+#include <cerrno>
+
+#include "bus_worker.h"
+
+namespace battd {
+
+OutputStage::OutputStage(std::unique_ptr<Sink> sink, const SinkFilterConfig &filter,
+                         size_t num_gauges, Doorbell *done)
+    : sink_(std::move(sink)), filters_(num_gauges, SinkFilter(filter)), done_(done) {}
+
+OutputStage::~OutputStage() {
+    stop();
+}
+
+int OutputStage::start() {
+    if (wake_.fd() < 0)
+        return -EMFILE;
+    thread_ = std::thread(&OutputStage::run, this);
+    return 0;
+}
+
+void OutputStage::stop() {
+    stopping_.store(true, std::memory_order_release);
+    wake_.ring();
+    if (thread_.joinable())
+        thread_.join();
+}
+
+bool OutputStage::offer(const OutputItem &it, int64_t now_ns) {
+    bool sample = it.kind == OutputItem::SAMPLE;
+
+    if (!(sink_->kinds() & (1u << it.kind)))
+        return false;
+    if (sample && it.gauge < filters_.size() && !filters_[it.gauge].wants(it, now_ns)) {
+        metrics_.filtered++;
+        return false;
+    }
+    if (in_flight_ == RING_SIZE || !items_.try_push(it)) {
+        metrics_.dropped++;
+        return false;
+    }
+    wake_.ring();
+    in_flight_++;
+    metrics_.queued++;
+    if (sample && it.gauge < filters_.size())
+        filters_[it.gauge].sent(it, now_ns);
+    return true;
+}
+
+bool OutputStage::pop_done(OutputDone *d) {
+    if (!done_ring_.try_pop(d))
+        return false;
+    in_flight_--;
+    return true;
+}
+
+void OutputStage::run() {
+    for (;;) {
+        // Read before draining: everything pushed before stop() is written
+        bool stop = stopping_.load(std::memory_order_acquire);
+        OutputItem it;
+
+        while (items_.try_pop(&it)) {
+            OutputDone d;
+
+            d.kind = it.kind;
+            d.gauge = it.gauge;
+            d.queued_ns = it.queued_ns;
+            sink_->write(it, &d);
+            d.done_ns = monotonic_ns();
+            // Cannot fail: offer() keeps at most RING_SIZE items between
+            // items_ and done_ring_, and the loop needs every completion
+            // for error reports, publish counts and the module's seq
+            done_ring_.try_push(d);
+            done_->ring();
+        }
+        sink_->flush();
+        if (stop)
+            return;
+        wake_.wait(-1);
+    }
+}
+
+} // namespace battd
@@ -0,0 +1,119 @@
+#ifndef USERSPACE_BATTERYD_OUTPUT_STAGE_H
+#define USERSPACE_BATTERYD_OUTPUT_STAGE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "metrics.h"
+#include "sink_filter.h"
+#include "spsc_ring.h"
+#include "sysfs_publisher.h"
+#include "telemetry_log.h"
+
+namespace battd {
+
+// epoll loop -> sinks
+struct OutputItem {
+    enum Kind : uint8_t {
+        LINE,           // text to stdout (stderr if error)
+        SAMPLE,         // a classified sample: update, rec and the console row in text
+        ONLINE,         // external power state changed
+        STALE,          // the gauge stopped answering
+        INVALIDATE,     // the module went away or came back
+    };
+
+    Kind kind = LINE;
+    bool error = false;
+    size_t gauge = 0;
+    int online = 0;
+    char text[192] = "";
+    BatteryUpdate update;
+    TelemetryRecord rec = {};
+    int64_t queued_ns = 0;
+};
+
+// sink -> epoll loop, for the metrics and error reports
+struct OutputDone {
+    OutputItem::Kind kind = OutputItem::LINE;
+    size_t gauge = 0;
+    int err = 0;                // 0 or -errno from the sink
+    unsigned syscalls = 0;      // spent by the sink on this item
+    bool have_seq = false;
+    uint64_t seq = 0;           // sysfs: the module's seq, re-read after a publish
+    uint64_t log_dropped = 0;   // log: records lost to write errors so far
+    int64_t queued_ns = 0;
+    int64_t done_ns = 0;
+};
+
+// --- Output sink ---
+// One destination for what the loop produces. write() runs on the sink's
+// own thread and may block, which only ever delays this sink.
+class Sink {
+public:
+    virtual ~Sink() = default;
+
+    virtual const char *name() const = 0;
+    // Bit (1 << OutputItem::Kind) for every kind the sink takes
+    virtual unsigned kinds() const = 0;
+    virtual void write(OutputItem &it, OutputDone *d) = 0;
+    // After each batch
+    virtual void flush() {}
+};
+
+// --- Output stage ---
+// A sink with its own thread, fed by the loop through an SPSC ring. Samples
+// pass the sink's change filter first; when RING_SIZE items are in flight
+// (queued, or written but their completion not yet popped) the item is
+// dropped and counted rather than waited for. That bound keeps the
+// completion ring from ever filling, so no OutputDone is lost.
+class OutputStage {
+public:
+    static constexpr size_t RING_SIZE = 256;
+
+    // done is rung after every item handled
+    OutputStage(std::unique_ptr<Sink> sink, const SinkFilterConfig &filter, size_t num_gauges,
+                Doorbell *done);
+    ~OutputStage();
+
+    OutputStage(const OutputStage &) = delete;
+    OutputStage &operator=(const OutputStage &) = delete;
+
+    // Returns 0 or -errno.
+    int start();
+    // Write out what is queued, then join.
+    void stop();
+
+    // Loop thread only. Queue it if the sink takes it and, for a sample,
+    // its filter lets it through. Returns true if queued.
+    bool offer(const OutputItem &it, int64_t now_ns);
+    bool pop_done(OutputDone *d);
+
+    const char *name() const { return sink_->name(); }
+    size_t backlog() const { return items_.depth(); }
+    size_t high_water() const { return items_.high_water(); }
+    // Loop thread only
+    SinkMetrics &metrics() { return metrics_; }
+    const SinkMetrics &metrics() const { return metrics_; }
+
+private:
+    void run();
+
+    std::unique_ptr<Sink> sink_;
+    std::vector<SinkFilter> filters_;  // per gauge, loop thread only
+    SinkMetrics metrics_;
+    size_t in_flight_ = 0;             // loop thread: offered, completion not popped
+    Doorbell *done_;
+    Doorbell wake_;
+    SpscRing<OutputItem, RING_SIZE> items_;
+    SpscRing<OutputDone, RING_SIZE> done_ring_;
+    std::atomic<bool> stopping_{false};
+    std::thread thread_;
+};
+
+} // namespace battd
+
+#endif // USERSPACE_BATTERYD_OUTPUT_STAGE_H
@@ -0,0 +1,295 @@
+// recovery_bench - measure I2C error recovery against a simulated bus
+//
+// Runs the daemon's sample path (BusGuard around the MAX17048 read) on a
+// simulated MAX17048 in real time and injects one fault per scenario:
+//   nack_glitch  the gauge NACKs briefly (mid-conversion, EMI)
+//   nack_burst   the gauge NACKs for a while (brown-out) and comes back
+//   stuck_bus    a slave holds SDA low: every transfer times out until the
+//                adapter driver is rebound and clocks the bus free
+//   adapter_gone the adapter is removed and probed again: the open fd keeps
+//                failing with ENODEV until the node is reopened
+// Each scenario runs under each recovery policy, from plain "give up on the
+// sample" to retries with a rebind, and reports per policy:
+//   - recovery time: first failed sample -> first good sample after it
+//   - lost samples and retries spent
+//   - bus recoveries (reopens or rebinds) and the time they took
+//
+// The sampling interval and fault durations are scaled down (--interval,
+// default 10 ms) so a run takes seconds; the ratios are what matter.
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <getopt.h>
+
+#include "bus_recovery.h"
+#include "bus_worker.h"
+#include "max17048.h"
+
+using namespace battd;
+
+// --- Simulated adapter with one MAX17048 ---
+
+enum class Fault { None, Nack, Stuck, Gone };
+
+class SimBus : public I2cBus {
+public:
+    SimBus() : I2cBus(-1) {
+        set_word(max17048::REG_VCELL, 0xC800);      // 3.9 V
+        set_word(max17048::REG_SOC, 0x4B00);        // 75 %
+        set_word(max17048::REG_MODE, 0x0000);
+        set_word(max17048::REG_VERSION, 0x0012);
+        set_word(max17048::REG_HIBRT, 0x8030);
+        set_word(max17048::REG_CONFIG, 0x971C);
+        set_word(max17048::REG_CRATE, 0xFFF0);
+        set_word(max17048::REG_STATUS, 0x0000);
+    }
+
+    // Fault from now until until_ns (Nack) or until the matching recovery;
+    // for Gone the node only reappears at until_ns.
+    void inject(Fault f, int64_t until_ns) {
+        fault_ = f;
+        until_ns_ = until_ns;
+        stale_fd_ = f == Fault::Gone;
+    }
+
+    int read_regs(uint16_t, uint8_t reg, uint8_t *buf, size_t len, SyscallStats *st) override {
+        int ret = transfer(st);
+
+        if (ret) return ret;
+        for (size_t i = 0; i < len; i++)
+            buf[i] = regs_[(reg + i) & 0xFF];
+        return 0;
+    }
+
+    int write_regs(uint16_t, uint8_t reg, const uint8_t *buf, size_t len, SyscallStats *st) override {
+        int ret = transfer(st);
+
+        if (ret) return ret;
+        for (size_t i = 0; i < len; i++)
+            regs_[(reg + i) & 0xFF] = buf[i];
+        return 0;
+    }
+
+    // Reopen is cheap; a rebind re-probes the controller, which on real
+    // adapters takes tens of milliseconds
+    int recover(bool rebind, SyscallStats *) override {
+        std::this_thread::sleep_for(std::chrono::microseconds(rebind ? 20000 : 100));
+        if (fault_ == Fault::Gone) {
+            if (monotonic_ns() < until_ns_)
+                return -ENOENT;
+            stale_fd_ = false;
+            fault_ = Fault::None;
+        }
+        if (fault_ == Fault::Stuck && rebind)
+            fault_ = Fault::None;
+        return 0;
+    }
+
+    unsigned transfers() const { return transfers_; }
+
+private:
+    void set_word(uint8_t reg, uint16_t v) {
+        regs_[reg] = static_cast<uint8_t>(v >> 8);
+        regs_[reg + 1] = static_cast<uint8_t>(v);
+    }
+
+    int transfer(SyscallStats *st) {
+        transfers_++;
+        if (st) st->ioctls++;
+        if (stale_fd_)
+            return -ENODEV;
+        switch (fault_) {
+        case Fault::Nack:
+            if (monotonic_ns() >= until_ns_) {
+                fault_ = Fault::None;
+                return 0;
+            }
+            return -ENXIO;
+        case Fault::Stuck:
+            // The adapter's own timeout, scaled like everything else
+            std::this_thread::sleep_for(std::chrono::microseconds(1000));
+            return -ETIMEDOUT;
+        default:
+            return 0;
+        }
+    }
+
+    uint8_t regs_[256] = {};
+    Fault fault_ = Fault::None;
+    int64_t until_ns_ = 0;
+    bool stale_fd_ = false;
+    unsigned transfers_ = 0;
+};
+
+// --- Scenarios and policies ---
+
+struct Scenario {
+    const char *name;
+    Fault fault;
+    double duration;    // in sampling intervals (Nack: fault, Gone: until re-added)
+};
+
+struct Policy {
+    const char *name;
+    RecoveryPolicy p;
+};
+
+struct Result {
+    bool failed = false;        // at least one sample lost
+    bool recovered = false;     // a good sample followed
+    double recovery_ms = 0.0;
+    unsigned lost = 0;
+    unsigned retries = 0;
+    unsigned recoveries = 0;
+    double recovery_cost_ms = 0.0;
+    unsigned transfers = 0;
+};
+
+// Sample every interval_ns like the daemon's timer, skipping ticks a slow
+// sample ran into. The fault is injected just before sample fault_at.
+static Result run(const Scenario &sc, const Policy &pol, int64_t interval_ns, unsigned samples,
+                  unsigned fault_at) {
+    SimBus bus;
+    BusGuard guard(bus);
+    std::unique_ptr<GaugeChip> chip = max17048::make_chip(ChipType::Max17048);
+    RecoveryPolicy p = pol.p;
+    Result res;
+    int64_t start = monotonic_ns(), tick = start, first_fail = 0;
+
+    p.deadline_ms = std::min<unsigned>(p.deadline_ms, static_cast<unsigned>(interval_ns / 1000000));
+
+    for (unsigned i = 0; i < samples; i++) {
+        RecoveryStats rs;
+        Sample s;
+        int64_t now = monotonic_ns();
+        int ret;
+
+        if (tick > now)
+            std::this_thread::sleep_for(std::chrono::nanoseconds(tick - now));
+        if (i == fault_at)
+            bus.inject(sc.fault, tick + static_cast<int64_t>(sc.duration * interval_ns));
+
+        ret = guard.run(p, tick + static_cast<int64_t>(p.deadline_ms) * 1000000,
+                        [&]() { return chip->read_sample(bus, max17048::DEFAULT_ADDR, &s, nullptr); },
+                        &rs, nullptr);
+        res.retries += rs.retries;
+        if (rs.recovered) {
+            res.recoveries++;
+            res.recovery_cost_ms += rs.recovery_ns / 1e6;
+        }
+        if (ret) {
+            if (!res.failed)
+                first_fail = tick;
+            res.failed = true;
+            res.lost++;
+        } else if (res.failed && !res.recovered) {
+            res.recovered = true;
+            res.recovery_ms = (monotonic_ns() - first_fail) / 1e6;
+        }
+
+        now = monotonic_ns();
+        do
+            tick += interval_ns;
+        while (tick <= now - interval_ns);
+    }
+    res.transfers = bus.transfers();
+    return res;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [--interval MS] [--samples N] [--runs N]\n", prog);
+}
+
+int main(int argc, char **argv) {
+    static const struct option longopts[] = {
+        { "interval", required_argument, nullptr, 'i' },
+        { "samples", required_argument, nullptr, 'n' },
+        { "runs", required_argument, nullptr, 'r' },
+        { "help", no_argument, nullptr, 'h' },
+        { nullptr, 0, nullptr, 0 },
+    };
+    static const Scenario scenarios[] = {
+        { "nack_glitch", Fault::Nack, 0.15 },
+        { "nack_burst", Fault::Nack, 1.5 },
+        { "stuck_bus", Fault::Stuck, 0.0 },
+        { "adapter_gone", Fault::Gone, 2.5 },
+    };
+    std::vector<Policy> policies(4);
+    double interval_ms = 10.0;
+    unsigned samples = 25, runs = 3;
+    int c;
+
+    policies[0].name = "none";
+    policies[0].p.retries = 0;
+    policies[0].p.recover_after = 0;
+    policies[1].name = "retry";
+    policies[1].p.recover_after = 0;
+    policies[2].name = "retry+reopen";
+    policies[3].name = "retry+rebind";
+    policies[3].p.rebind = true;
+
+    while ((c = getopt_long(argc, argv, "i:n:r:h", longopts, nullptr)) != -1) {
+        switch (c) {
+        case 'i': interval_ms = atof(optarg); break;
+        case 'n': samples = static_cast<unsigned>(atoi(optarg)); break;
+        case 'r': runs = static_cast<unsigned>(atoi(optarg)); break;
+        default:
+            usage(argv[0]);
+            return c == 'h' ? 0 : 1;
+        }
+    }
+    if (interval_ms < 2.0 || samples < 10 || runs < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+    // Backoff scaled with the interval, as 5 ms is to a 10 s tick
+    for (Policy &pol : policies)
+        pol.p.backoff_ms = std::max(1u, static_cast<unsigned>(interval_ms / 10.0));
+
+    printf("interval %.0f ms, %u samples, fault at sample 5, %u runs (averaged)\n\n", interval_ms,
+           samples, runs);
+    printf("%-13s %-13s %10s %8s %8s %10s %10s %10s\n", "scenario", "policy", "recover_ms", "lost",
+           "retries", "recoveries", "recov_ms", "transfers");
+    for (const Scenario &sc : scenarios) {
+        for (const Policy &pol : policies) {
+            Result sum;
+            unsigned ok = 0;
+            char rec[32] = "never";
+
+            for (unsigned r = 0; r < runs; r++) {
+                Result res = run(sc, pol, static_cast<int64_t>(interval_ms * 1e6), samples, 5);
+
+                if (res.recovered) {
+                    ok++;
+                    sum.recovery_ms += res.recovery_ms;
+                }
+                sum.failed |= res.failed;
+                sum.lost += res.lost;
+                sum.retries += res.retries;
+                sum.recoveries += res.recoveries;
+                sum.recovery_cost_ms += res.recovery_cost_ms;
+                sum.transfers += res.transfers;
+            }
+            if (!sum.failed)
+                snprintf(rec, sizeof(rec), "0");
+            else if (ok == runs)
+                snprintf(rec, sizeof(rec), "%.1f", sum.recovery_ms / ok);
+            else if (ok)
+                snprintf(rec, sizeof(rec), "%.1f (%u/%u)", sum.recovery_ms / ok, ok, runs);
+            printf("%-13s %-13s %10s %8.1f %8.1f %10.1f %10.1f %10.1f\n", sc.name, pol.name, rec,
+                   static_cast<double>(sum.lost) / runs, static_cast<double>(sum.retries) / runs,
+                   static_cast<double>(sum.recoveries) / runs, sum.recovery_cost_ms / runs,
+                   static_cast<double>(sum.transfers) / runs);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,47 @@
+#include "sink_filter.h"
+
+#include <cmath>
+#include <cstring>
+
+#include "output_stage.h"
+
+namespace battd {
+
+bool SinkFilter::wants(const OutputItem &it, int64_t now_ns) const {
+    const BatteryUpdate &u = it.update;
+    int64_t since = now_ns - last_ns_;
+
+    if (!have_)
+        return true;
+    if (since < static_cast<int64_t>(cfg_.min_interval_ms) * 1000000)
+        return false;
+    if (cfg_.max_interval_ms && since >= static_cast<int64_t>(cfg_.max_interval_ms) * 1000000)
+        return true;
+    if (!cfg_.filters())
+        return true;
+
+    if (strcmp(u.status, status_) != 0 || it.rec.state != state_ || u.have_temp != have_temp_)
+        return true;
+    if (cfg_.voltage_delta_mv > 0.0 &&
+        std::fabs((static_cast<double>(u.voltage_uv) - static_cast<double>(voltage_uv_)) / 1000.0) >=
+            cfg_.voltage_delta_mv)
+        return true;
+    if (cfg_.soc_delta_pct > 0.0 && std::abs(it.rec.soc_milli - soc_milli_) / 1000.0 >= cfg_.soc_delta_pct)
+        return true;
+    if (cfg_.temp_delta_c > 0.0 && u.have_temp && std::abs(u.temp_dc - temp_dc_) / 10.0 >= cfg_.temp_delta_c)
+        return true;
+    return false;
+}
+
+void SinkFilter::sent(const OutputItem &it, int64_t now_ns) {
+    have_ = true;
+    last_ns_ = now_ns;
+    voltage_uv_ = it.update.voltage_uv;
+    soc_milli_ = it.rec.soc_milli;
+    have_temp_ = it.update.have_temp;
+    temp_dc_ = it.update.temp_dc;
+    status_ = it.update.status;
+    state_ = it.rec.state;
+}
+
+} // namespace battd
@@ -0,0 +1,50 @@
+#ifndef USERSPACE_BATTERYD_SINK_FILTER_H
+#define USERSPACE_BATTERYD_SINK_FILTER_H
+
+#include <cstdint>
+
+namespace battd {
+
+struct OutputItem;
+
+// Per-sink settings, the same keys in every sink's section
+struct SinkFilterConfig {
+    unsigned min_interval_ms = 0;   // rate limit: at most one sample per gauge per this
+    unsigned max_interval_ms = 0;   // pass an unchanged sample after this, 0 = never
+    // Pass a sample once a value has moved this far from the last one
+    // passed. All 0 = every sample passes (subject to min_interval).
+    double voltage_delta_mv = 0.0;
+    double soc_delta_pct = 0.0;
+    double temp_delta_c = 0.0;
+
+    bool filters() const { return voltage_delta_mv > 0.0 || soc_delta_pct > 0.0 || temp_delta_c > 0.0; }
+};
+
+// --- Change filter and rate limit, one per sink and gauge ---
+// A status or charge state change always passes, unless the rate limit
+// holds it back; it then goes out with the next sample that is allowed,
+// since the comparison is against what the sink last got.
+class SinkFilter {
+public:
+    explicit SinkFilter(const SinkFilterConfig &cfg) : cfg_(cfg) {}
+
+    // Would the sample in it go out at now_ns?
+    bool wants(const OutputItem &it, int64_t now_ns) const;
+    // It did: compare against it from now on
+    void sent(const OutputItem &it, int64_t now_ns);
+
+private:
+    SinkFilterConfig cfg_;
+    bool have_ = false;
+    int64_t last_ns_ = 0;
+    uint64_t voltage_uv_ = 0;
+    int32_t soc_milli_ = 0;
+    bool have_temp_ = false;
+    int temp_dc_ = 0;
+    const char *status_ = nullptr;  // the classifier's static strings
+    uint8_t state_ = 0;
+};
+
+} // namespace battd
+
+#endif // USERSPACE_BATTERYD_SINK_FILTER_H
@@ -0,0 +1,145 @@
+#include "sinks.h"
+
+#include <cerrno>
+#include <cstdio>
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "bus_worker.h"
+#include "classifier.h"
+#include "gauge.h"
+
+namespace battd {
+
+// --- ConsoleSink ---
+
+void ConsoleSink::write(OutputItem &it, OutputDone *) {
+    fprintf(it.error ? stderr : stdout, "%s\n", it.text);
+}
+
+void ConsoleSink::flush() {
+    fflush(stdout);
+}
+
+// --- SysfsSink ---
+
+void SysfsSink::add_gauge(std::unique_ptr<SysfsPublisher> publisher, bool watch_seq) {
+    gauges_.emplace_back(new Gauge(std::move(publisher), watch_seq));
+}
+
+void SysfsSink::write(OutputItem &it, OutputDone *d) {
+    Gauge *g = it.gauge < gauges_.size() ? gauges_[it.gauge].get() : nullptr;
+    SyscallStats st;
+
+    if (!g || !g->publisher)
+        return;
+
+    switch (it.kind) {
+    case OutputItem::SAMPLE:
+        d->err = g->publisher->publish(it.update, &st);
+        // Module-side counter for the metrics endpoint, read here so a
+        // scrape never touches sysfs
+        if (g->watch_seq) {
+            if (g->seq.read(&d->seq, &st) == -EBADF && g->seq.open(&st) == 0)
+                d->seq = g->seq.value();
+            d->have_seq = g->seq.fd() >= 0;
+        }
+        break;
+    case OutputItem::ONLINE:
+        d->err = g->publisher->publish_online(it.online, &st);
+        break;
+    case OutputItem::STALE:
+        d->err = g->publisher->mark_stale(&st);
+        break;
+    case OutputItem::INVALIDATE:
+        g->publisher->invalidate(&st);
+        // The old seq node is gone with the module
+        g->seq.close(&st);
+        break;
+    default:
+        break;
+    }
+    d->syscalls = st.total();
+}
+
+// --- LogSink ---
+
+void LogSink::write(OutputItem &it, OutputDone *d) {
+    d->err = log_->append(it.rec, monotonic_ns());
+    d->log_dropped = log_->dropped();
+}
+
+// --- UdpSink ---
+
+UdpSink::UdpSink(const UdpSinkConfig &cfg, const std::vector<std::string> &gauges) : cfg_(cfg) {
+    // Names are free-form in the config; escape them once, not per datagram
+    for (const std::string &name : gauges)
+        gauges_.push_back(json_escape(name));
+}
+
+UdpSink::~UdpSink() {
+    if (fd_ >= 0)
+        close(fd_);
+}
+
+int UdpSink::open() {
+    struct in_addr ifaddr;
+    int loop = 1, ttl = static_cast<int>(cfg_.ttl);
+
+    addr_.sin_family = AF_INET;
+    addr_.sin_port = htons(static_cast<uint16_t>(cfg_.port));
+    if (inet_pton(AF_INET, cfg_.group.c_str(), &addr_.sin_addr) != 1)
+        return -EINVAL;
+    if (!cfg_.interface.empty() && inet_pton(AF_INET, cfg_.interface.c_str(), &ifaddr) != 1)
+        return -EINVAL;
+
+    fd_ = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd_ < 0)
+        return -errno;
+
+    if (IN_MULTICAST(ntohl(addr_.sin_addr.s_addr))) {
+        // Listeners on this host are the point, so loop back
+        if (setsockopt(fd_, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop)) < 0 ||
+            setsockopt(fd_, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) < 0)
+            return -errno;
+        if (!cfg_.interface.empty() &&
+            setsockopt(fd_, IPPROTO_IP, IP_MULTICAST_IF, &ifaddr, sizeof(ifaddr)) < 0)
+            return -errno;
+    }
+    return 0;
+}
+
+void UdpSink::write(OutputItem &it, OutputDone *d) {
+    const TelemetryRecord &r = it.rec;
+    const char *gauge = it.gauge < gauges_.size() ? gauges_[it.gauge].c_str() : "";
+    char buf[512], wall[40], rate[24] = "null", temp[24] = "null";
+    int len;
+
+    format_wall(wall, sizeof(wall), r.wall_ns);
+    if (r.flags & TELEMETRY_RATE_VALID)
+        snprintf(rate, sizeof(rate), "%.3f", r.rate_milli / 1000.0);
+    if (r.flags & TELEMETRY_TEMP_VALID)
+        snprintf(temp, sizeof(temp), "%.1f", r.temp_mc / 1000.0);
+
+    len = snprintf(buf, sizeof(buf),
+                   "{\"time\":\"%s\",\"mono_s\":%.3f,\"gauge\":\"%s\",\"chip\":\"%s\",\"voltage_v\":%.6f,"
+                   "\"soc_pct\":%.3f,\"rate_pct_h\":%s,\"temp_c\":%s,\"state\":\"%s\",\"status\":\"%s\","
+                   "\"tte_s\":%d,\"ttf_s\":%d}\n",
+                   wall, r.mono_ns / 1e9, gauge, chip_type_name(static_cast<ChipType>(r.chip)),
+                   r.voltage_uv / 1e6, r.soc_milli / 1000.0, rate, temp,
+                   charge_state_name(static_cast<ChargeState>(r.state)), it.update.status, r.tte_s,
+                   r.ttf_s);
+    if (len < 0 || static_cast<size_t>(len) >= sizeof(buf)) {
+        d->err = -EMSGSIZE;
+        return;
+    }
+
+    d->syscalls = 1;
+    if (sendto(fd_, buf, len, MSG_DONTWAIT | MSG_NOSIGNAL,
+               reinterpret_cast<const struct sockaddr *>(&addr_), sizeof(addr_)) < 0)
+        d->err = -errno;
+}
+
+} // namespace battd
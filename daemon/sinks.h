@@ -0,0 +1,100 @@
+#ifndef USERSPACE_BATTERYD_SINKS_H
+#define USERSPACE_BATTERYD_SINKS_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <netinet/in.h>
+
+#include "output_stage.h"
+#include "sysfs_publisher.h"
+#include "sysfs_watch.h"
+#include "telemetry_log.h"
+
+namespace battd {
+
+// --- Console: stdout rows and messages ---
+class ConsoleSink : public Sink {
+public:
+    const char *name() const override { return "console"; }
+    unsigned kinds() const override { return 1u << OutputItem::LINE | 1u << OutputItem::SAMPLE; }
+    void write(OutputItem &it, OutputDone *d) override;
+    void flush() override;
+};
+
+// --- userspace_battery sysfs ---
+// The set_* attributes of every gauge with ko_write, plus the charger
+// state, mark_stale and the seq re-read for the metrics.
+class SysfsSink : public Sink {
+public:
+    // In gauge order; publisher is null for a gauge without ko_write.
+    // watch_seq re-reads the module's seq after each publish.
+    void add_gauge(std::unique_ptr<SysfsPublisher> publisher, bool watch_seq);
+
+    const char *name() const override { return "sysfs"; }
+    unsigned kinds() const override {
+        return 1u << OutputItem::SAMPLE | 1u << OutputItem::ONLINE | 1u << OutputItem::STALE |
+               1u << OutputItem::INVALIDATE;
+    }
+    void write(OutputItem &it, OutputDone *d) override;
+
+private:
+    struct Gauge {
+        Gauge(std::unique_ptr<SysfsPublisher> p, bool w)
+            : publisher(std::move(p)), watch_seq(w),
+              seq(publisher ? publisher->platform_path() + "/seq" : std::string()) {}
+
+        std::unique_ptr<SysfsPublisher> publisher;
+        bool watch_seq;
+        SysfsWatch seq;
+    };
+
+    std::vector<std::unique_ptr<Gauge>> gauges_;
+};
+
+// --- Binary telemetry log ---
+class LogSink : public Sink {
+public:
+    explicit LogSink(std::unique_ptr<TelemetryLog> log) : log_(std::move(log)) {}
+
+    const char *name() const override { return "log"; }
+    unsigned kinds() const override { return 1u << OutputItem::SAMPLE; }
+    void write(OutputItem &it, OutputDone *d) override;
+
+private:
+    std::unique_ptr<TelemetryLog> log_;
+};
+
+struct UdpSinkConfig {
+    std::string group;          // IPv4 address, usually multicast; empty = no sink
+    unsigned port = 4510;
+    unsigned ttl = 1;           // multicast hops; 1 = this link only
+    std::string interface;      // IPv4 address of the sending interface, empty = default
+};
+
+// --- UDP datagrams for local listeners ---
+// One JSON object per sample, the same fields battlog -f json prints, sent
+// without blocking: a listener that is not there costs nothing.
+class UdpSink : public Sink {
+public:
+    UdpSink(const UdpSinkConfig &cfg, const std::vector<std::string> &gauges);
+    ~UdpSink() override;
+
+    // Create the socket. Returns 0 or -errno (-EINVAL for a bad address).
+    int open();
+
+    const char *name() const override { return "udp"; }
+    unsigned kinds() const override { return 1u << OutputItem::SAMPLE; }
+    void write(OutputItem &it, OutputDone *d) override;
+
+private:
+    UdpSinkConfig cfg_;
+    std::vector<std::string> gauges_;   // JSON-escaped
+    int fd_ = -1;
+    struct sockaddr_in addr_ = {};
+};
+
+} // namespace battd
+
+#endif // USERSPACE_BATTERYD_SINKS_H
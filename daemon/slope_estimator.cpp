@@ -0,0 +1,120 @@
+#include "slope_estimator.h"
+
+#include <cmath>
+
+namespace battd {
+
+SlopeEstimator::SlopeEstimator(double window_s, size_t capacity)
+    : window_s_(window_s), ring_(capacity < 3 ? 3 : capacity) {}
+
+void SlopeEstimator::reset() {
+    head_ = 0;
+    n_ = 0;
+    since_rebase_ = 0;
+    st_ = sv_ = stt_ = stv_ = svv_ = 0.0;
+}
+
+void SlopeEstimator::push(double t, double v) {
+    ring_[(head_ + n_) % ring_.size()] = { t, v };
+    n_++;
+    st_ += t;
+    sv_ += v;
+    stt_ += t * t;
+    stv_ += t * v;
+    svv_ += v * v;
+}
+
+void SlopeEstimator::pop() {
+    const Point &p = ring_[head_];
+
+    st_ -= p.t;
+    sv_ -= p.v;
+    stt_ -= p.t * p.t;
+    stv_ -= p.t * p.v;
+    svv_ -= p.v * p.v;
+    head_ = (head_ + 1) % ring_.size();
+    n_--;
+}
+
+// Move the reference to the oldest sample and recompute the sums exactly.
+// Runs once per ring_.size() insertions, so the cost stays O(1) amortized.
+void SlopeEstimator::rebase() {
+    const Point ref = ring_[head_];
+    size_t n = n_;
+
+    t0_ += ref.t;
+    v0_ += ref.v;
+    st_ = sv_ = stt_ = stv_ = svv_ = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        Point &p = ring_[(head_ + i) % ring_.size()];
+
+        p.t -= ref.t;
+        p.v -= ref.v;
+        st_ += p.t;
+        sv_ += p.v;
+        stt_ += p.t * p.t;
+        stv_ += p.t * p.v;
+        svv_ += p.v * p.v;
+    }
+    since_rebase_ = 0;
+}
+
+void SlopeEstimator::add(double t_s, double v) {
+    double t, rv;
+
+    if (n_ == 0) {
+        t0_ = t_s;
+        v0_ = v;
+        since_rebase_ = 0;
+    }
+    t = t_s - t0_;
+    rv = v - v0_;
+
+    // Expire by time, and by count if samples arrive faster than expected
+    while (n_ > 0 && t - ring_[head_].t > window_s_)
+        pop();
+    if (n_ == ring_.size())
+        pop();
+
+    push(t, rv);
+    if (++since_rebase_ >= ring_.size())
+        rebase();
+}
+
+double SlopeEstimator::span_s() const {
+    if (n_ < 2)
+        return 0.0;
+    return ring_[(head_ + n_ - 1) % ring_.size()].t - ring_[head_].t;
+}
+
+bool SlopeEstimator::valid() const {
+    double n = static_cast<double>(n_);
+
+    return n_ >= 3 && n * stt_ - st_ * st_ > 1e-9 * n * n;
+}
+
+double SlopeEstimator::slope() const {
+    double n = static_cast<double>(n_);
+    double sxx = n * stt_ - st_ * st_;
+
+    if (!valid())
+        return 0.0;
+    return (n * stv_ - st_ * sv_) / sxx;
+}
+
+double SlopeEstimator::slope_stderr() const {
+    double n = static_cast<double>(n_);
+    double sxx, sxy, syy, sse;
+
+    if (!valid())
+        return INFINITY;
+    sxx = stt_ - st_ * st_ / n;
+    sxy = stv_ - st_ * sv_ / n;
+    syy = svv_ - sv_ * sv_ / n;
+    sse = syy - sxy * sxy / sxx;
+    if (sse < 0.0)
+        sse = 0.0; // rounding on a perfect fit
+    return std::sqrt(sse / (n - 2.0) / sxx);
+}
+
+} // namespace battd
@@ -0,0 +1,51 @@
+#ifndef USERSPACE_BATTERYD_SLOPE_ESTIMATOR_H
+#define USERSPACE_BATTERYD_SLOPE_ESTIMATOR_H
+
+#include <cstddef>
+#include <vector>
+
+namespace battd {
+
+// --- Streaming least-squares slope over a time window ---
+// Keeps running sums (n, St, Sv, Stt, Stv, Svv) of the samples inside the
+// window, so each add() is O(1) amortized: one insert plus however many
+// samples fell out of the window. Times and values are stored relative to
+// a reference point that is moved forward periodically, which keeps the
+// sums well conditioned on a daemon that runs for months.
+class SlopeEstimator {
+public:
+    explicit SlopeEstimator(double window_s = 600.0, size_t capacity = 512);
+
+    void add(double t_s, double v);
+    void reset();
+
+    size_t count() const { return n_; }
+    double span_s() const;            // newest - oldest sample time
+
+    // True once at least three distinct timestamps are in the window.
+    bool valid() const;
+    double slope() const;             // units of v per second
+    double slope_stderr() const;      // standard error of slope()
+
+private:
+    struct Point {
+        double t;
+        double v;
+    };
+
+    void push(double t, double v);
+    void pop();
+    void rebase();
+
+    double window_s_;
+    std::vector<Point> ring_;         // relative to t0_/v0_
+    size_t head_ = 0;                 // oldest sample
+    size_t n_ = 0;
+    size_t since_rebase_ = 0;
+    double t0_ = 0.0, v0_ = 0.0;
+    double st_ = 0.0, sv_ = 0.0, stt_ = 0.0, stv_ = 0.0, svv_ = 0.0;
+};
+
+} // namespace battd
+
+#endif // USERSPACE_BATTERYD_SLOPE_ESTIMATOR_H
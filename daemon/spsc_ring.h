@@ -0,0 +1,90 @@
+#ifndef USERSPACE_BATTERYD_SPSC_RING_H
+#define USERSPACE_BATTERYD_SPSC_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace battd {
+
+// --- Single-producer single-consumer ring ---
+// Bounded and lock-free: the producer only stores tail_, the consumer only
+// stores head_, each on its own cache line. try_push() never waits; a full
+// ring is the caller's to count and drop, so a stalled consumer cannot hold
+// up the producer. N must be a power of two.
+template <typename T, size_t N>
+class SpscRing {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "ring size must be a power of two");
+
+public:
+    SpscRing() = default;
+    SpscRing(const SpscRing &) = delete;
+    SpscRing &operator=(const SpscRing &) = delete;
+
+    // Producer side. Returns false when full.
+    bool try_push(const T &v) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        size_t depth = tail - head_.load(std::memory_order_acquire);
+
+        if (depth == N)
+            return false;
+        slots_[tail & (N - 1)] = v;
+        tail_.store(tail + 1, std::memory_order_release);
+        if (depth + 1 > high_water_.load(std::memory_order_relaxed))
+            high_water_.store(depth + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Consumer side. Returns false when empty.
+    bool try_pop(T *out) {
+        size_t head = head_.load(std::memory_order_relaxed);
+
+        if (head == tail_.load(std::memory_order_acquire))
+            return false;
+        *out = slots_[head & (N - 1)];
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Either side; a snapshot that may be stale by the time it is used
+    size_t depth() const {
+        return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+    }
+    // Deepest the ring has been
+    size_t high_water() const { return high_water_.load(std::memory_order_relaxed); }
+    static constexpr size_t capacity() { return N; }
+
+private:
+    alignas(64) std::atomic<size_t> head_{0};
+    alignas(64) std::atomic<size_t> tail_{0};
+    std::atomic<size_t> high_water_{0};    // producer-written
+    alignas(64) T slots_[N];
+};
+
+// --- Wakeup for a ring consumer ---
+// An eventfd: producers ring() after pushing, the consumer either keeps the
+// fd in its epoll set or blocks in wait(). Any number of rings may share one.
+class Doorbell {
+public:
+    Doorbell();
+    ~Doorbell();
+
+    Doorbell(const Doorbell &) = delete;
+    Doorbell &operator=(const Doorbell &) = delete;
+
+    int fd() const { return fd_; }
+
+    void ring();
+    // Reset before draining, so a ring() racing the drain is not lost
+    void clear();
+    // Block until rung or until timeout_ns passes (< 0 = forever); clears
+    // the bell. Returns true if it was rung.
+    bool wait(int64_t timeout_ns);
+
+private:
+    int fd_;
+};
+
+} // namespace battd
+
+#endif // USERSPACE_BATTERYD_SPSC_RING_H
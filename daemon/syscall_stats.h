@@ -0,0 +1,31 @@
+#ifndef USERSPACE_BATTERYD_SYSCALL_STATS_H
+#define USERSPACE_BATTERYD_SYSCALL_STATS_H
+
+namespace battd {
+
+// --- Per-sample syscall accounting ---
+// Every helper that touches the kernel on the sample path takes an optional
+// SyscallStats pointer and bumps the matching counter, so the main loop can
+// report exactly what one sample cost.
+struct SyscallStats {
+    unsigned opens = 0;
+    unsigned closes = 0;
+    unsigned writes = 0;    // pwrite to sysfs attributes
+    unsigned reads = 0;     // netlink / misc reads
+    unsigned ioctls = 0;    // I2C_RDWR transactions
+
+    unsigned total() const { return opens + closes + writes + reads + ioctls; }
+
+    SyscallStats &operator+=(const SyscallStats &o) {
+        opens += o.opens;
+        closes += o.closes;
+        writes += o.writes;
+        reads += o.reads;
+        ioctls += o.ioctls;
+        return *this;
+    }
+};
+
+} // namespace battd
+
+#endif // USERSPACE_BATTERYD_SYSCALL_STATS_H
@@ -0,0 +1,249 @@
+#include "sysfs_publisher.h"
+
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace battd {
+
+// --- SysfsAttr ---
+
+SysfsAttr::~SysfsAttr() {
+    close();
+}
+
+int SysfsAttr::open(SyscallStats *st) {
+    fd_ = ::open(path_.c_str(), O_WRONLY | O_CLOEXEC);
+    if (st) st->opens++;
+    if (fd_ < 0)
+        return -errno;
+    return 0;
+}
+
+void SysfsAttr::close(SyscallStats *st) {
+    if (fd_ < 0)
+        return;
+    ::close(fd_);
+    if (st) st->closes++;
+    fd_ = -1;
+    last_.clear();
+}
+
+int SysfsAttr::write(const char *buf, size_t len, SyscallStats *st) {
+    ssize_t n;
+    int ret;
+
+    if (dedup_ && fd_ >= 0 && last_.size() == len && last_.compare(0, len, buf, len) == 0)
+        return 0;
+
+    for (int attempt = 0; attempt < 2; attempt++) {
+        if (fd_ < 0) {
+            ret = open(st);
+            if (ret) return ret;
+        }
+
+        n = pwrite(fd_, buf, len, 0);
+        if (st) st->writes++;
+        if (n == static_cast<ssize_t>(len)) {
+            last_.assign(buf, len);
+            return 0;
+        }
+        if (n >= 0)
+            return -EIO;
+
+        ret = -errno;
+        // Module reloaded or device removed: the old kernfs node is dead,
+        // reopen once by path. Anything else (EINVAL etc.) is a value error.
+        if (ret != -ENODEV && ret != -ENOENT && ret != -EBADF)
+            return ret;
+        close(st);
+    }
+    return ret;
+}
+
+// --- SysfsPublisher ---
+
+// The module refused the value itself (-EINVAL, -ERANGE for an impossible
+// temperature): the other attributes of the sample are still good
+static bool value_error(int err) {
+    return err == -EINVAL || err == -ERANGE;
+}
+
+// Keep the first error, unless a later one says the device or the write
+// itself failed
+static void keep_error(int *err, int ret) {
+    if (ret && (!*err || (value_error(*err) && !value_error(ret))))
+        *err = ret;
+}
+
+SysfsPublisher::SysfsPublisher(const std::string &platform_path)
+    : platform_path_(platform_path),
+      // Always rewritten: it doubles as the heartbeat for the module's
+      // stale_timeout_ms watchdog
+      voltage_(platform_path + "/set_voltage_uv", false),
+      capacity_(platform_path + "/set_capacity"),
+      status_(platform_path + "/set_status"),
+      time_to_empty_(platform_path + "/set_time_to_empty"),
+      time_to_full_(platform_path + "/set_time_to_full"),
+      temp_(platform_path + "/set_temp"),
+      online_(platform_path + "/set_online"),
+      cycle_count_(platform_path + "/set_cycle_count"),
+      health_(platform_path + "/set_health"),
+      charge_full_(platform_path + "/set_charge_full"),
+      charge_full_design_(platform_path + "/set_charge_full_design"),
+      // Deduped, so after the first upload this costs a compare, not a
+      // syscall; a reopen after invalidate() uploads it again
+      ocv_table_(platform_path + "/ocv_table"),
+      mark_stale_(platform_path + "/mark_stale", false),
+      transaction_(platform_path + "/transaction", false) {}
+
+int SysfsPublisher::publish(const BatteryUpdate &u, SyscallStats *st) {
+    int ret, err;
+
+    if (!txn_ || no_txn_)
+        return publish_attrs(u, st);
+
+    // EBUSY (another writer holds one) also lands here: our writes then
+    // go straight through, which is what they did before transactions
+    ret = transaction_.write("begin", 5, st);
+    if (ret) {
+        if (ret == -ENOENT)
+            no_txn_ = true;
+        return publish_attrs(u, st);
+    }
+
+    // A rejected value only loses its own attribute: the rest, voltage
+    // included, is committed so the module's watchdog still sees the
+    // heartbeat. Only an I/O or device error throws the sample away.
+    err = publish_attrs(u, st);
+    if (err && !value_error(err)) {
+        transaction_.write("abort", 5, st);
+        // Nothing staged was applied; the dedup caches say otherwise
+        forget();
+        return err;
+    }
+    ret = transaction_.write("commit", 6, st);
+    if (ret) {
+        forget();
+        return ret;
+    }
+    return err;
+}
+
+int SysfsPublisher::publish_attrs(const BatteryUpdate &u, SyscallStats *st) {
+    char buf[32];
+    int len, ret, err = 0;
+
+    // Table before voltage, so the voltage write already derives capacity
+    if (!ocv_blob_.empty()) {
+        ret = ocv_table_.write(reinterpret_cast<const char *>(ocv_blob_.data()),
+                               ocv_blob_.size(), st);
+        keep_error(&err, ret);
+    }
+
+    len = snprintf(buf, sizeof(buf), "%" PRIu64, u.voltage_uv);
+    ret = voltage_.write(buf, len, st);
+    keep_error(&err, ret);
+
+    if (ocv_blob_.empty()) {
+        len = snprintf(buf, sizeof(buf), "%d", u.capacity);
+        ret = capacity_.write(buf, len, st);
+        keep_error(&err, ret);
+    }
+
+    ret = status_.write(u.status, strlen(u.status), st);
+    keep_error(&err, ret);
+
+    len = snprintf(buf, sizeof(buf), "%d", u.time_to_empty_s);
+    ret = time_to_empty_.write(buf, len, st);
+    keep_error(&err, ret);
+
+    len = snprintf(buf, sizeof(buf), "%d", u.time_to_full_s);
+    ret = time_to_full_.write(buf, len, st);
+    keep_error(&err, ret);
+
+    if (u.have_temp) {
+        len = snprintf(buf, sizeof(buf), "%d", u.temp_dc);
+        ret = temp_.write(buf, len, st);
+        keep_error(&err, ret);
+    }
+
+    if (!no_ageing_) {
+        ret = publish_ageing(u, st);
+        if (ret == -ENOENT)
+            no_ageing_ = true;
+        else
+            keep_error(&err, ret);
+    }
+    return err;
+}
+
+int SysfsPublisher::publish_ageing(const BatteryUpdate &u, SyscallStats *st) {
+    char buf[32];
+    int len, ret, err = 0;
+
+    if (u.charge_full_design_uah >= 0) {
+        len = snprintf(buf, sizeof(buf), "%d", u.charge_full_design_uah);
+        ret = charge_full_design_.write(buf, len, st);
+        // A module without the ageing attributes: the rest are missing too
+        if (ret == -ENOENT) return ret;
+        keep_error(&err, ret);
+    }
+    if (u.charge_full_uah >= 0) {
+        len = snprintf(buf, sizeof(buf), "%d", u.charge_full_uah);
+        keep_error(&err, charge_full_.write(buf, len, st));
+    }
+    if (u.cycle_count >= 0) {
+        len = snprintf(buf, sizeof(buf), "%d", u.cycle_count);
+        keep_error(&err, cycle_count_.write(buf, len, st));
+    }
+    if (u.health)
+        keep_error(&err, health_.write(u.health, strlen(u.health), st));
+    return err;
+}
+
+void SysfsPublisher::forget() {
+    voltage_.forget();
+    capacity_.forget();
+    status_.forget();
+    time_to_empty_.forget();
+    time_to_full_.forget();
+    temp_.forget();
+    cycle_count_.forget();
+    health_.forget();
+    charge_full_.forget();
+    charge_full_design_.forget();
+}
+
+int SysfsPublisher::publish_online(bool online, SyscallStats *st) {
+    return online_.write(online ? "1" : "0", 1, st);
+}
+
+int SysfsPublisher::mark_stale(SyscallStats *st) {
+    return mark_stale_.write("1", 1, st);
+}
+
+void SysfsPublisher::invalidate(SyscallStats *st) {
+    voltage_.close(st);
+    capacity_.close(st);
+    status_.close(st);
+    time_to_empty_.close(st);
+    time_to_full_.close(st);
+    temp_.close(st);
+    online_.close(st);
+    cycle_count_.close(st);
+    health_.close(st);
+    charge_full_.close(st);
+    charge_full_design_.close(st);
+    no_ageing_ = false;
+    ocv_table_.close(st);
+    mark_stale_.close(st);
+    transaction_.close(st);
+    no_txn_ = false;
+}
+
+} // namespace battd
@@ -0,0 +1,127 @@
+#ifndef USERSPACE_BATTERYD_SYSFS_PUBLISHER_H
+#define USERSPACE_BATTERYD_SYSFS_PUBLISHER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "syscall_stats.h"
+
+namespace battd {
+
+// --- Persistent sysfs attribute ---
+// Opened once and rewritten in place with pwrite(fd, buf, n, 0). The fd is
+// only reopened when the kernel tells us the attribute is gone (ENODEV once
+// the kernfs node is deactivated, ENOENT/EBADF if it never came back).
+// Unless dedup is off, a value identical to the last one written is not
+// written again; the cache is dropped whenever the fd is closed.
+class SysfsAttr {
+public:
+    explicit SysfsAttr(std::string path, bool dedup = true)
+        : path_(std::move(path)), dedup_(dedup) {}
+    ~SysfsAttr();
+
+    SysfsAttr(const SysfsAttr &) = delete;
+    SysfsAttr &operator=(const SysfsAttr &) = delete;
+
+    // Returns 0 or -errno.
+    int write(const char *buf, size_t len, SyscallStats *st);
+    void close(SyscallStats *st = nullptr);
+    // Drop the dedup cache: the kernel no longer holds what we last wrote
+    void forget() { last_.clear(); }
+
+    const std::string &path() const { return path_; }
+
+private:
+    int open(SyscallStats *st);
+
+    std::string path_;
+    bool dedup_;
+    std::string last_;
+    int fd_ = -1;
+};
+
+// One sample's worth of values for a userspace_battery instance
+struct BatteryUpdate {
+    uint64_t voltage_uv = 0;
+    int capacity = 0;
+    const char *status = "Unknown";
+    int time_to_empty_s = -1;       // -1 = unknown
+    int time_to_full_s = -1;
+    bool have_temp = false;
+    int temp_dc = 0;                // tenths of a degree C
+
+    // Ageing, only written when tracked
+    int cycle_count = -1;
+    const char *health = nullptr;   // as the class attribute spells it
+    int charge_full_uah = -1;
+    int charge_full_design_uah = -1;
+};
+
+// --- userspace_battery producer interface ---
+// Owns the set_* attributes of one platform device
+// (e.g. /sys/devices/platform/userspace_battery).
+class SysfsPublisher {
+public:
+    explicit SysfsPublisher(const std::string &platform_path);
+
+    // Returns 0 or -errno: the first I/O or device error, else the first
+    // value the module rejected (-EINVAL, -ERANGE). Later attributes are
+    // still written, and in a transaction a rejected value is left out of
+    // the commit rather than aborting it. The ageing values are deduped
+    // like the rest and skipped on a module without them.
+    int publish(const BatteryUpdate &u, SyscallStats *st);
+
+    // Install an encoded OCV table (see ocv_table.h). From then on every
+    // publish() first (re)uploads it when the fd is fresh, and capacity is
+    // left for the module to derive from voltage.
+    void set_ocv_table(std::vector<uint8_t> blob) { ocv_blob_ = std::move(blob); }
+
+    // Wrap every publish() in the module's transaction attribute, so one
+    // sample is one seq step and one uevent instead of one per attribute.
+    // Quietly falls back to plain writes on a module without it.
+    void set_transaction(bool on) { txn_ = on; }
+
+    // External power state for the companion charger (set_online).
+    int publish_online(bool online, SyscallStats *st);
+
+    // The gauge stopped answering: have the module report stale now rather
+    // than when its watchdog expires. The next publish() clears it.
+    int mark_stale(SyscallStats *st);
+
+    // Drop all fds; they are reopened on the next publish. Used when a
+    // uevent says the device went away or came back.
+    void invalidate(SyscallStats *st = nullptr);
+
+    const std::string &platform_path() const { return platform_path_; }
+
+private:
+    int publish_attrs(const BatteryUpdate &u, SyscallStats *st);
+    void forget();
+    int publish_ageing(const BatteryUpdate &u, SyscallStats *st);
+
+    std::string platform_path_;
+    SysfsAttr voltage_;
+    SysfsAttr capacity_;
+    SysfsAttr status_;
+    SysfsAttr time_to_empty_;
+    SysfsAttr time_to_full_;
+    SysfsAttr temp_;
+    SysfsAttr online_;
+    SysfsAttr cycle_count_;
+    SysfsAttr health_;
+    SysfsAttr charge_full_;
+    SysfsAttr charge_full_design_;
+    bool no_ageing_ = false;        // module predates the ageing attributes
+    SysfsAttr ocv_table_;
+    SysfsAttr mark_stale_;
+    SysfsAttr transaction_;
+    bool txn_ = false;
+    bool no_txn_ = false;           // module predates transactions
+    std::vector<uint8_t> ocv_blob_;
+};
+
+} // namespace battd
+
+#endif // USERSPACE_BATTERYD_SYSFS_PUBLISHER_H
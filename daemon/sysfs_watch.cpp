@@ -0,0 +1,60 @@
+#include "sysfs_watch.h"
+
+#include <cerrno>
+#include <cstdlib>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace battd {
+
+SysfsWatch::~SysfsWatch() {
+    close();
+}
+
+int SysfsWatch::open(SyscallStats *st) {
+    int ret;
+
+    close(st);
+    fd_ = ::open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+    if (st) st->opens++;
+    if (fd_ < 0)
+        return -errno;
+
+    // sysfs only starts reporting POLLPRI after the first read
+    ret = read(&value_, st);
+    if (ret)
+        close(st);
+    return ret;
+}
+
+void SysfsWatch::close(SyscallStats *st) {
+    if (fd_ < 0)
+        return;
+    ::close(fd_);
+    if (st) st->closes++;
+    fd_ = -1;
+}
+
+int SysfsWatch::read(uint64_t *val, SyscallStats *st) {
+    char buf[32];
+    char *end;
+    ssize_t n;
+
+    if (fd_ < 0)
+        return -EBADF;
+
+    n = pread(fd_, buf, sizeof(buf) - 1, 0);
+    if (st) st->reads++;
+    if (n < 0)
+        return -errno;
+    buf[n] = '\0';
+
+    *val = strtoull(buf, &end, 10);
+    if (end == buf)
+        return -EINVAL;
+    value_ = *val;
+    return 0;
+}
+
+} // namespace battd
@@ -0,0 +1,42 @@
+#ifndef USERSPACE_BATTERYD_SYSFS_WATCH_H
+#define USERSPACE_BATTERYD_SYSFS_WATCH_H
+
+#include <cstdint>
+#include <string>
+
+#include "syscall_stats.h"
+
+namespace battd {
+
+// --- Pollable sysfs counter ---
+// Read side of an attribute the module sysfs_notify()s (resume_count, seq).
+// The fd stays open; sysfs reports a notification as EPOLLPRI|EPOLLERR, after
+// which the value is re-read with pread(fd, buf, n, 0), which also re-arms it.
+class SysfsWatch {
+public:
+    explicit SysfsWatch(std::string path) : path_(std::move(path)) {}
+    ~SysfsWatch();
+
+    SysfsWatch(const SysfsWatch &) = delete;
+    SysfsWatch &operator=(const SysfsWatch &) = delete;
+
+    // Open and read the current value. Returns 0 or -errno.
+    int open(SyscallStats *st = nullptr);
+    void close(SyscallStats *st = nullptr);
+
+    // Re-read after a wakeup. Returns 0 with *val, or -errno.
+    int read(uint64_t *val, SyscallStats *st = nullptr);
+
+    int fd() const { return fd_; }
+    uint64_t value() const { return value_; }
+    const std::string &path() const { return path_; }
+
+private:
+    std::string path_;
+    uint64_t value_ = 0;
+    int fd_ = -1;
+};
+
+} // namespace battd
+
+#endif // USERSPACE_BATTERYD_SYSFS_WATCH_H
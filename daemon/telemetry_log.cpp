@@ -0,0 +1,200 @@
+#include "telemetry_log.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <utility>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace battd {
+
+int64_t realtime_ns() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+void format_wall(char *buf, size_t len, int64_t wall_ns) {
+    time_t sec = static_cast<time_t>(wall_ns / 1000000000);
+    struct tm tm;
+    size_t n;
+
+    gmtime_r(&sec, &tm);
+    n = strftime(buf, len, "%Y-%m-%dT%H:%M:%S", &tm);
+    snprintf(buf + n, len - n, ".%03dZ", static_cast<int>(wall_ns / 1000000 % 1000));
+}
+
+std::string json_escape(const std::string &s) {
+    std::string out;
+    char hex[8];
+
+    for (char c : s) {
+        if (c == '\\' || c == '"') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            snprintf(hex, sizeof(hex), "\\u%04x", static_cast<unsigned char>(c));
+            out += hex;
+        } else {
+            out += c;
+        }
+    }
+    return out;
+}
+
+TelemetryLog::TelemetryLog(const TelemetryLogConfig &cfg, std::vector<std::string> gauges)
+    : cfg_(cfg), gauges_(std::move(gauges)) {
+    buf_.reserve(cfg_.flush_bytes + sizeof(TelemetryRecord));
+}
+
+TelemetryLog::~TelemetryLog() {
+    flush();
+    if (fd_ >= 0)
+        close(fd_);
+}
+
+std::vector<uint8_t> TelemetryLog::header() const {
+    TelemetryFileHeader h = {};
+    std::vector<uint8_t> out(sizeof(h) + gauges_.size() * TELEMETRY_NAME_LEN, 0);
+
+    memcpy(h.magic, TELEMETRY_MAGIC, sizeof(h.magic));
+    h.version = TELEMETRY_VERSION;
+    h.record_size = sizeof(TelemetryRecord);
+    h.num_gauges = static_cast<uint16_t>(gauges_.size());
+    h.name_len = TELEMETRY_NAME_LEN;
+    memcpy(out.data(), &h, sizeof(h));
+    for (size_t i = 0; i < gauges_.size(); i++)
+        gauges_[i].copy(reinterpret_cast<char *>(&out[sizeof(h) + i * TELEMETRY_NAME_LEN]),
+                        TELEMETRY_NAME_LEN - 1);
+    return out;
+}
+
+int TelemetryLog::write_all(const uint8_t *buf, size_t len) {
+    while (len) {
+        ssize_t n = write(fd_, buf, len);
+
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -errno;
+        }
+        buf += n;
+        len -= static_cast<size_t>(n);
+    }
+    return 0;
+}
+
+// path -> path.1 -> ... -> path.keep, then start a fresh file
+int TelemetryLog::rotate() {
+    std::vector<uint8_t> hdr = header();
+    int ret;
+
+    if (fd_ >= 0) {
+        close(fd_);
+        fd_ = -1;
+    }
+    if (cfg_.keep == 0) {
+        unlink(cfg_.path.c_str());
+    } else {
+        for (unsigned i = cfg_.keep; i > 1; i--)
+            rename((cfg_.path + "." + std::to_string(i - 1)).c_str(),
+                   (cfg_.path + "." + std::to_string(i)).c_str());
+        rename(cfg_.path.c_str(), (cfg_.path + ".1").c_str());
+    }
+
+    fd_ = ::open(cfg_.path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    if (fd_ < 0)
+        return -errno;
+    ret = write_all(hdr.data(), hdr.size());
+    if (ret) {
+        close(fd_);
+        fd_ = -1;
+        return ret;
+    }
+    size_ = hdr.size();
+    return 0;
+}
+
+int TelemetryLog::open() {
+    std::vector<uint8_t> hdr = header(), old(hdr.size());
+    struct stat stbuf;
+    uint64_t tail;
+
+    if (fd_ >= 0)
+        return 0;
+    fd_ = ::open(cfg_.path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd_ < 0)
+        return -errno;
+    if (fstat(fd_, &stbuf) < 0)
+        return -errno;
+    size_ = static_cast<uint64_t>(stbuf.st_size);
+
+    if (size_ == 0) {
+        int ret = write_all(hdr.data(), hdr.size());
+
+        if (ret) return ret;
+        size_ = hdr.size();
+        return 0;
+    }
+    if (size_ < hdr.size() || pread(fd_, old.data(), old.size(), 0) != static_cast<ssize_t>(old.size()) ||
+        old != hdr || size_ >= cfg_.max_bytes)
+        return rotate();
+
+    // Drop a record torn by a crash so the next one lands on its boundary
+    tail = (size_ - hdr.size()) % sizeof(TelemetryRecord);
+    if (tail) {
+        size_ -= tail;
+        if (ftruncate(fd_, static_cast<off_t>(size_)) < 0)
+            return -errno;
+    }
+    return 0;
+}
+
+int TelemetryLog::flush() {
+    size_t records = buf_.size() / sizeof(TelemetryRecord);
+    int ret = 0;
+
+    if (buf_.empty())
+        return 0;
+    if (fd_ < 0)
+        ret = open();
+    if (!ret && size_ + buf_.size() > cfg_.max_bytes && size_ > header().size())
+        ret = rotate();
+    if (!ret)
+        ret = write_all(buf_.data(), buf_.size());
+    if (!ret && cfg_.sync && fdatasync(fd_) < 0)
+        ret = -errno;
+
+    if (ret) {
+        // Reopen next time rather than appending after a short write
+        if (fd_ >= 0) {
+            close(fd_);
+            fd_ = -1;
+        }
+        dropped_ += records;
+    } else {
+        size_ += buf_.size();
+    }
+    buf_.clear();
+    return ret;
+}
+
+int TelemetryLog::append(const TelemetryRecord &r, int64_t now_ns) {
+    const uint8_t *p = reinterpret_cast<const uint8_t *>(&r);
+
+    if (buf_.empty())
+        first_ns_ = now_ns;
+    buf_.insert(buf_.end(), p, p + sizeof(r));
+
+    if (buf_.size() >= cfg_.flush_bytes ||
+        now_ns - first_ns_ >= static_cast<int64_t>(cfg_.flush_interval_ms) * 1000000)
+        return flush();
+    return 0;
+}
+
+} // namespace battd
@@ -0,0 +1,117 @@
+#ifndef USERSPACE_BATTERYD_TELEMETRY_LOG_H
+#define USERSPACE_BATTERYD_TELEMETRY_LOG_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace battd {
+
+// --- On-disk format (host byte order) ---
+// A file is a header, a table of gauge names and then fixed-size records.
+// Records only ever grow at the end: readers take record_size from the
+// header and ignore bytes past the fields they know.
+constexpr char TELEMETRY_MAGIC[4] = { 'B', 'T', 'L', 'G' };
+constexpr uint16_t TELEMETRY_VERSION = 1;
+constexpr size_t TELEMETRY_NAME_LEN = 16;  // NUL-padded per gauge
+
+struct TelemetryFileHeader {
+    char magic[4];
+    uint16_t version;
+    uint16_t record_size;
+    uint16_t num_gauges;
+    uint16_t name_len;
+    uint32_t reserved;
+};
+static_assert(sizeof(TelemetryFileHeader) == 16, "header layout");
+
+// TelemetryRecord::flags
+constexpr uint8_t TELEMETRY_RATE_VALID = 0x01;
+constexpr uint8_t TELEMETRY_TEMP_VALID = 0x02;
+constexpr uint8_t TELEMETRY_HIBERNATING = 0x04;
+constexpr uint8_t TELEMETRY_PUBLISHED = 0x08;   // queued to the module (passed its filter)
+
+struct TelemetryRecord {
+    int64_t mono_ns;        // sample start, CLOCK_MONOTONIC
+    int64_t wall_ns;        // the same instant, CLOCK_REALTIME
+    uint32_t voltage_uv;
+    int32_t soc_milli;      // 0.001 %
+    int32_t rate_milli;     // 0.001 %/h
+    int32_t temp_mc;
+    int32_t tte_s;          // -1 = unknown
+    int32_t ttf_s;
+    uint16_t raw_voltage;   // register words, see Sample
+    uint16_t raw_soc;
+    uint16_t raw_rate;
+    uint16_t syscalls;
+    uint32_t latency_us;    // job queued -> bus read done
+    uint8_t gauge;          // index into the name table
+    uint8_t chip;           // ChipType
+    uint8_t state;          // ChargeState
+    uint8_t flags;
+};
+static_assert(sizeof(TelemetryRecord) == 56, "record layout");
+
+struct TelemetryLogConfig {
+    std::string path;                   // empty = no log
+    size_t flush_bytes = 64 * 1024;     // flush once this much is buffered
+    unsigned flush_interval_ms = 300000; // or the oldest record is this old
+    uint64_t max_bytes = 16 << 20;      // rotate before a file grows past this
+    unsigned keep = 4;                  // rotated files kept as path.1 .. path.N
+    bool sync = false;                  // fdatasync() after each flush
+};
+
+// --- Append-only telemetry log ---
+// Records are collected in memory and written in one write() per flush,
+// so a unit sampling every 10 s touches flash a few times an hour. The
+// time policy is checked when a record is appended; whatever is buffered
+// at shutdown is flushed by the destructor.
+class TelemetryLog {
+public:
+    TelemetryLog(const TelemetryLogConfig &cfg, std::vector<std::string> gauges);
+    ~TelemetryLog();
+
+    TelemetryLog(const TelemetryLog &) = delete;
+    TelemetryLog &operator=(const TelemetryLog &) = delete;
+
+    // Open (or continue) cfg.path. A file written for a different gauge
+    // set or format is rotated away first. Returns 0 or -errno.
+    int open();
+
+    // Buffer r and flush if the size or time policy says so. Returns 0 or
+    // the -errno of a failed flush, whose records are then dropped.
+    int append(const TelemetryRecord &r, int64_t now_ns);
+
+    // Returns 0 or -errno.
+    int flush();
+
+    uint64_t dropped() const { return dropped_; }
+
+private:
+    std::vector<uint8_t> header() const;
+    int rotate();
+    int write_all(const uint8_t *buf, size_t len);
+
+    TelemetryLogConfig cfg_;
+    std::vector<std::string> gauges_;
+    std::vector<uint8_t> buf_;
+    int fd_ = -1;
+    uint64_t size_ = 0;             // bytes in the current file
+    int64_t first_ns_ = 0;          // monotonic time of the oldest buffered record
+    uint64_t dropped_ = 0;
+};
+
+// CLOCK_REALTIME in ns
+int64_t realtime_ns();
+
+// "2024-05-01T12:00:00.123Z", the time format of every export (battlog,
+// the UDP sink)
+void format_wall(char *buf, size_t len, int64_t wall_ns);
+
+// s with quotes, backslashes and control characters escaped, for a JSON string
+std::string json_escape(const std::string &s);
+
+} // namespace battd
+
+#endif // USERSPACE_BATTERYD_TELEMETRY_LOG_H
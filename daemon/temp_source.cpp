@@ -0,0 +1,51 @@
+#include "temp_source.h"
+
+#include <cerrno>
+#include <cstdlib>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace battd {
+
+TempSource::~TempSource() {
+    if (fd_ >= 0)
+        close(fd_);
+}
+
+int TempSource::read(int *mc, SyscallStats *st) {
+    char buf[32];
+    char *end;
+    ssize_t n;
+    long val;
+
+    if (fd_ < 0) {
+        fd_ = open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+        if (st) st->opens++;
+        if (fd_ < 0)
+            return -errno;
+    }
+
+    n = pread(fd_, buf, sizeof(buf) - 1, 0);
+    if (st) st->reads++;
+    if (n < 0) {
+        int ret = -errno;
+
+        // Sensor driver unbound: reopen by path next time
+        if (ret == -ENODEV || ret == -ENOENT) {
+            close(fd_);
+            if (st) st->closes++;
+            fd_ = -1;
+        }
+        return ret;
+    }
+    buf[n] = '\0';
+
+    val = strtol(buf, &end, 10);
+    if (end == buf)
+        return -EINVAL;
+    *mc = static_cast<int>(val);
+    return 0;
+}
+
+} // namespace battd
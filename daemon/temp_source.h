@@ -0,0 +1,36 @@
+#ifndef USERSPACE_BATTERYD_TEMP_SOURCE_H
+#define USERSPACE_BATTERYD_TEMP_SOURCE_H
+
+#include <string>
+
+#include "syscall_stats.h"
+
+namespace battd {
+
+// --- Battery temperature from a sysfs sensor ---
+// The MAX17048 has no temperature sensor of its own, so the temperature
+// comes from a thermal zone (/sys/class/thermal/thermal_zoneN/temp) or a
+// hwmon channel (/sys/class/hwmon/hwmonN/tempM_input). Both report
+// millidegrees C as text. Like SysfsAttr, the file stays open and is
+// re-read with pread(fd, buf, n, 0).
+class TempSource {
+public:
+    explicit TempSource(std::string path) : path_(std::move(path)) {}
+    ~TempSource();
+
+    TempSource(const TempSource &) = delete;
+    TempSource &operator=(const TempSource &) = delete;
+
+    // Returns 0 with *mc in millidegrees C, or -errno.
+    int read(int *mc, SyscallStats *st);
+
+    const std::string &path() const { return path_; }
+
+private:
+    std::string path_;
+    int fd_ = -1;
+};
+
+} // namespace battd
+
+#endif // USERSPACE_BATTERYD_TEMP_SOURCE_H
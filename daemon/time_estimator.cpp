@@ -0,0 +1,70 @@
+#include "time_estimator.h"
+
+#include <cmath>
+
+namespace battd {
+
+void TimeEstimator::reset() {
+    soc_slope_.reset();
+    have_rate_ = false;
+    deviating_ = 0;
+}
+
+void TimeEstimator::update(double t_s, double soc_pct, bool crate_valid, double crate_pct_h) {
+    double inst;
+
+    soc_ = soc_pct;
+
+    if (crate_valid) {
+        inst = crate_pct_h;
+    } else {
+        soc_slope_.add(t_s, soc_pct);
+        if (!soc_slope_.valid())
+            return;
+        inst = soc_slope_.slope() * 3600.0;
+    }
+
+    if (!have_rate_) {
+        rate_ = inst;
+        last_t_ = t_s;
+        have_rate_ = true;
+        return;
+    }
+
+    // Load change: a sustained jump resets the average to the new level
+    if (std::fabs(inst - rate_) > cfg_.load_change_floor_pct_h &&
+        std::fabs(inst - rate_) > cfg_.load_change_ratio * std::fabs(rate_)) {
+        if (++deviating_ >= cfg_.load_change_samples) {
+            rate_ = inst;
+            deviating_ = 0;
+            last_t_ = t_s;
+            return;
+        }
+    } else {
+        deviating_ = 0;
+    }
+
+    rate_ += (1.0 - std::exp(-(t_s - last_t_) / cfg_.tau_s)) * (inst - rate_);
+    last_t_ = t_s;
+}
+
+static int clamp_time(double s, int max_s) {
+    if (s > max_s) return max_s;
+    return static_cast<int>(s + 0.5);
+}
+
+int TimeEstimator::time_to_empty_s() const {
+    if (!have_rate_ || rate_ > -cfg_.min_rate_pct_h)
+        return -1;
+    return clamp_time(soc_ / -rate_ * 3600.0, cfg_.max_time_s);
+}
+
+int TimeEstimator::time_to_full_s() const {
+    if (!have_rate_ || rate_ < cfg_.min_rate_pct_h)
+        return -1;
+    if (soc_ >= 100.0)
+        return 0;
+    return clamp_time((100.0 - soc_) / rate_ * 3600.0, cfg_.max_time_s);
+}
+
+} // namespace battd
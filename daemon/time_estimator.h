@@ -0,0 +1,55 @@
+#ifndef USERSPACE_BATTERYD_TIME_ESTIMATOR_H
+#define USERSPACE_BATTERYD_TIME_ESTIMATOR_H
+
+#include "slope_estimator.h"
+
+namespace battd {
+
+// --- Time-to-empty / time-to-full estimator ---
+// Works on the charge rate in %/h: the gauge's CRATE register when it has
+// one, otherwise the least-squares slope of SOC over a window. The rate is
+// exponentially smoothed with a time constant (alpha derived from the
+// actual sample spacing). When the instantaneous rate departs from the
+// smoothed one by more than the load-change tolerance for a couple of
+// samples in a row, the average snaps to the new rate instead of crawling
+// towards it, so plugging a charger or starting a heavy load shows up
+// within a sample or two.
+class TimeEstimator {
+public:
+    struct Config {
+        double tau_s = 300.0;               // smoothing time constant
+        double soc_window_s = 1800.0;       // SOC slope window without CRATE
+        double min_rate_pct_h = 0.5;        // below this: no estimate
+        double load_change_ratio = 0.5;     // relative deviation that counts
+        double load_change_floor_pct_h = 2.0; // absolute deviation that counts
+        unsigned load_change_samples = 2;
+        int max_time_s = 7 * 24 * 3600;
+    };
+
+    TimeEstimator() : TimeEstimator(Config()) {}
+    explicit TimeEstimator(const Config &cfg) : cfg_(cfg), soc_slope_(cfg.soc_window_s) {}
+
+    // t_s: monotonic seconds; crate_valid false -> derive rate from SOC.
+    void update(double t_s, double soc_pct, bool crate_valid, double crate_pct_h);
+    void reset();
+
+    bool valid() const { return have_rate_; }
+    double rate_pct_h() const { return rate_; }   // smoothed, + = charging
+
+    // Seconds, or -1 when there is no meaningful estimate.
+    int time_to_empty_s() const;
+    int time_to_full_s() const;
+
+private:
+    Config cfg_;
+    SlopeEstimator soc_slope_;
+    double rate_ = 0.0;
+    double soc_ = 0.0;
+    double last_t_ = 0.0;
+    bool have_rate_ = false;
+    unsigned deviating_ = 0;
+};
+
+} // namespace battd
+
+#endif // USERSPACE_BATTERYD_TIME_ESTIMATOR_H
@@ -0,0 +1,71 @@
+#include "uevent_monitor.h"
+
+#include <cerrno>
+#include <cstring>
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+
+namespace battd {
+
+UeventMonitor::~UeventMonitor() {
+    if (fd_ >= 0)
+        ::close(fd_);
+}
+
+int UeventMonitor::open() {
+    struct sockaddr_nl addr = {};
+
+    fd_ = socket(AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+    if (fd_ < 0)
+        return -errno;
+
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = 1; // kernel broadcast group
+    if (bind(fd_, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) < 0) {
+        int ret = -errno;
+        ::close(fd_);
+        fd_ = -1;
+        return ret;
+    }
+    return 0;
+}
+
+// Kernel messages start with "<action>@<devpath>\0" followed by KEY=VALUE\0 pairs
+static bool parse_header(const char *msg, size_t len, std::string *devpath) {
+    static const char *const actions[] = { "add@", "remove@", "bind@", "unbind@" };
+    const char *end = static_cast<const char *>(memchr(msg, '\0', len));
+    size_t hdr_len = end ? static_cast<size_t>(end - msg) : len;
+
+    for (const char *a : actions) {
+        size_t alen = strlen(a);
+
+        if (hdr_len > alen && strncmp(msg, a, alen) == 0) {
+            devpath->assign(msg + alen, hdr_len - alen);
+            return true;
+        }
+    }
+    return false;
+}
+
+void UeventMonitor::drain(const std::function<void(const std::string &devpath)> &fn,
+                          SyscallStats *st) {
+    char buf[4096];
+    std::string devpath;
+
+    if (fd_ < 0)
+        return;
+
+    for (;;) {
+        ssize_t n = recv(fd_, buf, sizeof(buf), 0);
+
+        if (st) st->reads++;
+        if (n <= 0)
+            break;
+        if (parse_header(buf, static_cast<size_t>(n), &devpath))
+            fn(devpath);
+    }
+}
+
+} // namespace battd
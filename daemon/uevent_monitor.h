@@ -0,0 +1,36 @@
+#ifndef USERSPACE_BATTERYD_UEVENT_MONITOR_H
+#define USERSPACE_BATTERYD_UEVENT_MONITOR_H
+
+#include <functional>
+#include <string>
+
+#include "syscall_stats.h"
+
+namespace battd {
+
+// --- Kernel uevent listener (NETLINK_KOBJECT_UEVENT) ---
+// sysfs does not generate inotify events when devices come and go, so module
+// reloads are picked up from the kernel's add/remove uevents instead.
+class UeventMonitor {
+public:
+    UeventMonitor() = default;
+    ~UeventMonitor();
+
+    UeventMonitor(const UeventMonitor &) = delete;
+    UeventMonitor &operator=(const UeventMonitor &) = delete;
+
+    // Returns 0 or -errno. Needs CAP_NET_ADMIN or root on most systems.
+    int open();
+    int fd() const { return fd_; }
+
+    // Read all queued messages and call fn with the devpath (e.g.
+    // "/devices/platform/userspace_battery") of every add/remove/bind/unbind.
+    void drain(const std::function<void(const std::string &devpath)> &fn, SyscallStats *st);
+
+private:
+    int fd_ = -1;
+};
+
+} // namespace battd
+
+#endif // USERSPACE_BATTERYD_UEVENT_MONITOR_H
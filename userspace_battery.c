@@ -5,111 +5,1175 @@
 #include <linux/sysfs.h>        // sysfs functions
 #include <linux/kobject.h>      // kobject
 #include <linux/kstrtox.h>      // kstrtoint, kstrtou64
-#include <linux/string.h>       // strncasecmp, strncpy
+#include <linux/string.h>       // memmove, strncasecmp, sysfs_match_string
 #include <linux/mutex.h>        // mutex
 #include <linux/power_supply.h> // power_supply framework
 #include <linux/platform_device.h>// platform device/driver
 #include <linux/err.h>          // IS_ERR, PTR_ERR
+#include <linux/moduleparam.h>  // module_param
+#include <linux/hrtimer.h>      // freshness watchdog
+#include <linux/ktime.h>        // ktime_get
+#include <linux/workqueue.h>    // deferring watchdog expiry out of hardirq
+#include <linux/thermal.h>      // battery thermal zone
+#include <linux/sort.h>         // sorting OCV table entries
+#include <linux/pm.h>           // suspend/resume callbacks
+
+#include "userspace_battery.h"  // Binary attribute layouts shared with userspace
+
+#define USERSPACE_BATT_MAX_INSTANCES 8
+#define USERSPACE_BATT_MEDIAN_MAX_TAPS 9
+#define USERSPACE_BATT_EMA_ONE 1024     // EMA alpha fixed-point scale (Q10)
+
+// Number of virtual batteries to create. Instance 0 keeps the historical
+// names (/sys/devices/platform/userspace_battery, power_supply
+// "userspace_battery"); instance N is "userspace_battery.N" in both places.
+static unsigned int num_batteries = 1;
+module_param(num_batteries, uint, 0444);
+MODULE_PARM_DESC(num_batteries, "Number of userspace batteries to register (1-8, default 1)");
+
+// Defaults for each battery's freshness watchdog (adjustable per battery in sysfs)
+static unsigned int stale_timeout_ms_default;
+module_param_named(stale_timeout_ms, stale_timeout_ms_default, uint, 0644);
+MODULE_PARM_DESC(stale_timeout_ms, "Report status Unknown when no update arrives for this long (ms, 0 = disabled)");
+
+static bool stale_clears_present_default;
+module_param_named(stale_clears_present, stale_clears_present_default, bool, 0644);
+MODULE_PARM_DESC(stale_clears_present, "Also report PRESENT=0 while data is stale (default N)");
+
+// Optional companion charger registered next to each battery
+static char *charger = "none";
+module_param(charger, charp, 0444);
+MODULE_PARM_DESC(charger, "Companion charger power supply: none (default), mains or usb");
+
+// Trip points of each battery's thermal zone, in millidegrees C (0 = no such trip)
+static int temp_trip_passive = 45000;
+module_param(temp_trip_passive, int, 0444);
+MODULE_PARM_DESC(temp_trip_passive, "Passive trip point in m°C (default 45000, 0 = none)");
+
+static int temp_trip_critical;
+module_param(temp_trip_critical, int, 0444);
+MODULE_PARM_DESC(temp_trip_critical, "Critical trip point in m°C, triggers shutdown (default 0 = none)");
+
+// Defaults for each battery's voltage input filter (adjustable per battery in sysfs)
+static unsigned int voltage_median_taps_default = 1;
+module_param_named(voltage_median_taps, voltage_median_taps_default, uint, 0644);
+MODULE_PARM_DESC(voltage_median_taps, "Median filter length for VOLTAGE_NOW (1-9 samples, default 1 = off)");
+
+static unsigned int voltage_avg_alpha_default = 128;
+module_param_named(voltage_avg_alpha, voltage_avg_alpha_default, uint, 0644);
+MODULE_PARM_DESC(voltage_avg_alpha, "EMA weight of a new sample in VOLTAGE_AVG, in 1/1024 (1-1024, default 128)");
+
+// Open transactions are aborted after this long without a commit
+static unsigned int txn_timeout_ms = 2000;
+module_param(txn_timeout_ms, uint, 0644);
+MODULE_PARM_DESC(txn_timeout_ms, "Abort a transaction not committed within this many ms (default 2000, 0 = never)");
+
+// CAPACITY_LEVEL thresholds in percent, and the default alert window
+static unsigned int capacity_level_critical = 5;
+module_param(capacity_level_critical, uint, 0644);
+MODULE_PARM_DESC(capacity_level_critical, "CAPACITY_LEVEL is Critical at or below this capacity (default 5)");
+
+static unsigned int capacity_level_low = 15;
+module_param(capacity_level_low, uint, 0644);
+MODULE_PARM_DESC(capacity_level_low, "CAPACITY_LEVEL is Low at or below this capacity (default 15)");
+
+static unsigned int capacity_level_high = 80;
+module_param(capacity_level_high, uint, 0644);
+MODULE_PARM_DESC(capacity_level_high, "CAPACITY_LEVEL is High at or above this capacity (default 80)");
+
+static int capacity_alert_min_default = 10;
+module_param_named(capacity_alert_min, capacity_alert_min_default, int, 0644);
+MODULE_PARM_DESC(capacity_alert_min, "Initial CAPACITY_ALERT_MIN in percent (default 10, 0 = off)");
+
+static int capacity_alert_max_default = 100;
+module_param_named(capacity_alert_max, capacity_alert_max_default, int, 0644);
+MODULE_PARM_DESC(capacity_alert_max, "Initial CAPACITY_ALERT_MAX in percent (default 100 = off)");
+
+static bool capacity_uevents = true;
+module_param(capacity_uevents, bool, 0644);
+MODULE_PARM_DESC(capacity_uevents, "Send uevents for plain capacity/voltage/time changes (N: only on level or alert crossings)");
+
+// --- Voltage Input Filter ---
+// Raw samples go through an N-tap median (rejects load spikes) whose output
+// is VOLTAGE_NOW, then an exponential moving average with a Q10 alpha that
+// is VOLTAGE_AVG. Both are constant time per sample: taps is bounded, and
+// the median window is kept sorted so only one element moves per update.
+struct userspace_batt_vfilter {
+    unsigned int taps;              // Median length, 1 = pass through
+    unsigned int count;             // Samples currently in the window
+    unsigned int head;              // Next slot to overwrite in ring[]
+    u64 ring[USERSPACE_BATT_MEDIAN_MAX_TAPS];   // Arrival order
+    u64 sorted[USERSPACE_BATT_MEDIAN_MAX_TAPS]; // Same samples, ascending
+    unsigned int alpha;             // EMA weight of a new sample, Q10
+    s64 avg_q16;                    // EMA state in uV << 16
+    bool have_avg;                  // avg_q16 is seeded
+};
+
+static void userspace_batt_vfilter_reset(struct userspace_batt_vfilter *f) {
+    f->count = 0;
+    f->head = 0;
+    f->have_avg = false;
+}
+
+// Feed one raw sample; returns the median and updates the average.
+static u64 userspace_batt_vfilter_add(struct userspace_batt_vfilter *f, u64 raw) {
+    unsigned int i;
+    u64 median;
+
+    if (f->count == f->taps) {
+        // Window full: drop the oldest sample from the sorted copy
+        u64 old = f->ring[f->head];
+
+        for (i = 0; f->sorted[i] != old; i++)
+            ;
+        memmove(&f->sorted[i], &f->sorted[i + 1], (f->count - i - 1) * sizeof(f->sorted[0]));
+        f->count--;
+    }
+    f->ring[f->head] = raw;
+    f->head = (f->head + 1) % f->taps;
+
+    for (i = f->count; i > 0 && f->sorted[i - 1] > raw; i--)
+        f->sorted[i] = f->sorted[i - 1];
+    f->sorted[i] = raw;
+    f->count++;
+
+    // Even count while the window fills: mean of the two middle samples
+    median = (f->sorted[(f->count - 1) / 2] + f->sorted[f->count / 2]) / 2;
+
+    if (!f->have_avg) {
+        f->avg_q16 = (s64)median << 16;
+        f->have_avg = true;
+    } else {
+        f->avg_q16 += ((((s64)median << 16) - f->avg_q16) * f->alpha) >> 10;
+    }
+    return median;
+}
+
+static u64 userspace_batt_vfilter_avg(const struct userspace_batt_vfilter *f) {
+    return (u64)((f->avg_q16 + (1 << 15)) >> 16);
+}
+
+// --- Producer Update ---
+
+// Fields a producer can write, as a mask
+#define USERSPACE_BATT_F_VOLTAGE  BIT(0)
+#define USERSPACE_BATT_F_CAPACITY BIT(1)
+#define USERSPACE_BATT_F_STATUS   BIT(2)
+#define USERSPACE_BATT_F_TTE      BIT(3)
+#define USERSPACE_BATT_F_TTF      BIT(4)
+#define USERSPACE_BATT_F_TEMP     BIT(5)
+#define USERSPACE_BATT_F_ONLINE   BIT(6)
+// Derived, never written directly
+#define USERSPACE_BATT_F_LEVEL    BIT(7)  // CAPACITY_LEVEL changed
+#define USERSPACE_BATT_F_ALERT    BIT(8)  // An alert threshold was crossed
+// Battery ageing, written rarely by producers that track it
+#define USERSPACE_BATT_F_CYCLES   BIT(9)
+#define USERSPACE_BATT_F_HEALTH   BIT(10)
+#define USERSPACE_BATT_F_FULL     BIT(11) // CHARGE_FULL
+#define USERSPACE_BATT_F_FULL_DESIGN BIT(12)
+
+// Values that drift with every sample; see the capacity_uevents parameter
+#define USERSPACE_BATT_F_QUIET \
+    (USERSPACE_BATT_F_VOLTAGE | USERSPACE_BATT_F_CAPACITY | USERSPACE_BATT_F_TTE | USERSPACE_BATT_F_TTF)
+
+// capacity_alert states
+enum {
+    USERSPACE_BATT_ALERT_NONE,
+    USERSPACE_BATT_ALERT_LOW,       // Below CAPACITY_ALERT_MIN
+    USERSPACE_BATT_ALERT_HIGH,      // Above CAPACITY_ALERT_MAX
+};
+
+// One or more written values; only the fields named in .fields are meaningful
+struct userspace_batt_update {
+    unsigned int fields;            // USERSPACE_BATT_F_*
+    u64 voltage_uv;                 // Raw, before the input filter
+    int capacity;
+    int status_enum;
+    int time_to_empty_s;
+    int time_to_full_s;
+    int temp_dc;
+    bool online;
+    int cycle_count;
+    int health;
+    int charge_full_uah;
+    int charge_full_design_uah;
+};
 
 // --- Module Data Structure ---
 struct userspace_batt_data {
-    u64 voltage_uv;                 // Store voltage in microvolts
+    u64 voltage_uv;                 // Filtered (median) voltage in microvolts
+    struct userspace_batt_vfilter vfilter; // Raw set_voltage_uv samples go through this
     int capacity;                   // Store capacity 0-100
     int status_enum;                // Store status using POWER_SUPPLY_STATUS_* enum
+    int time_to_empty_s;            // Seconds, -1 if unknown (reported as -ENODATA)
+    int time_to_full_s;             // Seconds, -1 if unknown
+    int temp_dc;                    // Tenths of a degree C (POWER_SUPPLY_PROP_TEMP units)
+    bool have_temp;                 // temp_dc was written at least once
+    struct userspace_batt_ocv *ocv; // OCV->capacity curves, NULL if none loaded
+    u64 seq;                        // Bumped under lock on every reader-visible change
+
+    // Ageing, as tracked by the producer; -1 = never written (-ENODATA)
+    int cycle_count;                // Equivalent full cycles
+    int health;                     // POWER_SUPPLY_HEALTH_*
+    int charge_full_uah;            // Faded capacity
+    int charge_full_design_uah;
+
+    // Capacity thresholds: level and alert are re-derived after every change
+    int capacity_alert_min;         // Percent, alert below this (0 = off)
+    int capacity_alert_max;         // Percent, alert above this (100 = off)
+    int capacity_level;             // POWER_SUPPLY_CAPACITY_LEVEL_*
+    int capacity_alert;             // USERSPACE_BATT_ALERT_*
     struct mutex lock;              // Protect data access
 
+    // Freshness watchdog: re-armed on every producer write. On expiry the
+    // battery reads as status Unknown (and optionally not present) until
+    // the next write; the stored values themselves are left untouched.
+    ktime_t last_update;            // ktime_get() of the last producer write
+    bool have_data;                 // At least one write since probe
+    bool stale;                     // Watchdog expired since last write
+    unsigned int stale_timeout_ms;  // 0 = watchdog disabled
+    bool stale_clears_present;      // Report PRESENT=0 while stale
+    struct hrtimer stale_timer;
+    struct work_struct stale_work;  // Expiry handling needs the mutex
+    bool removing;                  // remove() started: writes are refused, no re-arming
+
+    // Open transaction: set_* writes from txn.owner collect in txn.shadow
+    struct {
+        pid_t owner;                // tgid of the writer, 0 = no transaction
+        ktime_t deadline;           // Auto-abort time
+        struct userspace_batt_update shadow;
+    } txn;
+    struct delayed_work txn_work;   // Auto-abort
+
+    // System sleep: values are stale from suspend until the next write
+    unsigned int resume_count;      // Resumes since probe (pollable)
+
+    // Companion charger (only when the charger= parameter asks for one)
+    bool online;                    // External power present (charger ONLINE)
+
     // Kernel objects
     struct platform_device *pdev;   // Our virtual platform device
     struct power_supply *psy;       // Registered power supply device
+    struct power_supply *charger_psy; // Companion charger, NULL if none
+    struct thermal_zone_device *tz; // Battery thermal zone
+};
+
+// --- OCV to Capacity Lookup ---
+
+// One characterised curve, sorted by OCV, with the interpolation slope of
+// every segment precomputed so a lookup is a binary search plus one multiply.
+struct userspace_batt_ocv_curve {
+    int temp_c;
+    unsigned int num_points;
+    u32 ocv_uv[USERSPACE_BATT_OCV_MAX_POINTS];
+    u32 cap_milli[USERSPACE_BATT_OCV_MAX_POINTS];   // Capacity in 0.001 % units
+    u64 slope_q16[USERSPACE_BATT_OCV_MAX_POINTS];   // d(cap_milli)/d(uV) << 16 of segment i..i+1
+};
+
+struct userspace_batt_ocv {
+    unsigned int num_curves;
+    struct userspace_batt_ocv_curve curves[USERSPACE_BATT_OCV_MAX_TEMPS]; // Ascending temp_c
 };
 
-// Global pointer to our data (only one instance expected)
-static struct userspace_batt_data *g_batt_data;
+static int userspace_batt_ocv_entry_cmp(const void *a, const void *b) {
+    const struct userspace_batt_ocv_entry *ea = a, *eb = b;
+
+    if (ea->temp_c != eb->temp_c)
+        return ea->temp_c < eb->temp_c ? -1 : 1;
+    if (ea->ocv_uv != eb->ocv_uv)
+        return ea->ocv_uv < eb->ocv_uv ? -1 : 1;
+    return 0;
+}
+
+// Build lookup curves from entries (sorted in place). Returns 0 or -EINVAL.
+static int userspace_batt_ocv_build(struct userspace_batt_ocv_entry *e, unsigned int n,
+                                    struct userspace_batt_ocv *ocv) {
+    struct userspace_batt_ocv_curve *c = NULL;
+    unsigned int i, j;
+
+    sort(e, n, sizeof(*e), userspace_batt_ocv_entry_cmp, NULL);
+
+    ocv->num_curves = 0;
+    for (i = 0; i < n; i++) {
+        if (e[i].capacity > 100) return -EINVAL;
+
+        if (!c || c->temp_c != e[i].temp_c) {
+            if (ocv->num_curves == USERSPACE_BATT_OCV_MAX_TEMPS) return -EINVAL;
+            c = &ocv->curves[ocv->num_curves++];
+            c->temp_c = e[i].temp_c;
+            c->num_points = 0;
+        } else if (e[i].ocv_uv == c->ocv_uv[c->num_points - 1] ||
+                   e[i].capacity * 1000 < c->cap_milli[c->num_points - 1]) {
+            return -EINVAL; // Duplicate OCV, or capacity falling as OCV rises
+        }
+
+        if (c->num_points == USERSPACE_BATT_OCV_MAX_POINTS) return -EINVAL;
+        c->ocv_uv[c->num_points] = e[i].ocv_uv;
+        c->cap_milli[c->num_points] = e[i].capacity * 1000;
+        c->num_points++;
+    }
+
+    for (i = 0; i < ocv->num_curves; i++) {
+        c = &ocv->curves[i];
+        if (c->num_points < 2) return -EINVAL;
+        for (j = 0; j + 1 < c->num_points; j++)
+            c->slope_q16[j] = div_u64((u64)(c->cap_milli[j + 1] - c->cap_milli[j]) << 16,
+                                      c->ocv_uv[j + 1] - c->ocv_uv[j]);
+    }
+    return 0;
+}
+
+// Capacity (0-100) for a voltage. Picks the curve closest to the battery
+// temperature (25 °C when unknown). Caller holds data->lock.
+static int userspace_batt_ocv_lookup(const struct userspace_batt_data *data, u64 voltage_uv) {
+    const struct userspace_batt_ocv *ocv = data->ocv;
+    const struct userspace_batt_ocv_curve *c = &ocv->curves[0];
+    int temp_dc = data->have_temp ? data->temp_dc : 250;
+    unsigned int i, lo, hi, mid;
+    u64 cap;
+
+    for (i = 1; i < ocv->num_curves; i++) {
+        if (abs(ocv->curves[i].temp_c * 10 - temp_dc) < abs(c->temp_c * 10 - temp_dc))
+            c = &ocv->curves[i];
+    }
+
+    if (voltage_uv <= c->ocv_uv[0])
+        return c->cap_milli[0] / 1000;
+    if (voltage_uv >= c->ocv_uv[c->num_points - 1])
+        return c->cap_milli[c->num_points - 1] / 1000;
+
+    // Find segment lo with ocv_uv[lo] <= voltage_uv < ocv_uv[lo + 1]
+    lo = 0;
+    hi = c->num_points - 1;
+    while (hi - lo > 1) {
+        mid = (lo + hi) / 2;
+        if (c->ocv_uv[mid] <= voltage_uv)
+            lo = mid;
+        else
+            hi = mid;
+    }
+
+    cap = c->cap_milli[lo] + (((voltage_uv - c->ocv_uv[lo]) * c->slope_q16[lo]) >> 16);
+    return min_t(int, DIV_ROUND_CLOSEST_ULL(cap, 1000), 100);
+}
+
+// Platform devices created at init, one per battery instance
+static struct platform_device *g_batt_pdevs[USERSPACE_BATT_MAX_INSTANCES];
+
+// --- Change Notification ---
+
+// Publish a change the caller made (and counted in data->seq) under the
+// lock: the power_supply uevent, plus a sysfs_notify() on seq and snapshot
+// so pollers blocked in poll()/epoll on either file wake up.
+static void userspace_batt_changed(struct userspace_batt_data *data, struct power_supply *psy) {
+    if (psy)
+        power_supply_changed(psy);
+    sysfs_notify(&data->pdev->dev.kobj, NULL, "seq");
+    sysfs_notify(&data->pdev->dev.kobj, NULL, "snapshot");
+}
+
+// --- Capacity Level and Alerts ---
+
+static int userspace_batt_level_of(const struct userspace_batt_data *data) {
+    int cap = data->capacity;
+
+    if (cap < 0)
+        return POWER_SUPPLY_CAPACITY_LEVEL_UNKNOWN; // Nothing written yet
+    if (cap >= 100 || (data->status_enum == POWER_SUPPLY_STATUS_FULL && !data->stale))
+        return POWER_SUPPLY_CAPACITY_LEVEL_FULL;
+    if (cap <= READ_ONCE(capacity_level_critical))
+        return POWER_SUPPLY_CAPACITY_LEVEL_CRITICAL;
+    if (cap <= READ_ONCE(capacity_level_low))
+        return POWER_SUPPLY_CAPACITY_LEVEL_LOW;
+    if (cap >= READ_ONCE(capacity_level_high))
+        return POWER_SUPPLY_CAPACITY_LEVEL_HIGH;
+    return POWER_SUPPLY_CAPACITY_LEVEL_NORMAL;
+}
+
+// Re-derive CAPACITY_LEVEL and the alert state. Caller holds data->lock.
+// Returns USERSPACE_BATT_F_LEVEL / _ALERT for whichever one moved.
+static unsigned int userspace_batt_update_level(struct userspace_batt_data *data) {
+    unsigned int changed = 0;
+    int level = userspace_batt_level_of(data);
+    int alert = USERSPACE_BATT_ALERT_NONE;
+
+    if (data->capacity >= 0 && data->capacity < data->capacity_alert_min)
+        alert = USERSPACE_BATT_ALERT_LOW;
+    else if (data->capacity > data->capacity_alert_max)
+        alert = USERSPACE_BATT_ALERT_HIGH;
+
+    if (level != data->capacity_level) {
+        data->capacity_level = level;
+        changed |= USERSPACE_BATT_F_LEVEL;
+    }
+    if (alert != data->capacity_alert) {
+        data->capacity_alert = alert;
+        changed |= USERSPACE_BATT_F_ALERT;
+    }
+    return changed;
+}
+
+// --- Freshness Watchdog ---
+
+// Record a producer write and re-arm the watchdog. Caller holds data->lock.
+// Returns true if the battery was stale, i.e. what readers see changes even
+// if the written value is the same as before. Once remove() has started the
+// watchdog stays down: the timer lives in data, which devm frees.
+static bool userspace_batt_mark_fresh(struct userspace_batt_data *data) {
+    bool was_stale = data->stale;
+
+    data->last_update = ktime_get();
+    data->have_data = true;
+    data->stale = false;
+    if (data->stale_timeout_ms && !data->removing)
+        hrtimer_start(&data->stale_timer, ms_to_ktime(data->stale_timeout_ms), HRTIMER_MODE_REL);
+    return was_stale;
+}
+
+static enum hrtimer_restart userspace_batt_stale_timer_fn(struct hrtimer *timer) {
+    struct userspace_batt_data *data = container_of(timer, struct userspace_batt_data, stale_timer);
+
+    // Hardirq context: the state is mutex protected, so finish in process context
+    schedule_work(&data->stale_work);
+    return HRTIMER_NORESTART;
+}
+
+static void userspace_batt_stale_work_fn(struct work_struct *work) {
+    struct userspace_batt_data *data = container_of(work, struct userspace_batt_data, stale_work);
+    bool notify = false;
+
+    mutex_lock(&data->lock);
+    // A write may have raced with the expiry; only go stale if it really is
+    if (!data->stale && data->stale_timeout_ms &&
+        (!data->have_data ||
+         ktime_ms_delta(ktime_get(), data->last_update) >= data->stale_timeout_ms)) {
+        data->stale = true;
+        userspace_batt_update_level(data); // A stale Full is no longer Full
+        data->seq++;
+        notify = true;
+    }
+    mutex_unlock(&data->lock);
+
+    if (notify) {
+        dev_warn(&data->pdev->dev, "userspace_battery: No update for %u ms, reporting status Unknown\n",
+                 data->stale_timeout_ms);
+        userspace_batt_changed(data, data->psy); // Exactly one notification per expiry
+    }
+}
+
+// --- Producer Updates ---
+
+// Apply a set of producer-written fields. Caller holds data->lock.
+// Temperature goes first because it selects the OCV curve for the voltage.
+// Returns the USERSPACE_BATT_F_* fields whose reported value changed (and
+// bumps seq once if any did).
+static unsigned int userspace_batt_apply(struct userspace_batt_data *data,
+                                         const struct userspace_batt_update *u) {
+    unsigned int changed = 0;
+
+    if ((u->fields & USERSPACE_BATT_F_TEMP) && (!data->have_temp || data->temp_dc != u->temp_dc)) {
+        data->temp_dc = u->temp_dc;
+        data->have_temp = true;
+        changed |= USERSPACE_BATT_F_TEMP;
+    }
+    if (u->fields & USERSPACE_BATT_F_VOLTAGE) {
+        u64 filtered = userspace_batt_vfilter_add(&data->vfilter, u->voltage_uv);
+
+        if (!data->have_data || filtered != data->voltage_uv) {
+            data->voltage_uv = filtered;
+            changed |= USERSPACE_BATT_F_VOLTAGE;
+        }
+        // With an OCV table loaded, a voltage-only producer gets capacity for free
+        if (data->ocv) {
+            int cap = userspace_batt_ocv_lookup(data, filtered);
+
+            if (cap != data->capacity) {
+                data->capacity = cap;
+                changed |= USERSPACE_BATT_F_CAPACITY;
+            }
+        }
+    }
+    if ((u->fields & USERSPACE_BATT_F_CAPACITY) && data->capacity != u->capacity) {
+        data->capacity = u->capacity;
+        changed |= USERSPACE_BATT_F_CAPACITY;
+    }
+    if ((u->fields & USERSPACE_BATT_F_STATUS) && data->status_enum != u->status_enum) {
+        data->status_enum = u->status_enum;
+        changed |= USERSPACE_BATT_F_STATUS;
+    }
+    if ((u->fields & USERSPACE_BATT_F_TTE) && data->time_to_empty_s != u->time_to_empty_s) {
+        data->time_to_empty_s = u->time_to_empty_s;
+        changed |= USERSPACE_BATT_F_TTE;
+    }
+    if ((u->fields & USERSPACE_BATT_F_TTF) && data->time_to_full_s != u->time_to_full_s) {
+        data->time_to_full_s = u->time_to_full_s;
+        changed |= USERSPACE_BATT_F_TTF;
+    }
+    if ((u->fields & USERSPACE_BATT_F_ONLINE) && data->online != u->online) {
+        data->online = u->online;
+        changed |= USERSPACE_BATT_F_ONLINE;
+    }
+    if ((u->fields & USERSPACE_BATT_F_CYCLES) && data->cycle_count != u->cycle_count) {
+        data->cycle_count = u->cycle_count;
+        changed |= USERSPACE_BATT_F_CYCLES;
+    }
+    if ((u->fields & USERSPACE_BATT_F_HEALTH) && data->health != u->health) {
+        data->health = u->health;
+        changed |= USERSPACE_BATT_F_HEALTH;
+    }
+    if ((u->fields & USERSPACE_BATT_F_FULL) && data->charge_full_uah != u->charge_full_uah) {
+        data->charge_full_uah = u->charge_full_uah;
+        changed |= USERSPACE_BATT_F_FULL;
+    }
+    if ((u->fields & USERSPACE_BATT_F_FULL_DESIGN) &&
+        data->charge_full_design_uah != u->charge_full_design_uah) {
+        data->charge_full_design_uah = u->charge_full_design_uah;
+        changed |= USERSPACE_BATT_F_FULL_DESIGN;
+    }
+
+    if (userspace_batt_mark_fresh(data))
+        changed |= USERSPACE_BATT_F_STATUS; // Leaving stale changes the reported status
+    if (changed)
+        changed |= userspace_batt_update_level(data);
+    if (changed)
+        data->seq++;
+    return changed;
+}
+
+// Signal what userspace_batt_apply() changed. Call without data->lock.
+static void userspace_batt_notify(struct userspace_batt_data *data, unsigned int changed) {
+    if (!changed)
+        return;
+
+    // Crossing an alert threshold is the one thing capacity_alert pollers wait for
+    if (changed & USERSPACE_BATT_F_ALERT)
+        sysfs_notify(&data->pdev->dev.kobj, NULL, "capacity_alert");
+
+    if (!READ_ONCE(capacity_uevents) && !(changed & ~USERSPACE_BATT_F_QUIET)) {
+        // Only drifting values moved: wake seq/snapshot pollers, no uevent
+        userspace_batt_changed(data, NULL);
+    } else if (changed & USERSPACE_BATT_F_ONLINE) {
+        // The charger's notification reaches the battery through supplied_to
+        // (external_power_changed), so consumers see both in one chain
+        userspace_batt_changed(data, data->charger_psy);
+    } else {
+        userspace_batt_changed(data, data->psy);
+    }
+    // Let the thermal core re-evaluate trips with the new sample
+    if ((changed & USERSPACE_BATT_F_TEMP) && data->tz)
+        thermal_zone_device_update(data->tz, THERMAL_EVENT_TEMP_SAMPLE);
+}
+
+// Take one producer write: staged if the writing process has a transaction
+// open, applied and notified right away otherwise. -ENODEV once remove()
+// has started.
+static int userspace_batt_submit(struct userspace_batt_data *data,
+                                 const struct userspace_batt_update *u) {
+    struct userspace_batt_update *shadow = &data->txn.shadow;
+    unsigned int changed;
+
+    mutex_lock(&data->lock);
+    if (data->removing) {
+        mutex_unlock(&data->lock);
+        return -ENODEV;
+    }
+    if (data->txn.owner && data->txn.owner == task_tgid_nr(current)) {
+        if (u->fields & USERSPACE_BATT_F_VOLTAGE) shadow->voltage_uv = u->voltage_uv;
+        if (u->fields & USERSPACE_BATT_F_CAPACITY) shadow->capacity = u->capacity;
+        if (u->fields & USERSPACE_BATT_F_STATUS) shadow->status_enum = u->status_enum;
+        if (u->fields & USERSPACE_BATT_F_TTE) shadow->time_to_empty_s = u->time_to_empty_s;
+        if (u->fields & USERSPACE_BATT_F_TTF) shadow->time_to_full_s = u->time_to_full_s;
+        if (u->fields & USERSPACE_BATT_F_TEMP) shadow->temp_dc = u->temp_dc;
+        if (u->fields & USERSPACE_BATT_F_ONLINE) shadow->online = u->online;
+        if (u->fields & USERSPACE_BATT_F_CYCLES) shadow->cycle_count = u->cycle_count;
+        if (u->fields & USERSPACE_BATT_F_HEALTH) shadow->health = u->health;
+        if (u->fields & USERSPACE_BATT_F_FULL) shadow->charge_full_uah = u->charge_full_uah;
+        if (u->fields & USERSPACE_BATT_F_FULL_DESIGN)
+            shadow->charge_full_design_uah = u->charge_full_design_uah;
+        shadow->fields |= u->fields;
+        mutex_unlock(&data->lock);
+        return 0;
+    }
+    changed = userspace_batt_apply(data, u);
+    mutex_unlock(&data->lock);
+
+    userspace_batt_notify(data, changed);
+    return 0;
+}
+
+// --- Property Writes ---
+
+// Validate one written property and submit it. Shared by the power_supply
+// set_property callbacks (class attributes, parsed by the core) and the
+// legacy set_* attributes of the platform device.
+static int userspace_batt_write_property(struct userspace_batt_data *data,
+                                         enum power_supply_property psp,
+                                         const union power_supply_propval *val) {
+    struct userspace_batt_update u = { 0 };
+
+    switch (psp) {
+    case POWER_SUPPLY_PROP_VOLTAGE_NOW: // uV
+        if (val->intval < 0) return -EINVAL;
+        u.fields = USERSPACE_BATT_F_VOLTAGE;
+        u.voltage_uv = val->intval;
+        break;
+    case POWER_SUPPLY_PROP_CAPACITY: // 0-100
+        if (val->intval < 0 || val->intval > 100) return -EINVAL;
+        u.fields = USERSPACE_BATT_F_CAPACITY;
+        u.capacity = val->intval;
+        break;
+    case POWER_SUPPLY_PROP_STATUS:
+        if (val->intval < POWER_SUPPLY_STATUS_UNKNOWN || val->intval > POWER_SUPPLY_STATUS_FULL)
+            return -EINVAL;
+        u.fields = USERSPACE_BATT_F_STATUS;
+        u.status_enum = val->intval;
+        break;
+    case POWER_SUPPLY_PROP_TIME_TO_EMPTY_NOW: // Seconds, -1 = unknown
+        if (val->intval < -1) return -EINVAL;
+        u.fields = USERSPACE_BATT_F_TTE;
+        u.time_to_empty_s = val->intval;
+        break;
+    case POWER_SUPPLY_PROP_TIME_TO_FULL_NOW:
+        if (val->intval < -1) return -EINVAL;
+        u.fields = USERSPACE_BATT_F_TTF;
+        u.time_to_full_s = val->intval;
+        break;
+    case POWER_SUPPLY_PROP_TEMP: // Tenths of a degree C
+        if (val->intval < -2731 || val->intval > 2000) return -ERANGE; // Below absolute zero or above 200 °C
+        u.fields = USERSPACE_BATT_F_TEMP;
+        u.temp_dc = val->intval;
+        break;
+    case POWER_SUPPLY_PROP_ONLINE: // Companion charger only
+        if (!data->charger_psy) return -ENODEV;
+        u.fields = USERSPACE_BATT_F_ONLINE;
+        u.online = !!val->intval;
+        break;
+    case POWER_SUPPLY_PROP_CYCLE_COUNT:
+        if (val->intval < 0) return -EINVAL;
+        u.fields = USERSPACE_BATT_F_CYCLES;
+        u.cycle_count = val->intval;
+        break;
+    case POWER_SUPPLY_PROP_HEALTH:
+        if (val->intval < POWER_SUPPLY_HEALTH_UNKNOWN || val->intval > POWER_SUPPLY_HEALTH_COLD)
+            return -EINVAL;
+        u.fields = USERSPACE_BATT_F_HEALTH;
+        u.health = val->intval;
+        break;
+    case POWER_SUPPLY_PROP_CHARGE_FULL: // uAh
+        if (val->intval < 0) return -EINVAL;
+        u.fields = USERSPACE_BATT_F_FULL;
+        u.charge_full_uah = val->intval;
+        break;
+    case POWER_SUPPLY_PROP_CHARGE_FULL_DESIGN:
+        if (val->intval < 0) return -EINVAL;
+        u.fields = USERSPACE_BATT_F_FULL_DESIGN;
+        u.charge_full_design_uah = val->intval;
+        break;
+    case POWER_SUPPLY_PROP_CAPACITY_ALERT_MIN:
+    case POWER_SUPPLY_PROP_CAPACITY_ALERT_MAX: {
+        // Configuration rather than battery state: never staged, no heartbeat
+        unsigned int changed;
+
+        if (val->intval < 0 || val->intval > 100) return -EINVAL;
+        mutex_lock(&data->lock);
+        if (data->removing) {
+            mutex_unlock(&data->lock);
+            return -ENODEV;
+        }
+        if (psp == POWER_SUPPLY_PROP_CAPACITY_ALERT_MIN)
+            data->capacity_alert_min = val->intval;
+        else
+            data->capacity_alert_max = val->intval;
+        changed = userspace_batt_update_level(data);
+        if (changed)
+            data->seq++;
+        mutex_unlock(&data->lock);
+
+        userspace_batt_notify(data, changed);
+        return 0;
+    }
+    default:
+        return -EINVAL;
+    }
+
+    return userspace_batt_submit(data, &u);
+}
+
+static int userspace_batt_set_property(struct power_supply *psy,
+                                       enum power_supply_property psp,
+                                       const union power_supply_propval *val) {
+    struct userspace_batt_data *data = power_supply_get_drvdata(psy);
+
+    if (!data) return -ENODEV;
+    return userspace_batt_write_property(data, psp, val);
+}
+
+static int userspace_batt_property_is_writeable(struct power_supply *psy,
+                                                enum power_supply_property psp) {
+    switch (psp) {
+    case POWER_SUPPLY_PROP_VOLTAGE_NOW:
+    case POWER_SUPPLY_PROP_CAPACITY:
+    case POWER_SUPPLY_PROP_STATUS:
+    case POWER_SUPPLY_PROP_TIME_TO_EMPTY_NOW:
+    case POWER_SUPPLY_PROP_TIME_TO_FULL_NOW:
+    case POWER_SUPPLY_PROP_TEMP:
+    case POWER_SUPPLY_PROP_CAPACITY_ALERT_MIN:
+    case POWER_SUPPLY_PROP_CAPACITY_ALERT_MAX:
+    case POWER_SUPPLY_PROP_CYCLE_COUNT:
+    case POWER_SUPPLY_PROP_HEALTH:
+    case POWER_SUPPLY_PROP_CHARGE_FULL:
+    case POWER_SUPPLY_PROP_CHARGE_FULL_DESIGN:
+        return 1;
+    default:
+        return 0;
+    }
+}
 
 // --- Sysfs 'store' Functions (Write from userspace) ---
+// Legacy spellings of the writable class attributes, kept for existing
+// producers. Each one parses its value and goes through the same path.
 
-// Store voltage (expects microvolts)
-static ssize_t set_voltage_uv_store(struct device *dev, struct device_attribute *attr,
-                                    const char *buf, size_t count) {
-    u64 val;
+static ssize_t store_property(struct device *dev, const char *buf, size_t count,
+                              enum power_supply_property psp) {
+    struct userspace_batt_data *data = dev_get_drvdata(dev);
+    union power_supply_propval val;
     int ret;
 
-    // Get the private data from the platform device's driver_data
-    // Note: In this structure, it's easier to just use the global g_batt_data
-    if (!g_batt_data) return -ENODEV; // Should not happen if loaded correctly
+    if (!data) return -ENODEV; // Should not happen if probed correctly
 
-    ret = kstrtou64(buf, 0, &val);
+    ret = kstrtoint(buf, 0, &val.intval);
     if (ret) return ret;
 
-    mutex_lock(&g_batt_data->lock);
-    g_batt_data->voltage_uv = val;
-    mutex_unlock(&g_batt_data->lock);
+    ret = userspace_batt_write_property(data, psp, &val);
+    return ret ? ret : count;
+}
 
-    // Notify the power_supply framework that a property may have changed
-    power_supply_changed(g_batt_data->psy);
-    return count;
+// Store voltage (expects microvolts)
+static ssize_t set_voltage_uv_store(struct device *dev, struct device_attribute *attr,
+                                    const char *buf, size_t count) {
+    return store_property(dev, buf, count, POWER_SUPPLY_PROP_VOLTAGE_NOW);
 }
 
 // Store capacity (expects 0-100)
 static ssize_t set_capacity_store(struct device *dev, struct device_attribute *attr,
                                   const char *buf, size_t count) {
-    int val;
+    return store_property(dev, buf, count, POWER_SUPPLY_PROP_CAPACITY);
+}
+
+// Store status string, spelled as the class 'status' attribute shows it.
+// Matched case-insensitively ("charging", "FULL") as this node always has;
+// anything unrecognised still maps to Unknown.
+static ssize_t set_status_store(struct device *dev, struct device_attribute *attr,
+                                const char *buf, size_t count) {
+    // Indexed by POWER_SUPPLY_STATUS_*. The power_supply core keeps its own
+    // table and parser private, so the ABI strings are repeated here.
+    static const char *const status_text[] = {
+        [POWER_SUPPLY_STATUS_UNKNOWN] = "Unknown",
+        [POWER_SUPPLY_STATUS_CHARGING] = "Charging",
+        [POWER_SUPPLY_STATUS_DISCHARGING] = "Discharging",
+        [POWER_SUPPLY_STATUS_NOT_CHARGING] = "Not charging",
+        [POWER_SUPPLY_STATUS_FULL] = "Full",
+    };
+    struct userspace_batt_data *data = dev_get_drvdata(dev);
+    union power_supply_propval val = { .intval = POWER_SUPPLY_STATUS_UNKNOWN };
+    size_t len = count;
+    unsigned int i;
     int ret;
 
-    if (!g_batt_data) return -ENODEV;
+    if (!data) return -ENODEV;
 
-    ret = kstrtoint(buf, 0, &val);
+    // Trim trailing newline if present
+    if (len > 0 && buf[len - 1] == '\n')
+        len--;
+
+    for (i = 0; i < ARRAY_SIZE(status_text); i++) {
+        if (strlen(status_text[i]) == len && !strncasecmp(buf, status_text[i], len)) {
+            val.intval = i;
+            break;
+        }
+    }
+
+    ret = userspace_batt_write_property(data, POWER_SUPPLY_PROP_STATUS, &val);
+    return ret ? ret : count;
+}
+
+// Store a remaining-time estimate in seconds (-1 = unknown)
+static ssize_t set_time_to_empty_store(struct device *dev, struct device_attribute *attr,
+                                       const char *buf, size_t count) {
+    return store_property(dev, buf, count, POWER_SUPPLY_PROP_TIME_TO_EMPTY_NOW);
+}
+
+static ssize_t set_time_to_full_store(struct device *dev, struct device_attribute *attr,
+                                      const char *buf, size_t count) {
+    return store_property(dev, buf, count, POWER_SUPPLY_PROP_TIME_TO_FULL_NOW);
+}
+
+// Store battery temperature (expects tenths of a degree C, like the TEMP property)
+static ssize_t set_temp_store(struct device *dev, struct device_attribute *attr,
+                              const char *buf, size_t count) {
+    return store_property(dev, buf, count, POWER_SUPPLY_PROP_TEMP);
+}
+
+// Store external power state (expects 0/1), only present with a companion charger
+static ssize_t set_online_store(struct device *dev, struct device_attribute *attr,
+                                const char *buf, size_t count) {
+    struct userspace_batt_data *data = dev_get_drvdata(dev);
+    union power_supply_propval val;
+    bool online;
+    int ret;
+
+    if (!data) return -ENODEV;
+
+    ret = kstrtobool(buf, &online);
     if (ret) return ret;
-    if (val < 0 || val > 100) return -EINVAL; // Basic validation
 
-    mutex_lock(&g_batt_data->lock);
-    g_batt_data->capacity = val;
-    mutex_unlock(&g_batt_data->lock);
+    val.intval = online;
+    ret = userspace_batt_write_property(data, POWER_SUPPLY_PROP_ONLINE, &val);
+    return ret ? ret : count;
+}
 
-    power_supply_changed(g_batt_data->psy);
-    return count;
+// Store the equivalent full cycle count
+static ssize_t set_cycle_count_store(struct device *dev, struct device_attribute *attr,
+                                     const char *buf, size_t count) {
+    return store_property(dev, buf, count, POWER_SUPPLY_PROP_CYCLE_COUNT);
 }
 
-// Store status string
-static ssize_t set_status_store(struct device *dev, struct device_attribute *attr,
+// Store health, spelled as the class 'health' attribute shows it
+static ssize_t set_health_store(struct device *dev, struct device_attribute *attr,
                                 const char *buf, size_t count) {
-    int new_status = POWER_SUPPLY_STATUS_UNKNOWN; // Default
-    size_t len = count;
-    bool changed = false;
+    // Indexed by POWER_SUPPLY_HEALTH_*; the ones a battery producer can know
+    static const char *const health_text[] = {
+        [POWER_SUPPLY_HEALTH_UNKNOWN] = "Unknown",
+        [POWER_SUPPLY_HEALTH_GOOD] = "Good",
+        [POWER_SUPPLY_HEALTH_OVERHEAT] = "Overheat",
+        [POWER_SUPPLY_HEALTH_DEAD] = "Dead",
+        [POWER_SUPPLY_HEALTH_OVERVOLTAGE] = "Over voltage",
+        [POWER_SUPPLY_HEALTH_UNSPEC_FAILURE] = "Unspecified failure",
+        [POWER_SUPPLY_HEALTH_COLD] = "Cold",
+    };
+    struct userspace_batt_data *data = dev_get_drvdata(dev);
+    union power_supply_propval val;
+    int ret;
 
-    if (!g_batt_data) return -ENODEV;
+    if (!data) return -ENODEV;
 
-    // Trim trailing newline if present
-    if (len > 0 && buf[len - 1] == '\n') {
-        len--;
+    ret = sysfs_match_string(health_text, buf);
+    if (ret < 0) return -EINVAL;
+    val.intval = ret;
+
+    ret = userspace_batt_write_property(data, POWER_SUPPLY_PROP_HEALTH, &val);
+    return ret ? ret : count;
+}
+
+// Store the full and design capacities (expects microampere-hours)
+static ssize_t set_charge_full_store(struct device *dev, struct device_attribute *attr,
+                                     const char *buf, size_t count) {
+    return store_property(dev, buf, count, POWER_SUPPLY_PROP_CHARGE_FULL);
+}
+
+static ssize_t set_charge_full_design_store(struct device *dev, struct device_attribute *attr,
+                                            const char *buf, size_t count) {
+    return store_property(dev, buf, count, POWER_SUPPLY_PROP_CHARGE_FULL_DESIGN);
+}
+
+// --- Transactions ---
+// "begin" makes the writing process (by tgid, so every builtin echo of a
+// shell script counts) the owner: its set_* writes are staged instead of
+// applied. "commit" applies them all under one lock with one seq step and
+// one notification; "abort" drops them. Other processes keep writing
+// straight through. A transaction still open after txn_timeout_ms is
+// aborted, so a producer killed half way cannot wedge the battery.
+
+static void userspace_batt_txn_timeout_fn(struct work_struct *work) {
+    struct userspace_batt_data *data =
+        container_of(to_delayed_work(work), struct userspace_batt_data, txn_work);
+    pid_t owner = 0;
+
+    mutex_lock(&data->lock);
+    // A newer transaction has a later deadline; leave it alone
+    if (data->txn.owner && ktime_compare(ktime_get(), data->txn.deadline) >= 0) {
+        owner = data->txn.owner;
+        data->txn.owner = 0;
     }
+    mutex_unlock(&data->lock);
+
+    if (owner)
+        dev_warn(&data->pdev->dev, "userspace_battery: Transaction of pid %d timed out, aborted\n", owner);
+}
+
+static ssize_t transaction_show(struct device *dev, struct device_attribute *attr, char *buf) {
+    struct userspace_batt_data *data = dev_get_drvdata(dev);
+    pid_t owner;
 
-    // Convert string to enum (case-insensitive)
-    if (strncasecmp(buf, "Charging", len) == 0) {
-        new_status = POWER_SUPPLY_STATUS_CHARGING;
-    } else if (strncasecmp(buf, "Discharging", len) == 0) {
-        new_status = POWER_SUPPLY_STATUS_DISCHARGING;
-    } else if (strncasecmp(buf, "Full", len) == 0) {
-        new_status = POWER_SUPPLY_STATUS_FULL;
-    } else if (strncasecmp(buf, "Not charging", len) == 0) {
-        new_status = POWER_SUPPLY_STATUS_NOT_CHARGING;
-    } else { // Any other string maps to Unknown
-        new_status = POWER_SUPPLY_STATUS_UNKNOWN;
+    if (!data) return -ENODEV;
+
+    mutex_lock(&data->lock);
+    owner = data->txn.owner;
+    mutex_unlock(&data->lock);
+
+    if (!owner)
+        return sysfs_emit(buf, "idle\n");
+    return sysfs_emit(buf, "open %d\n", owner);
+}
+
+static ssize_t transaction_store(struct device *dev, struct device_attribute *attr,
+                                 const char *buf, size_t count) {
+    struct userspace_batt_data *data = dev_get_drvdata(dev);
+    pid_t tgid = task_tgid_nr(current);
+    struct userspace_batt_update staged;
+    unsigned int changed = 0;
+    unsigned int timeout_ms = READ_ONCE(txn_timeout_ms);
+    int ret = 0;
+
+    if (!data) return -ENODEV;
+
+    mutex_lock(&data->lock);
+    if (data->removing) {
+        ret = -ENODEV;
+    } else if (sysfs_streq(buf, "begin")) {
+        if (data->txn.owner) {
+            ret = -EBUSY; // One writer at a time, including a second begin
+        } else {
+            memset(&data->txn.shadow, 0, sizeof(data->txn.shadow));
+            data->txn.owner = tgid;
+            data->txn.deadline = timeout_ms ? ktime_add_ms(ktime_get(), timeout_ms) : KTIME_MAX;
+            if (timeout_ms)
+                mod_delayed_work(system_wq, &data->txn_work, msecs_to_jiffies(timeout_ms));
+        }
+    } else if (sysfs_streq(buf, "commit") || sysfs_streq(buf, "abort")) {
+        if (!data->txn.owner) {
+            ret = -EINVAL;
+        } else if (data->txn.owner != tgid) {
+            ret = -EPERM;
+        } else {
+            data->txn.owner = 0;
+            cancel_delayed_work(&data->txn_work);
+            staged = data->txn.shadow;
+            if (buf[0] == 'c' && staged.fields)
+                changed = userspace_batt_apply(data, &staged);
+        }
+    } else {
+        ret = -EINVAL;
     }
+    mutex_unlock(&data->lock);
+
+    userspace_batt_notify(data, changed);
+    return ret ? ret : count;
+}
+
+// --- Change Sequence Attribute ---
+
+// Update sequence number. Pollable: wait for POLLPRI, then seek to 0 and
+// read again; a jump of more than one means updates were coalesced.
+static ssize_t seq_show(struct device *dev, struct device_attribute *attr, char *buf) {
+    struct userspace_batt_data *data = dev_get_drvdata(dev);
+    u64 seq;
+
+    if (!data) return -ENODEV;
+
+    mutex_lock(&data->lock);
+    seq = data->seq;
+    mutex_unlock(&data->lock);
+
+    return sysfs_emit(buf, "%llu\n", seq);
+}
+
+// --- Capacity Alert Attribute ---
+
+// none, low or high. Pollable: notified only when an alert threshold is crossed
+static ssize_t capacity_alert_show(struct device *dev, struct device_attribute *attr, char *buf) {
+    static const char *const alert_text[] = {
+        [USERSPACE_BATT_ALERT_NONE] = "none",
+        [USERSPACE_BATT_ALERT_LOW] = "low",
+        [USERSPACE_BATT_ALERT_HIGH] = "high",
+    };
+    struct userspace_batt_data *data = dev_get_drvdata(dev);
+    int alert;
+
+    if (!data) return -ENODEV;
+
+    mutex_lock(&data->lock);
+    alert = data->capacity_alert;
+    mutex_unlock(&data->lock);
+
+    return sysfs_emit(buf, "%s\n", alert_text[alert]);
+}
+
+// --- Resume Attribute ---
 
-    mutex_lock(&g_batt_data->lock);
-    if (g_batt_data->status_enum != new_status) {
-        g_batt_data->status_enum = new_status;
-        changed = true;
+// Number of system resumes since probe. Pollable: producers wait for
+// POLLPRI to resample at once and drop history that spans the sleep.
+static ssize_t resume_count_show(struct device *dev, struct device_attribute *attr, char *buf) {
+    struct userspace_batt_data *data = dev_get_drvdata(dev);
+
+    if (!data) return -ENODEV;
+    return sysfs_emit(buf, "%u\n", READ_ONCE(data->resume_count));
+}
+
+// --- Watchdog Attributes ---
+
+// Milliseconds since the last producer write, -1 if nothing was written yet
+static ssize_t data_age_ms_show(struct device *dev, struct device_attribute *attr, char *buf) {
+    struct userspace_batt_data *data = dev_get_drvdata(dev);
+    s64 age = -1;
+
+    if (!data) return -ENODEV;
+
+    mutex_lock(&data->lock);
+    if (data->have_data)
+        age = ktime_ms_delta(ktime_get(), data->last_update);
+    mutex_unlock(&data->lock);
+
+    return sysfs_emit(buf, "%lld\n", age);
+}
+
+static ssize_t stale_timeout_ms_show(struct device *dev, struct device_attribute *attr, char *buf) {
+    struct userspace_batt_data *data = dev_get_drvdata(dev);
+
+    if (!data) return -ENODEV;
+    return sysfs_emit(buf, "%u\n", READ_ONCE(data->stale_timeout_ms));
+}
+
+static ssize_t stale_timeout_ms_store(struct device *dev, struct device_attribute *attr,
+                                      const char *buf, size_t count) {
+    struct userspace_batt_data *data = dev_get_drvdata(dev);
+    unsigned int val;
+    int ret;
+
+    if (!data) return -ENODEV;
+
+    ret = kstrtouint(buf, 0, &val);
+    if (ret) return ret;
+
+    mutex_lock(&data->lock);
+    data->stale_timeout_ms = val;
+    if (val) {
+        // Count the new timeout from now
+        hrtimer_start(&data->stale_timer, ms_to_ktime(val), HRTIMER_MODE_REL);
+    } else {
+        hrtimer_try_to_cancel(&data->stale_timer);
     }
-    mutex_unlock(&g_batt_data->lock);
+    mutex_unlock(&data->lock);
+    return count;
+}
+
+// The producer lost its source (e.g. the gauge stopped answering): report
+// stale now rather than after stale_timeout_ms. The next write clears it.
+static ssize_t mark_stale_store(struct device *dev, struct device_attribute *attr,
+                                const char *buf, size_t count) {
+    struct userspace_batt_data *data = dev_get_drvdata(dev);
+    bool val, notify = false;
+    int ret;
+
+    if (!data) return -ENODEV;
+
+    ret = kstrtobool(buf, &val);
+    if (ret) return ret;
+    if (!val) return count;
+
+    mutex_lock(&data->lock);
+    if (data->have_data && !data->stale) {
+        hrtimer_try_to_cancel(&data->stale_timer);
+        data->stale = true;
+        userspace_batt_update_level(data);
+        data->seq++;
+        notify = true;
+    }
+    mutex_unlock(&data->lock);
+
+    if (notify) {
+        dev_warn(dev, "userspace_battery: Producer lost its source, reporting status Unknown\n");
+        userspace_batt_changed(data, data->psy);
+    }
+    return count;
+}
+
+static ssize_t stale_clears_present_show(struct device *dev, struct device_attribute *attr, char *buf) {
+    struct userspace_batt_data *data = dev_get_drvdata(dev);
+
+    if (!data) return -ENODEV;
+    return sysfs_emit(buf, "%d\n", READ_ONCE(data->stale_clears_present));
+}
+
+static ssize_t stale_clears_present_store(struct device *dev, struct device_attribute *attr,
+                                          const char *buf, size_t count) {
+    struct userspace_batt_data *data = dev_get_drvdata(dev);
+    bool val;
+    bool changed;
+    int ret;
+
+    if (!data) return -ENODEV;
+
+    ret = kstrtobool(buf, &val);
+    if (ret) return ret;
+
+    mutex_lock(&data->lock);
+    changed = data->stale && data->stale_clears_present != val;
+    data->stale_clears_present = val;
+    if (changed)
+        data->seq++;
+    mutex_unlock(&data->lock);
 
     if (changed) {
-        power_supply_changed(g_batt_data->psy); // Notify only if changed
+        userspace_batt_changed(data, data->psy); // PRESENT flips right away
     }
     return count;
 }
 
+// --- Voltage Filter Attributes ---
+
+static ssize_t voltage_median_taps_show(struct device *dev, struct device_attribute *attr, char *buf) {
+    struct userspace_batt_data *data = dev_get_drvdata(dev);
+
+    if (!data) return -ENODEV;
+    return sysfs_emit(buf, "%u\n", READ_ONCE(data->vfilter.taps));
+}
+
+// Changing the length restarts the filter from the next sample
+static ssize_t voltage_median_taps_store(struct device *dev, struct device_attribute *attr,
+                                         const char *buf, size_t count) {
+    struct userspace_batt_data *data = dev_get_drvdata(dev);
+    unsigned int val;
+    int ret;
+
+    if (!data) return -ENODEV;
+
+    ret = kstrtouint(buf, 0, &val);
+    if (ret) return ret;
+    if (val < 1 || val > USERSPACE_BATT_MEDIAN_MAX_TAPS) return -EINVAL;
+
+    mutex_lock(&data->lock);
+    data->vfilter.taps = val;
+    userspace_batt_vfilter_reset(&data->vfilter);
+    mutex_unlock(&data->lock);
+    return count;
+}
+
+static ssize_t voltage_avg_alpha_show(struct device *dev, struct device_attribute *attr, char *buf) {
+    struct userspace_batt_data *data = dev_get_drvdata(dev);
+
+    if (!data) return -ENODEV;
+    return sysfs_emit(buf, "%u\n", READ_ONCE(data->vfilter.alpha));
+}
+
+static ssize_t voltage_avg_alpha_store(struct device *dev, struct device_attribute *attr,
+                                       const char *buf, size_t count) {
+    struct userspace_batt_data *data = dev_get_drvdata(dev);
+    unsigned int val;
+    int ret;
+
+    if (!data) return -ENODEV;
+
+    ret = kstrtouint(buf, 0, &val);
+    if (ret) return ret;
+    if (val < 1 || val > USERSPACE_BATT_EMA_ONE) return -EINVAL;
+
+    mutex_lock(&data->lock);
+    data->vfilter.alpha = val;
+    mutex_unlock(&data->lock);
+    return count;
+}
+
 // --- Sysfs Attribute Definitions (for writable attributes) ---
 // Use DEVICE_ATTR_WO for Write-Only by userspace (permissions 0200 - write for owner only)
 // Or DEVICE_ATTR_RW for Read-Write if you want userspace to read them back (permissions 0644)
@@ -117,17 +1181,258 @@ static ssize_t set_status_store(struct device *dev, struct device_attribute *att
 static DEVICE_ATTR_WO(set_voltage_uv);
 static DEVICE_ATTR_WO(set_capacity);
 static DEVICE_ATTR_WO(set_status);
+static DEVICE_ATTR_WO(set_time_to_empty);
+static DEVICE_ATTR_WO(set_time_to_full);
+static DEVICE_ATTR_WO(set_temp);
+static DEVICE_ATTR_WO(set_online);
+static DEVICE_ATTR_WO(set_cycle_count);
+static DEVICE_ATTR_WO(set_health);
+static DEVICE_ATTR_WO(set_charge_full);
+static DEVICE_ATTR_WO(set_charge_full_design);
+static DEVICE_ATTR_RW(transaction);
+static DEVICE_ATTR_RO(seq);
+static DEVICE_ATTR_RO(capacity_alert);
+static DEVICE_ATTR_RO(resume_count);
+static DEVICE_ATTR_RO(data_age_ms);
+static DEVICE_ATTR_RW(stale_timeout_ms);
+static DEVICE_ATTR_RW(stale_clears_present);
+static DEVICE_ATTR_WO(mark_stale);
+static DEVICE_ATTR_RW(voltage_median_taps);
+static DEVICE_ATTR_RW(voltage_avg_alpha);
 
 // --- Attribute Group (for writable attributes) ---
 static struct attribute *userspace_batt_sysfs_attrs[] = {
     &dev_attr_set_voltage_uv.attr,
     &dev_attr_set_capacity.attr,
     &dev_attr_set_status.attr,
+    &dev_attr_set_time_to_empty.attr,
+    &dev_attr_set_time_to_full.attr,
+    &dev_attr_set_temp.attr,
+    &dev_attr_set_online.attr,
+    &dev_attr_set_cycle_count.attr,
+    &dev_attr_set_health.attr,
+    &dev_attr_set_charge_full.attr,
+    &dev_attr_set_charge_full_design.attr,
+    &dev_attr_transaction.attr,
+    &dev_attr_seq.attr,
+    &dev_attr_capacity_alert.attr,
+    &dev_attr_resume_count.attr,
+    &dev_attr_data_age_ms.attr,
+    &dev_attr_stale_timeout_ms.attr,
+    &dev_attr_stale_clears_present.attr,
+    &dev_attr_mark_stale.attr,
+    &dev_attr_voltage_median_taps.attr,
+    &dev_attr_voltage_avg_alpha.attr,
     NULL, // Null-terminated list
 };
 
+// Hide set_online when no companion charger was registered
+static umode_t userspace_batt_attr_is_visible(struct kobject *kobj, struct attribute *attr, int n) {
+    struct userspace_batt_data *data = dev_get_drvdata(kobj_to_dev(kobj));
+
+    if (attr == &dev_attr_set_online.attr && !data->charger_psy)
+        return 0;
+    return attr->mode;
+}
+
+// --- OCV Table Binary Attribute ---
+
+// Replace the OCV table. The whole table must arrive in one write at offset 0.
+static ssize_t ocv_table_write(struct file *filp, struct kobject *kobj,
+                               const struct bin_attribute *attr, char *buf,
+                               loff_t off, size_t count) {
+    struct userspace_batt_data *data = dev_get_drvdata(kobj_to_dev(kobj));
+    const struct userspace_batt_ocv_hdr *hdr = (const void *)buf;
+    struct userspace_batt_ocv_entry *entries = NULL;
+    struct userspace_batt_ocv *ocv = NULL, *old;
+    unsigned int changed = 0;
+    int ret;
+
+    if (!data) return -ENODEV;
+    if (off != 0 || count < sizeof(*hdr)) return -EINVAL;
+    if (hdr->magic != USERSPACE_BATT_OCV_MAGIC || hdr->version != USERSPACE_BATT_OCV_VERSION)
+        return -EINVAL;
+    if (hdr->num_entries > USERSPACE_BATT_OCV_MAX_TEMPS * USERSPACE_BATT_OCV_MAX_POINTS ||
+        count != sizeof(*hdr) + hdr->num_entries * sizeof(*entries))
+        return -EINVAL;
+
+    if (hdr->num_entries) {
+        entries = kmemdup(buf + sizeof(*hdr), hdr->num_entries * sizeof(*entries), GFP_KERNEL);
+        ocv = kzalloc(sizeof(*ocv), GFP_KERNEL);
+        if (!entries || !ocv) {
+            ret = -ENOMEM;
+            goto out_free;
+        }
+        ret = userspace_batt_ocv_build(entries, hdr->num_entries, ocv);
+        if (ret) goto out_free;
+    }
+
+    mutex_lock(&data->lock);
+    old = data->ocv;
+    data->ocv = ocv;
+    if (ocv && data->have_data) {
+        int cap = userspace_batt_ocv_lookup(data, data->voltage_uv);
+
+        if (cap != data->capacity) {
+            data->capacity = cap;
+            changed = USERSPACE_BATT_F_CAPACITY | userspace_batt_update_level(data);
+            data->seq++;
+        }
+    }
+    mutex_unlock(&data->lock);
+
+    kfree(old);
+    kfree(entries);
+    userspace_batt_notify(data, changed);
+    dev_info(&data->pdev->dev, "userspace_battery: OCV table %s (%u curve(s)).\n",
+             ocv ? "loaded" : "cleared", ocv ? ocv->num_curves : 0);
+    return count;
+
+out_free:
+    kfree(entries);
+    kfree(ocv);
+    return ret;
+}
+
+// Read back the loaded table in the same format
+static ssize_t ocv_table_read(struct file *filp, struct kobject *kobj,
+                              const struct bin_attribute *attr, char *buf,
+                              loff_t off, size_t count) {
+    struct userspace_batt_data *data = dev_get_drvdata(kobj_to_dev(kobj));
+    struct userspace_batt_ocv_hdr *hdr;
+    struct userspace_batt_ocv_entry *e;
+    unsigned int i, j, n = 0;
+    ssize_t ret;
+    void *tmp;
+
+    if (!data) return -ENODEV;
+
+    tmp = kzalloc(USERSPACE_BATT_OCV_TABLE_MAX_SIZE, GFP_KERNEL);
+    if (!tmp) return -ENOMEM;
+    hdr = tmp;
+    e = tmp + sizeof(*hdr);
+
+    mutex_lock(&data->lock);
+    for (i = 0; data->ocv && i < data->ocv->num_curves; i++) {
+        const struct userspace_batt_ocv_curve *c = &data->ocv->curves[i];
+
+        for (j = 0; j < c->num_points; j++, n++) {
+            e[n].temp_c = c->temp_c;
+            e[n].ocv_uv = c->ocv_uv[j];
+            e[n].capacity = c->cap_milli[j] / 1000;
+        }
+    }
+    mutex_unlock(&data->lock);
+
+    hdr->magic = USERSPACE_BATT_OCV_MAGIC;
+    hdr->version = USERSPACE_BATT_OCV_VERSION;
+    hdr->num_entries = n;
+    ret = memory_read_from_buffer(buf, count, &off, tmp, sizeof(*hdr) + n * sizeof(*e));
+    kfree(tmp);
+    return ret;
+}
+
+static BIN_ATTR_RW(ocv_table, USERSPACE_BATT_OCV_TABLE_MAX_SIZE);
+
+// --- Snapshot Binary Attribute ---
+
+// All properties in one consistent read (struct userspace_batt_snapshot)
+static ssize_t snapshot_read(struct file *filp, struct kobject *kobj,
+                             const struct bin_attribute *attr, char *buf,
+                             loff_t off, size_t count) {
+    struct userspace_batt_data *data = dev_get_drvdata(kobj_to_dev(kobj));
+    struct userspace_batt_snapshot snap = {
+        .version = USERSPACE_BATT_SNAPSHOT_VERSION,
+        .size = sizeof(snap),
+    };
+
+    if (!data) return -ENODEV;
+
+    mutex_lock(&data->lock);
+    snap.seq = data->seq;
+    snap.update_ns = data->have_data ? ktime_to_ns(data->last_update) : 0;
+    snap.snapshot_ns = ktime_get_ns();
+    snap.voltage_uv = data->voltage_uv;
+    snap.voltage_avg_uv = userspace_batt_vfilter_avg(&data->vfilter);
+    snap.capacity_level = data->capacity_level;
+    snap.capacity_alert = data->capacity_alert;
+    snap.capacity = data->capacity;
+    // Same overlays as get_property, so both views always agree
+    snap.status = data->stale ? POWER_SUPPLY_STATUS_UNKNOWN : data->status_enum;
+    snap.present = !(data->stale && data->stale_clears_present);
+    snap.time_to_empty_s = data->time_to_empty_s;
+    snap.time_to_full_s = data->time_to_full_s;
+    snap.temp_dc = data->temp_dc;
+    if (data->have_data) snap.flags |= USERSPACE_BATT_SNAP_HAVE_DATA;
+    if (data->stale) snap.flags |= USERSPACE_BATT_SNAP_STALE;
+    if (data->have_temp) snap.flags |= USERSPACE_BATT_SNAP_HAVE_TEMP;
+    if (data->charger_psy) snap.flags |= USERSPACE_BATT_SNAP_HAVE_CHARGER;
+    if (data->online) snap.flags |= USERSPACE_BATT_SNAP_ONLINE;
+    if (data->ocv) snap.flags |= USERSPACE_BATT_SNAP_HAVE_OCV;
+    snap.cycle_count = data->cycle_count;
+    snap.health = data->health;
+    snap.charge_full_uah = data->charge_full_uah;
+    snap.charge_full_design_uah = data->charge_full_design_uah;
+    mutex_unlock(&data->lock);
+
+    return memory_read_from_buffer(buf, count, &off, &snap, sizeof(snap));
+}
+
+static BIN_ATTR_RO(snapshot, sizeof(struct userspace_batt_snapshot));
+
+static const struct bin_attribute *const userspace_batt_sysfs_bin_attrs[] = {
+    &bin_attr_ocv_table,
+    &bin_attr_snapshot,
+    NULL,
+};
+
+// Import OCV curves from a monitored-battery firmware node, if the device has one
+static void userspace_batt_ocv_from_fwnode(struct userspace_batt_data *data) {
+    struct power_supply_battery_info *info;
+    struct userspace_batt_ocv_entry *entries;
+    struct userspace_batt_ocv *ocv;
+    unsigned int i, j, n = 0;
+
+    if (power_supply_get_battery_info(data->psy, &info))
+        return; // No battery description, nothing to import
+
+    entries = kcalloc(USERSPACE_BATT_OCV_MAX_TEMPS * USERSPACE_BATT_OCV_MAX_POINTS,
+                      sizeof(*entries), GFP_KERNEL);
+    ocv = kzalloc(sizeof(*ocv), GFP_KERNEL);
+    if (!entries || !ocv)
+        goto out;
+
+    for (i = 0; i < POWER_SUPPLY_OCV_TEMP_MAX && i < USERSPACE_BATT_OCV_MAX_TEMPS; i++) {
+        for (j = 0; j < info->ocv_table_size[i] && j < USERSPACE_BATT_OCV_MAX_POINTS; j++, n++) {
+            entries[n].temp_c = info->ocv_temp[i];
+            entries[n].ocv_uv = info->ocv_table[i][j].ocv;
+            entries[n].capacity = info->ocv_table[i][j].capacity;
+        }
+    }
+
+    if (n && !userspace_batt_ocv_build(entries, n, ocv)) {
+        data->ocv = ocv; // Probe time, nobody else can see data yet
+        ocv = NULL;
+        dev_info(&data->pdev->dev, "userspace_battery: Using OCV table from firmware node.\n");
+    }
+out:
+    kfree(entries);
+    kfree(ocv);
+    // The table was copied; nothing else keeps the firmware description
+    power_supply_put_battery_info(data->psy, info);
+}
+
+static void userspace_batt_ocv_free(void *arg) {
+    struct userspace_batt_data *data = arg;
+
+    kfree(data->ocv);
+    data->ocv = NULL;
+}
+
 static const struct attribute_group userspace_batt_sysfs_attr_group = {
     .attrs = userspace_batt_sysfs_attrs,
+    .bin_attrs = userspace_batt_sysfs_bin_attrs,
+    .is_visible = userspace_batt_attr_is_visible,
 };
 
 // --- Power Supply 'get_property' Function (Read by kernel/upower) ---
@@ -154,11 +1459,66 @@ static int userspace_batt_get_property(struct power_supply *psy,
         // Let's assume for now typical LiPo voltages fit okay when casted.
         val->intval = (int)data->voltage_uv;
         break;
+    case POWER_SUPPLY_PROP_VOLTAGE_AVG: // uV, EMA of the filtered voltage
+        val->intval = (int)userspace_batt_vfilter_avg(&data->vfilter);
+        break;
     case POWER_SUPPLY_PROP_CAPACITY: // Expected 0-100
         val->intval = data->capacity;
         break;
+    case POWER_SUPPLY_PROP_CAPACITY_ALERT_MIN:
+        val->intval = data->capacity_alert_min;
+        break;
+    case POWER_SUPPLY_PROP_CAPACITY_ALERT_MAX:
+        val->intval = data->capacity_alert_max;
+        break;
+    case POWER_SUPPLY_PROP_CAPACITY_LEVEL:
+        val->intval = data->capacity_level;
+        break;
     case POWER_SUPPLY_PROP_STATUS: // Expected POWER_SUPPLY_STATUS_* enum
-        val->intval = data->status_enum;
+        // Stale data overrides whatever the producer last said
+        val->intval = data->stale ? POWER_SUPPLY_STATUS_UNKNOWN : data->status_enum;
+        break;
+    case POWER_SUPPLY_PROP_TEMP: // Tenths of a degree C
+        if (!data->have_temp)
+            ret = -ENODATA;
+        else
+            val->intval = data->temp_dc;
+        break;
+    case POWER_SUPPLY_PROP_PRESENT:
+        val->intval = !(data->stale && data->stale_clears_present);
+        break;
+    case POWER_SUPPLY_PROP_TIME_TO_EMPTY_NOW: // Seconds
+        if (data->time_to_empty_s < 0)
+            ret = -ENODATA; // No estimate yet (or not discharging)
+        else
+            val->intval = data->time_to_empty_s;
+        break;
+    case POWER_SUPPLY_PROP_TIME_TO_FULL_NOW: // Seconds
+        if (data->time_to_full_s < 0)
+            ret = -ENODATA;
+        else
+            val->intval = data->time_to_full_s;
+        break;
+    case POWER_SUPPLY_PROP_CYCLE_COUNT:
+        if (data->cycle_count < 0)
+            ret = -ENODATA; // Producer does not track ageing
+        else
+            val->intval = data->cycle_count;
+        break;
+    case POWER_SUPPLY_PROP_HEALTH:
+        val->intval = data->health;
+        break;
+    case POWER_SUPPLY_PROP_CHARGE_FULL: // uAh
+        if (data->charge_full_uah < 0)
+            ret = -ENODATA;
+        else
+            val->intval = data->charge_full_uah;
+        break;
+    case POWER_SUPPLY_PROP_CHARGE_FULL_DESIGN:
+        if (data->charge_full_design_uah < 0)
+            ret = -ENODATA;
+        else
+            val->intval = data->charge_full_design_uah;
         break;
     default:
         ret = -EINVAL; // Property not supported
@@ -171,126 +1531,409 @@ static int userspace_batt_get_property(struct power_supply *psy,
 
 // --- Power Supply Properties ---
 static enum power_supply_property userspace_batt_properties[] = {
+    POWER_SUPPLY_PROP_PRESENT,
     POWER_SUPPLY_PROP_VOLTAGE_NOW,
+    POWER_SUPPLY_PROP_VOLTAGE_AVG,
     POWER_SUPPLY_PROP_CAPACITY,
+    POWER_SUPPLY_PROP_CAPACITY_ALERT_MIN,
+    POWER_SUPPLY_PROP_CAPACITY_ALERT_MAX,
+    POWER_SUPPLY_PROP_CAPACITY_LEVEL,
     POWER_SUPPLY_PROP_STATUS,
+    POWER_SUPPLY_PROP_TIME_TO_EMPTY_NOW,
+    POWER_SUPPLY_PROP_TIME_TO_FULL_NOW,
+    POWER_SUPPLY_PROP_TEMP, // Also exported as hwmon temp1_input by the power_supply core
+    POWER_SUPPLY_PROP_CYCLE_COUNT,
+    POWER_SUPPLY_PROP_HEALTH,
+    POWER_SUPPLY_PROP_CHARGE_FULL,
+    POWER_SUPPLY_PROP_CHARGE_FULL_DESIGN,
     // Add other properties like POWER_SUPPLY_PROP_TECHNOLOGY = POWER_SUPPLY_TECHNOLOGY_LIPO if desired
 };
 
+// --- Companion Charger ---
+
+static int userspace_charger_get_property(struct power_supply *psy,
+                                          enum power_supply_property psp,
+                                          union power_supply_propval *val) {
+    struct userspace_batt_data *data = power_supply_get_drvdata(psy);
+
+    if (psp != POWER_SUPPLY_PROP_ONLINE)
+        return -EINVAL;
+
+    mutex_lock(&data->lock);
+    val->intval = data->online;
+    mutex_unlock(&data->lock);
+    return 0;
+}
+
+static int userspace_charger_property_is_writeable(struct power_supply *psy,
+                                                   enum power_supply_property psp) {
+    return psp == POWER_SUPPLY_PROP_ONLINE;
+}
+
+static enum power_supply_property userspace_charger_properties[] = {
+    POWER_SUPPLY_PROP_ONLINE,
+};
+
+// Called by the power_supply core when a supplier (our charger) changed
+static void userspace_batt_external_power_changed(struct power_supply *psy) {
+    power_supply_changed(psy);
+}
+
+// Both supplies take writes through their class attributes, so remove()
+// unregisters them itself before stopping the watchdog; devm only covers
+// probe failures.
+static void userspace_batt_psy_unregister(void *psy) {
+    power_supply_unregister(psy);
+}
+
+static int userspace_charger_register(struct userspace_batt_data *data, enum power_supply_type type) {
+    struct device *dev = &data->pdev->dev;
+    struct power_supply_config psy_cfg = {};
+    struct power_supply_desc *desc;
+    char **supplied_to;
+    int ret;
+
+    desc = devm_kzalloc(dev, sizeof(*desc), GFP_KERNEL);
+    supplied_to = devm_kcalloc(dev, 1, sizeof(*supplied_to), GFP_KERNEL);
+    if (!desc || !supplied_to) return -ENOMEM;
+
+    // userspace_battery -> userspace_charger, userspace_battery.N -> userspace_charger.N
+    if (data->pdev->id == PLATFORM_DEVID_NONE)
+        desc->name = "userspace_charger";
+    else
+        desc->name = devm_kasprintf(dev, GFP_KERNEL, "userspace_charger.%d", data->pdev->id);
+    if (!desc->name) return -ENOMEM;
+
+    desc->type = type;
+    desc->properties = userspace_charger_properties;
+    desc->num_properties = ARRAY_SIZE(userspace_charger_properties);
+    desc->get_property = userspace_charger_get_property;
+    desc->set_property = userspace_batt_set_property; // Same data, ONLINE case
+    desc->property_is_writeable = userspace_charger_property_is_writeable;
+
+    supplied_to[0] = (char *)dev_name(dev); // The battery psy shares the device name
+    psy_cfg.drv_data = data;
+    psy_cfg.supplied_to = supplied_to;
+    psy_cfg.num_supplicants = 1;
+
+    data->charger_psy = power_supply_register(dev, desc, &psy_cfg);
+    if (IS_ERR(data->charger_psy)) {
+        ret = PTR_ERR(data->charger_psy);
+
+        data->charger_psy = NULL;
+        dev_err(dev, "userspace_battery: Failed to register charger, error %d\n", ret);
+        return ret;
+    }
+    ret = devm_add_action_or_reset(dev, userspace_batt_psy_unregister, data->charger_psy);
+    if (ret) {
+        data->charger_psy = NULL;
+        return ret;
+    }
+    dev_info(dev, "userspace_battery: Registered companion charger %s.\n", desc->name);
+    return 0;
+}
+
+// --- Thermal Zone ---
+
+static int userspace_batt_tz_get_temp(struct thermal_zone_device *tz, int *temp) {
+    struct userspace_batt_data *data = thermal_zone_device_priv(tz);
+    int ret = 0;
+
+    mutex_lock(&data->lock);
+    if (data->have_temp)
+        *temp = data->temp_dc * 100; // Thermal core works in m°C
+    else
+        ret = -EAGAIN; // No sample yet; the core skips this update quietly
+    mutex_unlock(&data->lock);
+    return ret;
+}
+
+static const struct thermal_zone_device_ops userspace_batt_tz_ops = {
+    .get_temp = userspace_batt_tz_get_temp,
+};
+
+static void userspace_batt_tz_unregister(void *tz) {
+    thermal_zone_device_unregister(tz);
+}
+
+// Register a thermal zone with the configured trip points. The zone is not
+// polled: set_temp pushes every new sample into the thermal core.
+static int userspace_batt_tz_register(struct userspace_batt_data *data) {
+    struct device *dev = &data->pdev->dev;
+    struct thermal_zone_params tzp = {
+        .no_hwmon = true, // The power_supply core already registers hwmon for TEMP
+    };
+    struct thermal_trip trips[2] = {};
+    int num_trips = 0;
+    int ret;
+
+    if (temp_trip_passive) {
+        trips[num_trips].temperature = temp_trip_passive;
+        trips[num_trips].hysteresis = 2000;
+        trips[num_trips].type = THERMAL_TRIP_PASSIVE;
+        num_trips++;
+    }
+    if (temp_trip_critical) {
+        trips[num_trips].temperature = temp_trip_critical;
+        trips[num_trips].type = THERMAL_TRIP_CRITICAL;
+        num_trips++;
+    }
+
+    data->tz = thermal_zone_device_register_with_trips(dev_name(dev), trips, num_trips, data,
+                                                       &userspace_batt_tz_ops, &tzp, 0, 0);
+    if (IS_ERR(data->tz)) {
+        ret = PTR_ERR(data->tz);
+        data->tz = NULL;
+        dev_err(dev, "userspace_battery: Failed to register thermal zone, error %d\n", ret);
+        return ret;
+    }
+
+    ret = devm_add_action_or_reset(dev, userspace_batt_tz_unregister, data->tz);
+    if (ret) {
+        data->tz = NULL;
+        return ret;
+    }
+
+    ret = thermal_zone_device_enable(data->tz);
+    if (ret) return ret;
+
+    dev_info(dev, "userspace_battery: Registered thermal zone with %d trip(s).\n", num_trips);
+    return 0;
+}
+
 // --- Platform Driver Probe / Remove ---
 
 static int userspace_battery_probe(struct platform_device *pdev) {
     int ret;
+    struct userspace_batt_data *data;
     struct power_supply_config psy_cfg = {};
     struct power_supply_desc *psy_desc; // Allocate dynamically
+    enum power_supply_type charger_type = POWER_SUPPLY_TYPE_UNKNOWN;
 
     dev_info(&pdev->dev, "userspace_battery: Probing platform device...\n");
 
-    if (!g_batt_data) {
-        dev_err(&pdev->dev, "userspace_battery: Global data not allocated during probe!\n");
-        return -ENODEV;
+    if (sysfs_streq(charger, "mains")) {
+        charger_type = POWER_SUPPLY_TYPE_MAINS;
+    } else if (sysfs_streq(charger, "usb")) {
+        charger_type = POWER_SUPPLY_TYPE_USB;
+    } else if (!sysfs_streq(charger, "none")) {
+        dev_err(&pdev->dev, "userspace_battery: Invalid charger=%s (none, mains or usb)\n", charger);
+        return -EINVAL;
     }
 
-    // Set the global platform device pointer for cleanup reference
-    g_batt_data->pdev = pdev;
-    // Associate our global data with this platform device instance
-    platform_set_drvdata(pdev, g_batt_data);
+    // Per-instance data, freed automatically when the device is unbound
+    data = devm_kzalloc(&pdev->dev, sizeof(*data), GFP_KERNEL);
+    if (!data) return -ENOMEM;
+
+    // Initialize defaults
+    mutex_init(&data->lock);
+    data->voltage_uv = 0;
+    data->capacity = -1; // Indicate uninitialized
+    data->status_enum = POWER_SUPPLY_STATUS_UNKNOWN;
+    data->time_to_empty_s = -1;
+    data->time_to_full_s = -1;
+    data->cycle_count = -1;
+    data->health = POWER_SUPPLY_HEALTH_UNKNOWN;
+    data->charge_full_uah = -1;
+    data->charge_full_design_uah = -1;
+    data->pdev = pdev;
+    data->stale_timeout_ms = stale_timeout_ms_default;
+    data->stale_clears_present = stale_clears_present_default;
+    data->capacity_alert_min = clamp_val(capacity_alert_min_default, 0, 100);
+    data->capacity_alert_max = clamp_val(capacity_alert_max_default, 0, 100);
+    data->capacity_level = POWER_SUPPLY_CAPACITY_LEVEL_UNKNOWN;
+    data->vfilter.taps = clamp_val(voltage_median_taps_default, 1, USERSPACE_BATT_MEDIAN_MAX_TAPS);
+    data->vfilter.alpha = clamp_val(voltage_avg_alpha_default, 1, USERSPACE_BATT_EMA_ONE);
+    hrtimer_setup(&data->stale_timer, userspace_batt_stale_timer_fn, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    INIT_WORK(&data->stale_work, userspace_batt_stale_work_fn);
+    INIT_DELAYED_WORK(&data->txn_work, userspace_batt_txn_timeout_fn);
+
+    // Associate our data with this platform device instance (used by the set_* stores)
+    platform_set_drvdata(pdev, data);
 
     // Allocate and configure power supply description using devm_ for automatic cleanup
     psy_desc = devm_kzalloc(&pdev->dev, sizeof(*psy_desc), GFP_KERNEL);
     if (!psy_desc) return -ENOMEM;
 
-    psy_desc->name = "userspace_battery"; // Name for /sys/class/power_supply/
+    // Name for /sys/class/power_supply/, follows the platform device name
+    psy_desc->name = dev_name(&pdev->dev);
     psy_desc->type = POWER_SUPPLY_TYPE_BATTERY;
     psy_desc->properties = userspace_batt_properties;
     psy_desc->num_properties = ARRAY_SIZE(userspace_batt_properties);
     psy_desc->get_property = userspace_batt_get_property;
+    psy_desc->set_property = userspace_batt_set_property;
+    psy_desc->property_is_writeable = userspace_batt_property_is_writeable;
+    psy_desc->external_power_changed = userspace_batt_external_power_changed;
+    psy_desc->no_thermal = true; // We register our own zone, with trip points
 
-    psy_cfg.drv_data = g_batt_data; // Link our data struct
+    psy_cfg.drv_data = data; // Link our data struct
 
     // Register the power supply device using the virtual platform device as parent
-    g_batt_data->psy = devm_power_supply_register(&pdev->dev, psy_desc, &psy_cfg);
-    if (IS_ERR(g_batt_data->psy)) {
-        dev_err(&pdev->dev, "userspace_battery: Failed to register power supply, error %ld\n", PTR_ERR(g_batt_data->psy));
-        return PTR_ERR(g_batt_data->psy);
+    data->psy = power_supply_register(&pdev->dev, psy_desc, &psy_cfg);
+    if (IS_ERR(data->psy)) {
+        dev_err(&pdev->dev, "userspace_battery: Failed to register power supply, error %ld\n", PTR_ERR(data->psy));
+        return PTR_ERR(data->psy);
     }
+    ret = devm_add_action_or_reset(&pdev->dev, userspace_batt_psy_unregister, data->psy);
+    if (ret) return ret;
     dev_info(&pdev->dev, "userspace_battery: Registered power supply device.\n");
 
+    if (charger_type != POWER_SUPPLY_TYPE_UNKNOWN) {
+        ret = userspace_charger_register(data, charger_type);
+        if (ret) return ret;
+    }
+
+    ret = userspace_batt_tz_register(data);
+    if (ret) return ret;
+
+    // Whatever table is installed at unbind time is freed with the device
+    ret = devm_add_action_or_reset(&pdev->dev, userspace_batt_ocv_free, data);
+    if (ret) return ret;
+    userspace_batt_ocv_from_fwnode(data);
+
     // Create the writable sysfs attributes under the platform device's kobject
     // (/sys/devices/platform/userspace_battery/)
     ret = sysfs_create_group(&pdev->dev.kobj, &userspace_batt_sysfs_attr_group);
     if (ret) {
         dev_err(&pdev->dev, "userspace_battery: Failed to create sysfs group, error %d\n", ret);
-        // devm_power_supply_register cleanup is automatic on return error
+        // The power supplies are unregistered by devm on return error
         return ret;
     }
     dev_info(&pdev->dev, "userspace_battery: Created sysfs attributes.\n");
 
+    // Arm the watchdog so a producer that never starts is reported too
+    mutex_lock(&data->lock);
+    if (data->stale_timeout_ms)
+        hrtimer_start(&data->stale_timer, ms_to_ktime(data->stale_timeout_ms), HRTIMER_MODE_REL);
+    mutex_unlock(&data->lock);
+
     return 0; // Success
 }
 
 // Corrected signature: returns void, no return statement
 static void userspace_battery_remove(struct platform_device *pdev) {
+    struct userspace_batt_data *data = platform_get_drvdata(pdev);
+
     dev_info(&pdev->dev, "userspace_battery: Removing platform driver.\n");
 
-    // Remove sysfs group created in probe
+    // Remove sysfs group created in probe (waits for set_* writes in progress)
     sysfs_remove_group(&pdev->dev.kobj, &userspace_batt_sysfs_attr_group);
 
-    // power_supply registration/cleanup is handled by devm associated with pdev
-    // drvdata cleanup is handled in module_exit
+    // The class attributes of both supplies stay writable until they are
+    // unregistered: refuse writes from here on so none re-arms the watchdog
+    mutex_lock(&data->lock);
+    data->removing = true;
+    mutex_unlock(&data->lock);
+
+    // Stop the watchdog before the power supply it notifies goes away
+    hrtimer_cancel(&data->stale_timer);
+    cancel_work_sync(&data->stale_work);
+    cancel_delayed_work_sync(&data->txn_work);
+
+    // Unregistering waits for class attribute writes still in progress, so
+    // none is left touching the thermal zone when devm unregisters it
+    if (data->charger_psy)
+        devm_release_action(&pdev->dev, userspace_batt_psy_unregister, data->charger_psy);
+    devm_release_action(&pdev->dev, userspace_batt_psy_unregister, data->psy);
+
+    // The thermal zone, the OCV table and data itself are freed by devm
+}
+
+// --- Power Management ---
+
+// Whatever the producer wrote before the system slept no longer describes
+// the battery: report it stale (status Unknown) until the first write after
+// resume. The watchdog is stopped so it cannot fire across the sleep.
+static int userspace_battery_suspend(struct device *dev) {
+    struct userspace_batt_data *data = dev_get_drvdata(dev);
+
+    hrtimer_cancel(&data->stale_timer);
+    cancel_work_sync(&data->stale_work);
+
+    mutex_lock(&data->lock);
+    if (data->have_data && !data->stale) {
+        data->stale = true;
+        userspace_batt_update_level(data);
+        data->seq++;
+    }
+    mutex_unlock(&data->lock);
+    return 0;
+}
+
+// Tell consumers the values are stale now and wake producers polling
+// resume_count so fresh data arrives within one sample of resume.
+static int userspace_battery_resume(struct device *dev) {
+    struct userspace_batt_data *data = dev_get_drvdata(dev);
+
+    mutex_lock(&data->lock);
+    data->resume_count++;
+    data->seq++;
+    if (data->stale_timeout_ms)
+        hrtimer_start(&data->stale_timer, ms_to_ktime(data->stale_timeout_ms), HRTIMER_MODE_REL);
+    mutex_unlock(&data->lock);
+
+    sysfs_notify(&dev->kobj, NULL, "resume_count");
+    userspace_batt_changed(data, data->psy);
+    return 0;
 }
 
+static DEFINE_SIMPLE_DEV_PM_OPS(userspace_battery_pm_ops, userspace_battery_suspend,
+                                userspace_battery_resume);
+
 // --- Platform Driver Definition ---
 static struct platform_driver userspace_battery_platform_driver = {
     .driver = {
         .name = "userspace_battery", // Must match platform device name
+        .pm = pm_sleep_ptr(&userspace_battery_pm_ops),
     },
     .probe = userspace_battery_probe,
     .remove = userspace_battery_remove, // Corrected type usage
 };
 
 // --- Module Init / Exit ---
+static void userspace_battery_unregister_devices(void) {
+    int i;
+
+    for (i = 0; i < USERSPACE_BATT_MAX_INSTANCES; i++) {
+        if (g_batt_pdevs[i]) {
+            platform_device_unregister(g_batt_pdevs[i]);
+            g_batt_pdevs[i] = NULL;
+        }
+    }
+}
+
 static int __init userspace_battery_init(void) {
+    struct platform_device *pdev;
     int ret;
+    int i;
 
     pr_info("userspace_battery: Loading module...\n");
 
-    // Allocate global data structure
-    g_batt_data = kzalloc(sizeof(*g_batt_data), GFP_KERNEL);
-    if (!g_batt_data) {
-        pr_err("userspace_battery: Failed to allocate memory\n");
-        return -ENOMEM;
+    if (num_batteries < 1 || num_batteries > USERSPACE_BATT_MAX_INSTANCES) {
+        pr_err("userspace_battery: num_batteries must be 1-%d\n", USERSPACE_BATT_MAX_INSTANCES);
+        return -EINVAL;
     }
 
-    // Initialize defaults
-    mutex_init(&g_batt_data->lock);
-    g_batt_data->voltage_uv = 0;
-    g_batt_data->capacity = -1; // Indicate uninitialized
-    g_batt_data->status_enum = POWER_SUPPLY_STATUS_UNKNOWN;
-    g_batt_data->pdev = NULL; // Not created yet
-    g_batt_data->psy = NULL; // Not created yet
-
-    // Create the virtual platform device - This acts as the parent device
-    // ID -1 = auto-assign, no resources, no platform data
-    g_batt_data->pdev = platform_device_register_simple("userspace_battery", -1, NULL, 0);
-    if (IS_ERR(g_batt_data->pdev)) {
-        ret = PTR_ERR(g_batt_data->pdev);
-        pr_err("userspace_battery: Failed to register platform device, error %d\n", ret);
-        kfree(g_batt_data);
-        g_batt_data = NULL;
-        return ret;
+    // Create the virtual platform devices - These act as the parent devices
+    // Instance 0 uses ID -1 (no suffix) so existing sysfs paths keep working;
+    // no resources, no platform data. Per-instance data is allocated in probe.
+    for (i = 0; i < num_batteries; i++) {
+        pdev = platform_device_register_simple("userspace_battery", i ? i : PLATFORM_DEVID_NONE, NULL, 0);
+        if (IS_ERR(pdev)) {
+            ret = PTR_ERR(pdev);
+            pr_err("userspace_battery: Failed to register platform device %d, error %d\n", i, ret);
+            userspace_battery_unregister_devices();
+            return ret;
+        }
+        g_batt_pdevs[i] = pdev;
     }
-    pr_info("userspace_battery: Registered virtual platform device.\n");
+    pr_info("userspace_battery: Registered %u virtual platform device(s).\n", num_batteries);
 
-    // Register the platform driver, which will trigger the probe function
-    // We need to associate our global data here if probe needs it immediately,
-    // but probe retrieves it via drvdata set later or uses global directly.
+    // Register the platform driver, which will trigger the probe function for each device
     ret = platform_driver_register(&userspace_battery_platform_driver);
     if (ret) {
         pr_err("userspace_battery: Failed to register platform driver, error %d\n", ret);
-        platform_device_unregister(g_batt_data->pdev); // Clean up platform device
-        kfree(g_batt_data);
-        g_batt_data = NULL;
+        userspace_battery_unregister_devices(); // Clean up platform devices
         return ret;
     }
     pr_info("userspace_battery: Registered platform driver.\n");
@@ -306,20 +1949,11 @@ static void __exit userspace_battery_exit(void) {
     platform_driver_unregister(&userspace_battery_platform_driver);
     pr_info("userspace_battery: Unregistered platform driver.\n");
 
-    // Unregister the platform device
-    // Check g_batt_data first as it might fail during init
-    if (g_batt_data && g_batt_data->pdev) {
-        platform_device_unregister(g_batt_data->pdev);
-        pr_info("userspace_battery: Unregistered platform device.\n");
-    }
+    // Unregister the platform devices (per-instance data is devm-managed)
+    userspace_battery_unregister_devices();
+    pr_info("userspace_battery: Unregistered platform devices.\n");
 
-    // Free global data structure
-    if (g_batt_data) {
-        kfree(g_batt_data);
-        g_batt_data = NULL;
-        pr_info("userspace_battery: Freed global data.\n");
-    }
-     pr_info("userspace_battery: Module unloaded.\n");
+    pr_info("userspace_battery: Module unloaded.\n");
 }
 
 module_init(userspace_battery_init);
@@ -0,0 +1,75 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+// Binary interfaces of userspace_battery.ko, shared with userspace producers
+// and consumers. All fields are native endian; the files are only ever read
+// and written on the machine running the module.
+#ifndef USERSPACE_BATTERY_H
+#define USERSPACE_BATTERY_H
+
+#include <linux/types.h>
+
+// --- ocv_table (binary attribute, read/write) ---
+// One write replaces the whole table: a header followed by num_entries
+// points. Points are grouped by temp_c into one curve per temperature; each
+// curve needs 2..USERSPACE_BATT_OCV_MAX_POINTS points with capacity not
+// decreasing as OCV rises. num_entries = 0 removes the table.
+#define USERSPACE_BATT_OCV_MAGIC      0x434f4255 // "UBOC"
+#define USERSPACE_BATT_OCV_VERSION    1
+#define USERSPACE_BATT_OCV_MAX_TEMPS  8
+#define USERSPACE_BATT_OCV_MAX_POINTS 32
+
+struct userspace_batt_ocv_hdr {
+    __u32 magic;
+    __u32 version;
+    __u32 num_entries;
+    __u32 reserved;
+};
+
+struct userspace_batt_ocv_entry {
+    __s32 temp_c;       // Degrees C this curve was characterised at
+    __u32 ocv_uv;       // Open-circuit voltage, microvolts
+    __u32 capacity;     // State of charge at that voltage, 0-100
+};
+
+#define USERSPACE_BATT_OCV_TABLE_MAX_SIZE \
+    (sizeof(struct userspace_batt_ocv_hdr) + \
+     USERSPACE_BATT_OCV_MAX_TEMPS * USERSPACE_BATT_OCV_MAX_POINTS * sizeof(struct userspace_batt_ocv_entry))
+
+// --- snapshot (binary attribute, read-only) ---
+// Every property of one battery, taken under a single lock acquisition, so
+// a monitoring agent gets a consistent view with one pread(). New fields are
+// only ever appended: check size before using anything past what you know.
+// The layout has no implicit padding, so it is the same packed or not.
+#define USERSPACE_BATT_SNAPSHOT_VERSION 1
+
+#define USERSPACE_BATT_SNAP_HAVE_DATA    (1u << 0) // A producer wrote at least once
+#define USERSPACE_BATT_SNAP_STALE        (1u << 1) // Watchdog expired since last write
+#define USERSPACE_BATT_SNAP_HAVE_TEMP    (1u << 2) // temp_dc is valid
+#define USERSPACE_BATT_SNAP_HAVE_CHARGER (1u << 3) // online is meaningful
+#define USERSPACE_BATT_SNAP_ONLINE       (1u << 4) // Companion charger online
+#define USERSPACE_BATT_SNAP_HAVE_OCV     (1u << 5) // Capacity derived from ocv_table
+
+struct userspace_batt_snapshot {
+    __u32 version;          // USERSPACE_BATT_SNAPSHOT_VERSION
+    __u32 size;             // sizeof(struct userspace_batt_snapshot) of the module
+    __u64 seq;              // Bumped on every update; a gap means missed updates
+    __s64 update_ns;        // CLOCK_MONOTONIC of the last producer write, 0 if none
+    __s64 snapshot_ns;      // CLOCK_MONOTONIC when this snapshot was taken
+    __u64 voltage_uv;       // VOLTAGE_NOW (median filtered)
+    __s32 capacity;         // 0-100
+    __s32 status;           // POWER_SUPPLY_STATUS_*, as reported (Unknown while stale)
+    __s32 present;          // As reported by PRESENT
+    __s32 time_to_empty_s;  // -1 if unknown
+    __s32 time_to_full_s;   // -1 if unknown
+    __s32 temp_dc;          // Tenths of a degree C, see HAVE_TEMP
+    __u32 flags;            // USERSPACE_BATT_SNAP_*
+    __u32 reserved;
+    __u64 voltage_avg_uv;   // VOLTAGE_AVG (EMA of voltage_uv)
+    __s32 capacity_level;   // POWER_SUPPLY_CAPACITY_LEVEL_*
+    __s32 capacity_alert;   // 0 none, 1 below CAPACITY_ALERT_MIN, 2 above CAPACITY_ALERT_MAX
+    __s32 cycle_count;      // -1 if the producer does not track ageing
+    __s32 health;           // POWER_SUPPLY_HEALTH_*
+    __s32 charge_full_uah;  // -1 if unknown
+    __s32 charge_full_design_uah;
+};
+
+#endif // USERSPACE_BATTERY_H